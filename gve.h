@@ -68,6 +68,10 @@
 /* Each RX bounce buffer page can fit two packet buffers. */
 #define GVE_DEFAULT_RX_BUFFER_OFFSET (PAGE_SIZE / 2)
 
+/* Header buffer sizes the driver accepts from the device for header split. */
+#define GVE_HEADER_BUF_SIZE_MIN 64
+#define GVE_HEADER_BUF_SIZE_MAX 256
+
 /* PTYPEs are always 10 bits. */
 #define GVE_NUM_PTYPES	1024
 
@@ -137,11 +141,14 @@ enum gve_state_flags_bit {
 	GVE_STATE_FLAG_LINK_UP,
 	GVE_STATE_FLAG_DO_RESET,
 	GVE_STATE_FLAG_IN_RESET,
+	GVE_STATE_FLAG_FAST_RESET,
 	GVE_NUM_STATE_FLAGS /* Not part of the enum space */
 };
 
 BITSET_DEFINE(gve_state_flags, GVE_NUM_STATE_FLAGS);
 
+#define GVE_RESET_OUTAGE_BUCKETS 12
+
 #define GVE_DEVICE_STATUS_RESET (0x1 << 1)
 #define GVE_DEVICE_STATUS_LINK_STATUS (0x1 << 2)
 
@@ -173,6 +180,7 @@ struct gve_irq {
 struct gve_rx_slot_page_info {
 	void *page_address;
 	vm_page_t page;
+	uint32_t page_idx; /* index of page in the ring's qpl */
 	uint32_t page_offset;
 	uint16_t pad;
 };
@@ -191,6 +199,55 @@ struct gve_rx_ctx {
 	bool drop_pkt;
 };
 
+/* Largest interval a DQO irq doorbell can hold: 12 bits of 2us units */
+#define GVE_ITR_MAX_USECS 8190
+/* Upper bounds of the busy-poll budget and the LRO sysctls */
+#define GVE_BUSY_POLL_MAX_USECS 1000
+#define GVE_LRO_PARAM_MAX 65535
+/* Upper bounds of the TX doorbell batching sysctls */
+#define GVE_TX_DB_BATCH_MAX_PKTS 4096
+#define GVE_TX_DB_BATCH_MAX_BYTES (4 * 1024 * 1024)
+/* Drain passes a sender makes for others before punting to the xmit tq */
+#define GVE_XMIT_DRAIN_ROUNDS 4
+
+/*
+ * Per-queue interrupt moderation, see gve_itr_rearm_usecs().
+ *
+ * DQO queues program the interval into the irq doorbell. GQI irq doorbells
+ * have no interval, so GQI queues emulate it by leaving the irq masked and
+ * polling again from `poll_callout` after the interval.
+ */
+struct gve_itr {
+	/* Interval to apply once a cleanup pass sees `frames` completions */
+	uint32_t usecs;
+	uint32_t frames;
+	/* When set, `cur_usecs` tracks the observed rates instead of `usecs` */
+	bool adaptive;
+	uint32_t cur_usecs;
+
+	/* Interval last written to a DQO irq doorbell */
+	uint32_t hw_usecs;
+
+	/* Counter snapshot that the adaptive mode computes rates against */
+	sbintime_t sample_time;
+	uint64_t sample_packets;
+	uint64_t sample_bytes;
+
+	struct callout poll_callout;
+};
+
+/* A NIC clock reading and the real time it was taken at, both in ns */
+struct gve_nic_ts_sync {
+	uint64_t nic_ns;
+	uint64_t real_ns;
+};
+
+/*
+ * Often enough for the 32 bit completion stamps, which wrap every 4.29s, to
+ * always be within 2^31 ns of the last sync.
+ */
+#define GVE_NIC_TS_SYNC_MS 250
+
 struct gve_ring_com {
 	struct gve_priv *priv;
 	uint32_t id;
@@ -236,8 +293,35 @@ struct gve_ring_com {
 
 	struct task cleanup_task;
 	struct taskqueue *cleanup_tq;
+
+	struct gve_itr itr;
+	/*
+	 * How long the cleanup task spins with the irq masked waiting for more
+	 * completions before re-arming the irq, see gve_busy_poll_spin().
+	 */
+	uint32_t busy_poll_usecs;
+
+#ifdef GVE_HISTOGRAMS
+	/* Uptime at the last interrupt, consumed by the next cleanup pass */
+	sbintime_t intr_time;
+#endif
 } __aligned(CACHE_LINE_SIZE);
 
+/*
+ * Buckets of the if_input batch size histogram: bucket n counts batches of
+ * [2^n, 2^(n+1)) packets and the last one every batch larger than that.
+ */
+#define GVE_RX_INPUT_BATCH_BUCKETS 8
+
+#ifdef GVE_HISTOGRAMS
+/*
+ * Buckets of the per-queue histograms built with GVE_HISTOGRAMS, laid out
+ * like the if_input batch histogram except that the first bucket also counts
+ * zero samples.
+ */
+#define GVE_HIST_BUCKETS 16
+#endif
+
 struct gve_rxq_stats {
 	counter_u64_t rbytes;
 	counter_u64_t rpackets;
@@ -245,11 +329,24 @@ struct gve_rxq_stats {
 	counter_u64_t rx_copybreak_cnt;
 	counter_u64_t rx_frag_flip_cnt;
 	counter_u64_t rx_frag_copy_cnt;
+	counter_u64_t rx_page_swap_cnt;
 	counter_u64_t rx_dropped_pkt_desc_err;
 	counter_u64_t rx_dropped_pkt_buf_post_fail;
 	counter_u64_t rx_dropped_pkt_mbuf_alloc_fail;
 	counter_u64_t rx_mbuf_dmamap_err;
 	counter_u64_t rx_mbuf_mclget_null;
+	counter_u64_t rx_hsplit_pkt;
+	counter_u64_t rx_hsplit_unsplit_pkt;
+	counter_u64_t rx_hsplit_bytes;
+	counter_u64_t rx_pool_hit;
+	counter_u64_t rx_pool_fallback;
+	counter_u64_t rx_mbuf_cache_empty;
+	counter_u64_t rx_pfil_dropped;
+	counter_u64_t rx_input_batch[GVE_RX_INPUT_BATCH_BUCKETS];
+#ifdef GVE_HISTOGRAMS
+	counter_u64_t rx_cleanup_work[GVE_HIST_BUCKETS];
+	counter_u64_t rx_intr_delay_us[GVE_HIST_BUCKETS];
+#endif
 };
 
 #define NUM_RX_STATS (sizeof(struct gve_rxq_stats) / sizeof(counter_u64_t))
@@ -285,6 +382,40 @@ struct gve_rx_buf_dqo {
 	SLIST_ENTRY(gve_rx_buf_dqo) slist_entry;
 };
 
+/*
+ * Mbufs allocated ahead of time for a rx ring to take without calling into
+ * UMA in the middle of a cleanup pass: header mbufs for GQI copybreak and
+ * cluster mbufs for DQO RDA buffer posts. The cache is topped up after a pass
+ * that leaves it with fewer than GVE_RX_MBUF_CACHE_LOWAT.
+ */
+#define GVE_RX_MBUF_CACHE_SIZE 128
+#define GVE_RX_MBUF_CACHE_LOWAT 32
+
+struct gve_rx_mbuf_cache {
+	struct mbuf *mbufs[GVE_RX_MBUF_CACHE_SIZE];
+	uint32_t cnt;
+	bool cluster; /* Whether the cached mbufs carry a cluster */
+};
+
+/*
+ * Per-queue copybreak threshold. Unless overridden, it is revisited once
+ * GVE_RX_COPYBREAK_WINDOW frags have gone by: it doubles when enough of them
+ * ran into a buffer shortage, since a copied frag gives its buffer straight
+ * back, and otherwise decays towards priv->rx_copybreak.
+ */
+#define GVE_RX_COPYBREAK_WINDOW 1024
+#define GVE_RX_COPYBREAK_MAX 1024
+/* One frag in this many being short of a buffer counts as pressure */
+#define GVE_RX_COPYBREAK_STARVED_DIV 16
+
+struct gve_rx_copybreak {
+	uint32_t thresh; /* Frags up to this length are copied */
+	uint32_t override; /* Fixed threshold set through sysctl, 0 to adapt */
+	uint32_t frags;
+	uint32_t copies;
+	uint32_t starved; /* Frags copied or left without a reposted buffer */
+};
+
 /* power-of-2 sized receive ring */
 struct gve_rx_ring {
 	struct gve_ring_com com;
@@ -303,6 +434,20 @@ struct gve_rx_ring {
 			struct gve_rx_slot_page_info *page_info;
 			uint32_t mask; /* masks the cnt and fill_cnt to the size of the ring */
 			uint8_t seq_no; /* helps traverse the descriptor ring */
+
+			/*
+			 * The qpl pages past the first rx_desc_cnt are spares,
+			 * swapped into a slot whose page cannot flip because the
+			 * stack still holds its other half. free_pages stacks
+			 * the spares the stack is done with, used_pages queues
+			 * the swapped out pages, oldest first, until it is.
+			 */
+			uint32_t *free_pages;
+			uint32_t *used_pages;
+			uint32_t num_spare_pages;
+			uint32_t free_page_cnt;
+			uint32_t used_page_head;
+			uint32_t used_page_cnt;
 		};
 
 		/* DQO-only fields */
@@ -314,17 +459,37 @@ struct gve_rx_ring {
 			struct gve_rx_buf_dqo *bufs; /* Parking place for posted buffers */
 			bus_dma_tag_t buf_dmatag; /* To dmamap posted mbufs with */
 
+			/*
+			 * Header split only: one priv->header_buf_size slot per
+			 * desc ring entry, which the device fills with the
+			 * headers of the packet completed at the same index.
+			 */
+			struct gve_dma_handle hdr_bufs_mem;
+			uint8_t *hdr_bufs;
+
 			uint32_t buf_cnt; /* Size of the bufs array */
 			uint32_t mask; /* One less than the sizes of the desc and compl rings */
 			uint32_t head; /* The index at which to post the next buffer at */
 			uint32_t tail; /* The index at which to receive the next compl at */
 			uint8_t cur_gen_bit; /* Gets flipped on every cycle of the compl ring */
-			SLIST_HEAD(, gve_rx_buf_dqo) free_bufs;
+			SLIST_HEAD(gve_rx_buf_list_dqo, gve_rx_buf_dqo) free_bufs;
+
+			/*
+			 * Only used in RDA mode: pre-mapped pages that buffers
+			 * are posted from ahead of freshly mapped cluster mbufs,
+			 * recycled the way QPL pages are. pool_bufs tracks them
+			 * with the QPL fields of gve_rx_buf_dqo.
+			 */
+			struct gve_queue_page_list *page_pool;
+			struct gve_rx_buf_dqo *pool_bufs;
+			uint32_t pool_buf_cnt;
+			struct gve_rx_buf_list_dqo pool_free_bufs;
 
 			/*
-			 * Only used in QPL mode. Pages referred to by if_input-ed mbufs
-			 * stay parked here till their wire count comes back to 1.
-			 * Pages are moved here after there aren't any pending completions.
+			 * Pages (QPL pages, or page pool pages in RDA mode) referred
+			 * to by if_input-ed mbufs stay parked here till their wire
+			 * count comes back to 1. Pages are moved here after there
+			 * aren't any pending completions.
 			 */
 			STAILQ_HEAD(, gve_rx_buf_dqo) used_bufs;
 		} dqo;
@@ -332,8 +497,21 @@ struct gve_rx_ring {
 
 	struct lro_ctrl lro;
 	struct gve_rx_ctx ctx;
+	struct gve_rx_mbuf_cache mbuf_cache;
+	struct gve_rx_copybreak copybreak;
 	struct gve_rxq_stats stats;
 
+	/* NIC-side counters, refreshed from the stats report by the service task */
+	uint64_t nic_queue_drops;
+	uint64_t nic_no_buffers_drops;
+	uint64_t nic_over_mru_drops;
+	uint64_t nic_bad_csum_drops;
+
+	/* Packets of the current cleanup pass waiting to be if_input-ed */
+	struct mbuf *input_head;
+	struct mbuf *input_tail;
+	uint32_t input_cnt;
+
 } __aligned(CACHE_LINE_SIZE);
 
 /*
@@ -359,6 +537,10 @@ struct gve_tx_buffer_state {
 	 * must be checked for validity when read.
 	 */
 	int64_t enqueue_time_sec;
+#ifdef GVE_HISTOGRAMS
+	/* Uptime at which the descriptors were written, for tx_compl_lat_us */
+	sbintime_t xmit_time;
+#endif
 
 	struct gve_tx_iovec iov[GVE_TX_MAX_DESCS];
 };
@@ -375,12 +557,25 @@ struct gve_txq_stats {
 	counter_u64_t tx_delayed_pkt_nospace_qpl_bufs;
 	counter_u64_t tx_delayed_pkt_tsoerr;
 	counter_u64_t tx_dropped_pkt_vlan;
+	counter_u64_t tx_xmit_handoff;
+	counter_u64_t tx_doorbells;
+	counter_u64_t tx_xmit_tq_deferred;
 	counter_u64_t tx_mbuf_collapse;
 	counter_u64_t tx_mbuf_defrag;
 	counter_u64_t tx_mbuf_defrag_err;
 	counter_u64_t tx_mbuf_dmamap_enomem_err;
 	counter_u64_t tx_mbuf_dmamap_err;
 	counter_u64_t tx_timeout;
+	counter_u64_t tx_copied_bytes;
+	counter_u64_t tx_zerocopy_bytes;
+	counter_u64_t tx_paced_pkt;
+	counter_u64_t tx_dropped_pkt_pacing;
+#ifdef GVE_HISTOGRAMS
+	counter_u64_t tx_cleanup_work[GVE_HIST_BUCKETS];
+	counter_u64_t tx_intr_delay_us[GVE_HIST_BUCKETS];
+	counter_u64_t tx_compl_lat_us[GVE_HIST_BUCKETS];
+	counter_u64_t tx_br_occupancy[GVE_HIST_BUCKETS];
+#endif
 };
 
 #define NUM_TX_STATS (sizeof(struct gve_txq_stats) / sizeof(counter_u64_t))
@@ -394,6 +589,10 @@ struct gve_tx_pending_pkt_dqo {
 	 * must be checked for validity when read.
 	 */
 	int64_t enqueue_time_sec;
+#ifdef GVE_HISTOGRAMS
+	/* Uptime at which the descriptors were written, for tx_compl_lat_us */
+	sbintime_t xmit_time;
+#endif
 
 	union {
 		/* RDA */
@@ -421,6 +620,13 @@ struct gve_tx_ring {
 	struct taskqueue *xmit_tq;
 	uint8_t stopped;
 
+	/*
+	 * Set by senders after enqueueing on br. The ring_mtx holder clears it
+	 * before draining and rechecks it after unlocking, so a sender losing
+	 * the trylock can leave its mbuf to the current drainer.
+	 */
+	uint32_t xmit_pending;
+
 	/* Accessed when writing descriptors */
 	struct buf_ring *br;
 	struct mtx ring_mtx;
@@ -548,6 +754,22 @@ struct gve_ptype_lut {
 	struct gve_ptype ptypes[GVE_NUM_PTYPES];
 };
 
+/* Largest RSS key and indirection table the driver will cache. */
+#define GVE_RSS_KEY_MAX_SIZE	64
+#define GVE_RSS_LUT_MAX_SIZE	512
+
+/*
+ * The driver's copy of the device's RSS config. It outlives resets and is
+ * pushed to the device whenever the queues are brought up.
+ */
+struct gve_rss_config {
+	uint8_t key[GVE_RSS_KEY_MAX_SIZE];
+	uint16_t lut[GVE_RSS_LUT_MAX_SIZE]; /* rx queue index for each hash bucket */
+	uint16_t key_size;
+	uint16_t lut_size;
+	uint16_t hash_types; /* GVE_RSS_HASH_* bits */
+};
+
 struct gve_priv {
 	if_t ifp;
 	device_t dev;
@@ -563,6 +785,34 @@ struct gve_priv {
 
 	uint32_t mgmt_msix_idx;
 	uint32_t rx_copybreak;
+	/*
+	 * LRO entries per rx ring, 0 for the kernel default, and the depth of
+	 * the per-ring mbuf queue that sorts packets by flow before LRO, 0 to
+	 * hand packets to LRO one at a time.
+	 */
+	uint32_t lro_entries;
+	uint32_t lro_mbufs;
+	/*
+	 * Packets and bytes a tx drain may queue before it is forced to write
+	 * the doorbell. The doorbell is always written once the br runs dry.
+	 */
+	uint32_t tx_db_batch_pkts;
+	uint32_t tx_db_batch_bytes;
+	/*
+	 * The first tx_ll_queues tx queues make up the low-latency class. It
+	 * takes packets with a DSCP set in tx_ll_dscp_mask and, if
+	 * tx_ll_max_len is not 0, non-TSO packets of at most that many bytes,
+	 * and rings its doorbell per packet. Everything else goes to the
+	 * remaining, bulk, queues.
+	 */
+	uint32_t tx_ll_queues;
+	uint32_t tx_ll_max_len;
+	uint64_t tx_ll_dscp_mask;
+	/*
+	 * Whether resets keep the adminq memory, ring taskqueues and LRO state
+	 * and only tell the device about the rings and QPLs again.
+	 */
+	bool fast_reset;
 
 	uint16_t num_event_counters;
 	uint16_t default_num_queues;
@@ -575,9 +825,19 @@ struct gve_priv {
 	uint16_t rx_pages_per_qpl;
 	uint64_t max_registered_pages;
 	uint64_t num_registered_pages;
+	/*
+	 * Wired qpls no ring currently holds, indexed by qpl id, kept for the
+	 * ring that gets that id next. Pages parked here plus the registered
+	 * ones stay within max_registered_pages.
+	 */
+	struct gve_queue_page_list **qpl_pool;
 	uint32_t supported_features;
 	uint16_t max_mtu;
+	uint16_t header_buf_size;
+	bool header_split_supported;
+	bool header_split_enabled;
 	bool modify_ringsize_enabled;
+	bool rss_config_enabled;
 
 	struct gve_dma_handle counter_array_mem;
 	__be32 *counters;
@@ -593,7 +853,51 @@ struct gve_priv {
 	struct gve_tx_ring *tx;
 	struct gve_rx_ring *rx;
 
+	/*
+	 * CPU that the irqs and taskqueues of the rx and tx queue with a given
+	 * index are bound to, and for each CPU the tx queue bound to it, if any,
+	 * so that unhashed traffic stays on the sending CPU.
+	 */
+	int *queue_cpus;
+	uint16_t *cpu_txq;
+
 	struct gve_ptype_lut *ptype_lut_dqo;
+	struct gve_rss_config rss_config;
+
+	/*
+	 * Region shared with the device for the stats report, sized for the max
+	 * queue counts, and the callout that has the service task refresh it.
+	 */
+	struct gve_dma_handle stats_report_mem;
+	struct gve_stats_report *stats_report;
+	uint64_t stats_report_len;
+	struct callout stats_report_callout;
+
+	/*
+	 * Rx hardware timestamps. The device stamps completions with the low
+	 * 32 bits of its nanosecond clock; every GVE_NIC_TS_SYNC_MS the nic_ts
+	 * task reads the full clock with the adminq next to nanotime() and
+	 * publishes the pair in the slot of nic_ts_sync that nic_ts_gen picks,
+	 * for the rx path to turn completion stamps into real time.
+	 */
+	bool nic_ts_supported;
+	struct gve_dma_handle nic_ts_report_mem;
+	struct gve_nic_ts_report *nic_ts_report;
+	struct callout nic_ts_callout;
+	struct task nic_ts_task;
+	struct gve_nic_ts_sync nic_ts_sync[2];
+	uint32_t nic_ts_gen; /* 0 until the first sync */
+
+	/*
+	 * Hooks linked to this head with pfilctl(8) see single-buffer packets
+	 * straight off the rings, before any mbuf is built for them. The head
+	 * is registered in rx_pfil_vnet, the vnet of the ifnet, and registered
+	 * again when the ifnet moves to another one.
+	 */
+	pfil_head_t rx_pfil;
+	struct vnet *rx_pfil_vnet;
+	eventhandler_tag rx_pfil_arrival;
+	char rx_pfil_name[IFNAMSIZ + 3];
 
 	/*
 	 * Admin queue - see gve_adminq.h
@@ -618,10 +922,18 @@ struct gve_priv {
 	uint32_t adminq_set_driver_parameter_cnt;
 	uint32_t adminq_verify_driver_compatibility_cnt;
 	uint32_t adminq_get_ptype_map_cnt;
+	uint32_t adminq_configure_rss_cnt;
+	uint32_t adminq_query_rss_cnt;
+	uint32_t adminq_report_stats_cnt;
+	uint32_t adminq_report_nic_ts_cnt;
 
 	uint32_t interface_up_cnt;
 	uint32_t interface_down_cnt;
 	uint32_t reset_cnt;
+	uint32_t reset_fast_cnt;
+	uint32_t reset_last_outage_us;
+	/* Resets by milliseconds of outage: [0, 2) in bucket 0, [2^n, 2^(n+1)) in n */
+	uint64_t reset_outage_ms[GVE_RESET_OUTAGE_BUCKETS];
 
 	struct task service_task;
 	struct taskqueue *service_tq;
@@ -666,11 +978,82 @@ gve_is_qpl(struct gve_priv *priv)
 	    priv->queue_format == GVE_DQO_QPL_FORMAT);
 }
 
+/*
+ * The number of active tx queues in the low-latency class, always leaving at
+ * least one bulk queue.
+ */
+static inline uint32_t
+gve_tx_ll_queues(struct gve_priv *priv)
+{
+	return (MIN(priv->tx_ll_queues, priv->tx_cfg.num_queues - 1));
+}
+
+/*
+ * Returns the rx pfil head if hooks are linked to it, NULL otherwise. The
+ * head stays valid for as long as the caller is in the net epoch.
+ */
+static inline pfil_head_t
+gve_rx_pfil_hooked(struct gve_priv *priv)
+{
+	pfil_head_t head = atomic_load_ptr(&priv->rx_pfil);
+
+	if (head == NULL || !PFIL_HOOKED_IN(head))
+		return (NULL);
+	return (head);
+}
+
+/*
+ * Loads the tx queue count and the size of the low-latency class in it once,
+ * for senders that can race a change of either.
+ */
+static inline uint32_t
+gve_tx_load_queues(struct gve_priv *priv, uint32_t *ll)
+{
+	uint32_t num_queues = atomic_load_16(&priv->tx_cfg.num_queues);
+
+	*ll = MIN(atomic_load_32(&priv->tx_ll_queues), num_queues - 1);
+	return (num_queues);
+}
+
+#ifdef GVE_HISTOGRAMS
+static inline void
+gve_hist_add(counter_u64_t *hist, uint64_t val)
+{
+	int bucket = val == 0 ? 0 : flsll(val) - 1;
+
+	counter_u64_add(hist[MIN(bucket, GVE_HIST_BUCKETS - 1)], 1);
+}
+
+/* Records how long the cleanup task took to run after the ring's interrupt. */
+static inline void
+gve_hist_intr_delay(struct gve_ring_com *com, counter_u64_t *hist)
+{
+	if (com->intr_time == 0)
+		return;
+	gve_hist_add(hist, sbttous(sbinuptime() - com->intr_time));
+	com->intr_time = 0;
+}
+#endif
+
+/* SDT probes defined in gve_main.c, see gve_main.c for their arguments */
+SDT_PROVIDER_DECLARE(gve);
+SDT_PROBE_DECLARE(gve, , tx, xmit__start);
+SDT_PROBE_DECLARE(gve, , tx, xmit__done);
+SDT_PROBE_DECLARE(gve, , tx, doorbell);
+SDT_PROBE_DECLARE(gve, , tx, completion);
+SDT_PROBE_DECLARE(gve, , rx, packet);
+SDT_PROBE_DECLARE(gve, , rx, copybreak);
+SDT_PROBE_DECLARE(gve, , rx, doorbell);
+SDT_PROBE_DECLARE(gve, , rx, post__fail);
+
 /* Defined in gve_main.c */
 void gve_schedule_reset(struct gve_priv *priv);
+int gve_up(struct gve_priv *priv);
+void gve_down(struct gve_priv *priv);
 int gve_adjust_tx_queues(struct gve_priv *priv, uint16_t new_queue_cnt);
 int gve_adjust_rx_queues(struct gve_priv *priv, uint16_t new_queue_cnt);
 int gve_adjust_ring_sizes(struct gve_priv *priv, uint16_t new_desc_cnt, bool is_rx);
+int gve_set_header_split(struct gve_priv *priv, bool enable);
 
 /* Register access functions defined in gve_utils.c */
 uint32_t gve_reg_bar_read_4(struct gve_priv *priv, bus_size_t offset);
@@ -682,8 +1065,19 @@ void gve_db_bar_dqo_write_4(struct gve_priv *priv, bus_size_t offset, uint32_t v
 struct gve_queue_page_list *gve_alloc_qpl(struct gve_priv *priv, uint32_t id,
     int npages, bool single_kva);
 void gve_free_qpl(struct gve_priv *priv, struct gve_queue_page_list *qpl);
+void gve_prealloc_qpls(struct gve_priv *priv, uint32_t first_id, int num_qpls,
+    int npages, bool single_kva);
+void gve_alloc_qpl_pool(struct gve_priv *priv);
+void gve_free_qpl_pool(struct gve_priv *priv);
+struct gve_queue_page_list *gve_alloc_page_pool(struct gve_priv *priv,
+    uint32_t id, int npages);
+void gve_free_page_pool(struct gve_queue_page_list *qpl);
 int gve_register_qpls(struct gve_priv *priv);
 int gve_unregister_qpls(struct gve_priv *priv);
+int gve_register_qpl_range(struct gve_priv *priv, bool is_rx, uint16_t start_idx,
+    uint16_t stop_idx);
+int gve_unregister_qpl_range(struct gve_priv *priv, bool is_rx, uint16_t start_idx,
+    uint16_t stop_idx);
 void gve_mextadd_free(struct mbuf *mbuf);
 
 /* TX functions defined in gve_tx.c */
@@ -691,12 +1085,20 @@ int gve_alloc_tx_rings(struct gve_priv *priv, uint16_t start_idx, uint16_t stop_
 void gve_free_tx_rings(struct gve_priv *priv, uint16_t start_idx, uint16_t stop_idx);
 int gve_create_tx_rings(struct gve_priv *priv);
 int gve_destroy_tx_rings(struct gve_priv *priv);
+int gve_create_tx_ring_range(struct gve_priv *priv, uint16_t start_idx,
+    uint16_t stop_idx);
+int gve_destroy_tx_ring_range(struct gve_priv *priv, uint16_t start_idx,
+    uint16_t stop_idx);
 int gve_check_tx_timeout_gqi(struct gve_priv *priv, struct gve_tx_ring *tx);
 int gve_tx_intr(void *arg);
 int gve_xmit_ifp(if_t ifp, struct mbuf *mbuf);
+int gve_xmit_txq(struct gve_tx_ring *tx, struct mbuf *mbuf);
 void gve_qflush(if_t ifp);
 void gve_xmit_tq(void *arg, int pending);
 void gve_tx_cleanup_tq(void *arg, int pending);
+#ifdef DEV_NETMAP
+int gve_netmap_txsync_gqi(struct netmap_kring *kring, int flags);
+#endif
 
 /* TX functions defined in gve_tx_dqo.c */
 int gve_tx_alloc_ring_dqo(struct gve_priv *priv, int i);
@@ -707,14 +1109,39 @@ int gve_tx_intr_dqo(void *arg);
 int gve_xmit_dqo(struct gve_tx_ring *tx, struct mbuf **mbuf_ptr);
 int gve_xmit_dqo_qpl(struct gve_tx_ring *tx, struct mbuf *mbuf);
 void gve_tx_cleanup_tq_dqo(void *arg, int pending);
+#ifdef DEV_NETMAP
+int gve_netmap_txsync_dqo(struct netmap_kring *kring, int flags);
+#endif
+
+/* Send tag functions defined in gve_snd_tag.c */
+int gve_snd_tag_alloc(if_t ifp, union if_snd_tag_alloc_params *params,
+    struct m_snd_tag **mstp);
+int gve_rl_tag_xmit(struct gve_priv *priv, struct mbuf *mbuf);
+void gve_snd_tag_detach(struct gve_priv *priv);
+int gve_snd_tag_unload(void);
 
 /* RX functions defined in gve_rx.c */
 int gve_alloc_rx_rings(struct gve_priv *priv, uint16_t start_idx, uint16_t stop_idx);
 void gve_free_rx_rings(struct gve_priv *priv, uint16_t start_idx, uint16_t stop_idx);
 int gve_create_rx_rings(struct gve_priv *priv);
 int gve_destroy_rx_rings(struct gve_priv *priv);
+int gve_create_rx_ring_range(struct gve_priv *priv, uint16_t start_idx,
+    uint16_t stop_idx);
+int gve_destroy_rx_ring_range(struct gve_priv *priv, uint16_t start_idx,
+    uint16_t stop_idx);
 int gve_rx_intr(void *arg);
 void gve_rx_cleanup_tq(void *arg, int pending);
+bool gve_rx_lro(struct gve_rx_ring *rx, struct mbuf *mbuf);
+void gve_rx_input(struct gve_rx_ring *rx, struct mbuf *mbuf);
+struct mbuf *gve_rx_mbuf_cache_get(struct gve_rx_ring *rx, int how);
+void gve_rx_mbuf_cache_refill(struct gve_rx_ring *rx, int how);
+void gve_rx_copybreak_adapt(struct gve_rx_ring *rx);
+bool gve_rx_pfil(struct gve_rx_ring *rx, pfil_head_t head, void *va,
+    uint16_t len);
+void gve_rx_input_flush(struct gve_rx_ring *rx);
+#ifdef DEV_NETMAP
+int gve_netmap_rxsync_gqi(struct netmap_kring *kring, int flags);
+#endif
 
 /* RX functions defined in gve_rx_dqo.c */
 int gve_rx_alloc_ring_dqo(struct gve_priv *priv, int i);
@@ -723,6 +1150,22 @@ void gve_rx_prefill_buffers_dqo(struct gve_rx_ring *rx);
 void gve_clear_rx_ring_dqo(struct gve_priv *priv, int i);
 int gve_rx_intr_dqo(void *arg);
 void gve_rx_cleanup_tq_dqo(void *arg, int pending);
+#ifdef DEV_NETMAP
+int gve_netmap_rxsync_dqo(struct netmap_kring *kring, int flags);
+#endif
+
+#ifdef DEV_NETMAP
+/* Netmap functions defined in gve_netmap.c */
+void gve_netmap_attach(struct gve_priv *priv);
+bool gve_netmap_on(struct gve_priv *priv);
+void gve_netmap_reset_ring(struct gve_priv *priv, int i, bool is_rx);
+bool gve_netmap_rx_irq(struct gve_rx_ring *rx);
+bool gve_netmap_tx_irq(struct gve_tx_ring *tx);
+void gve_netmap_copy_slots(struct netmap_kring *kring, u_int nm_i,
+    uint32_t off, uint32_t len, char *dst);
+bool gve_netmap_tx_pkt_bounds(struct netmap_kring *kring, u_int nm_i,
+    u_int stop_i, u_int *last_i, uint32_t *pkt_len, bool *has_empty_slot);
+#endif
 
 /* DMA functions defined in gve_utils.c */
 int gve_dma_alloc_coherent(struct gve_priv *priv, int size, int align,
@@ -737,8 +1180,22 @@ void gve_free_irqs(struct gve_priv *priv);
 int gve_alloc_irqs(struct gve_priv *priv);
 void gve_unmask_all_queue_irqs(struct gve_priv *priv);
 void gve_mask_all_queue_irqs(struct gve_priv *priv);
+void gve_unmask_queue_irq(struct gve_priv *priv, struct gve_ring_com *com);
+void gve_mask_queue_irq(struct gve_priv *priv, struct gve_ring_com *com);
+void gve_alloc_queue_cpus(struct gve_priv *priv);
+void gve_free_queue_cpus(struct gve_priv *priv);
+void gve_update_cpu_txq(struct gve_priv *priv);
+void gve_bind_queue(struct gve_priv *priv, struct gve_ring_com *com);
+void gve_itr_init(struct gve_ring_com *com, uint32_t usecs);
+uint32_t gve_itr_rearm_usecs(struct gve_ring_com *com, uint32_t work_done,
+    counter_u64_t packets, counter_u64_t bytes);
+uint32_t gve_itr_db_val_dqo(struct gve_ring_com *com, uint32_t usecs);
+void gve_itr_schedule_poll(struct gve_ring_com *com, uint32_t usecs);
+void gve_itr_stop(struct gve_ring_com *com);
+bool gve_busy_poll_spin(struct gve_ring_com *com, sbintime_t *deadline);
 
 /* Miscellaneous functions defined in gve_utils.c */
+void gve_rx_strip_vlan(struct mbuf *mbuf);
 void gve_invalidate_timestamp(int64_t *timestamp_sec);
 int64_t gve_seconds_since(int64_t *timestamp_sec);
 void gve_set_timestamp(int64_t *timestamp_sec);
@@ -746,6 +1203,8 @@ bool gve_timestamp_valid(int64_t *timestamp_sec);
 
 /* Systcl functions defined in gve_sysctl.c */
 extern bool gve_disable_hw_lro;
+extern bool gve_rx_page_pool;
+extern uint32_t gve_stats_report_interval;
 extern char gve_queue_format[8];
 extern char gve_version[8];
 void gve_setup_sysctl(struct gve_priv *priv);
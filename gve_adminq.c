@@ -60,7 +60,10 @@ void gve_parse_device_option(struct gve_priv *priv,
     struct gve_device_option_dqo_rda **dev_op_dqo_rda,
     struct gve_device_option_dqo_qpl **dev_op_dqo_qpl,
     struct gve_device_option_modify_ring **dev_op_modify_ring,
-    struct gve_device_option_jumbo_frames **dev_op_jumbo_frames)
+    struct gve_device_option_jumbo_frames **dev_op_jumbo_frames,
+    struct gve_device_option_buffer_sizes **dev_op_buffer_sizes,
+    struct gve_device_option_rss_config **dev_op_rss_config,
+    struct gve_device_option_nic_timestamp **dev_op_nic_timestamp)
 {
 	uint32_t req_feat_mask = be32toh(option->required_features_mask);
 	uint16_t option_length = be16toh(option->option_length);
@@ -167,6 +170,57 @@ void gve_parse_device_option(struct gve_priv *priv,
 		*dev_op_jumbo_frames = (void *)(option + 1);
 		break;
 
+	case GVE_DEV_OPT_ID_BUFFER_SIZES:
+		if (option_length < sizeof(**dev_op_buffer_sizes) ||
+		    req_feat_mask != GVE_DEV_OPT_REQ_FEAT_MASK_BUFFER_SIZES) {
+			device_printf(priv->dev, GVE_DEVICE_OPTION_ERROR_FMT,
+			    "Buffer Sizes", (int)sizeof(**dev_op_buffer_sizes),
+			    GVE_DEV_OPT_REQ_FEAT_MASK_BUFFER_SIZES,
+			    option_length, req_feat_mask);
+			break;
+		}
+
+		if (option_length > sizeof(**dev_op_buffer_sizes)) {
+			device_printf(priv->dev,
+			    GVE_DEVICE_OPTION_TOO_BIG_FMT, "Buffer Sizes");
+		}
+		*dev_op_buffer_sizes = (void *)(option + 1);
+		break;
+
+	case GVE_DEV_OPT_ID_RSS_CONFIG:
+		if (option_length < sizeof(**dev_op_rss_config) ||
+		    req_feat_mask != GVE_DEV_OPT_REQ_FEAT_MASK_RSS_CONFIG) {
+			device_printf(priv->dev, GVE_DEVICE_OPTION_ERROR_FMT,
+			    "RSS config", (int)sizeof(**dev_op_rss_config),
+			    GVE_DEV_OPT_REQ_FEAT_MASK_RSS_CONFIG,
+			    option_length, req_feat_mask);
+			break;
+		}
+
+		if (option_length > sizeof(**dev_op_rss_config)) {
+			device_printf(priv->dev,
+			    GVE_DEVICE_OPTION_TOO_BIG_FMT, "RSS config");
+		}
+		*dev_op_rss_config = (void *)(option + 1);
+		break;
+
+	case GVE_DEV_OPT_ID_NIC_TIMESTAMP:
+		if (option_length < sizeof(**dev_op_nic_timestamp) ||
+		    req_feat_mask != GVE_DEV_OPT_REQ_FEAT_MASK_NIC_TIMESTAMP) {
+			device_printf(priv->dev, GVE_DEVICE_OPTION_ERROR_FMT,
+			    "NIC timestamp", (int)sizeof(**dev_op_nic_timestamp),
+			    GVE_DEV_OPT_REQ_FEAT_MASK_NIC_TIMESTAMP,
+			    option_length, req_feat_mask);
+			break;
+		}
+
+		if (option_length > sizeof(**dev_op_nic_timestamp)) {
+			device_printf(priv->dev,
+			    GVE_DEVICE_OPTION_TOO_BIG_FMT, "NIC timestamp");
+		}
+		*dev_op_nic_timestamp = (void *)(option + 1);
+		break;
+
 	default:
 		/*
 		 * If we don't recognize the option just continue
@@ -185,7 +239,10 @@ gve_process_device_options(struct gve_priv *priv,
     struct gve_device_option_dqo_rda **dev_op_dqo_rda,
     struct gve_device_option_dqo_qpl **dev_op_dqo_qpl,
     struct gve_device_option_modify_ring **dev_op_modify_ring,
-    struct gve_device_option_jumbo_frames **dev_op_jumbo_frames)
+    struct gve_device_option_jumbo_frames **dev_op_jumbo_frames,
+    struct gve_device_option_buffer_sizes **dev_op_buffer_sizes,
+    struct gve_device_option_rss_config **dev_op_rss_config,
+    struct gve_device_option_nic_timestamp **dev_op_nic_timestamp)
 {
 	char *desc_end = (char *)descriptor + be16toh(descriptor->total_length);
 	const int num_options = be16toh(descriptor->num_device_options);
@@ -207,7 +264,10 @@ gve_process_device_options(struct gve_priv *priv,
 		    dev_op_dqo_rda,
 		    dev_op_dqo_qpl,
 		    dev_op_modify_ring,
-		    dev_op_jumbo_frames);
+		    dev_op_jumbo_frames,
+		    dev_op_buffer_sizes,
+		    dev_op_rss_config,
+		    dev_op_nic_timestamp);
 		dev_opt = (void *)((char *)(dev_opt + 1) + be16toh(dev_opt->option_length));
 	}
 
@@ -216,6 +276,11 @@ gve_process_device_options(struct gve_priv *priv,
 
 static int gve_adminq_execute_cmd(struct gve_priv *priv,
     struct gve_adminq_command *cmd);
+static int gve_adminq_issue_cmd(struct gve_priv *priv,
+    struct gve_adminq_command *cmd_orig);
+static int gve_adminq_kick_and_wait(struct gve_priv *priv);
+static int gve_adminq_check_idle(struct gve_priv *priv);
+static void gve_adminq_flush(struct gve_priv *priv);
 
 static int
 gve_adminq_destroy_tx_queue(struct gve_priv *priv, uint32_t id)
@@ -225,7 +290,7 @@ gve_adminq_destroy_tx_queue(struct gve_priv *priv, uint32_t id)
 	cmd.opcode = htobe32(GVE_ADMINQ_DESTROY_TX_QUEUE);
 	cmd.destroy_tx_queue.queue_id = htobe32(id);
 
-	return (gve_adminq_execute_cmd(priv, &cmd));
+	return (gve_adminq_issue_cmd(priv, &cmd));
 }
 
 static int
@@ -236,48 +301,76 @@ gve_adminq_destroy_rx_queue(struct gve_priv *priv, uint32_t id)
 	cmd.opcode = htobe32(GVE_ADMINQ_DESTROY_RX_QUEUE);
 	cmd.destroy_rx_queue.queue_id = htobe32(id);
 
-	return (gve_adminq_execute_cmd(priv, &cmd));
+	return (gve_adminq_issue_cmd(priv, &cmd));
 }
 
+/* Queues one destroy command per queue and waits for them all at once. */
 int
-gve_adminq_destroy_rx_queues(struct gve_priv *priv, uint32_t num_queues)
+gve_adminq_destroy_rx_queues(struct gve_priv *priv, uint32_t start_idx,
+    uint32_t stop_idx)
 {
 	int err;
 	int i;
 
-	for (i = 0; i < num_queues; i++) {
+	err = gve_adminq_check_idle(priv);
+	if (err != 0)
+		return (err);
+
+	for (i = start_idx; i < stop_idx; i++) {
 		err = gve_adminq_destroy_rx_queue(priv, i);
 		if (err != 0) {
 			device_printf(priv->dev, "Failed to destroy rxq %d, err: %d\n",
 			    i, err);
+			gve_adminq_flush(priv);
+			return (err);
 		}
 	}
 
-	if (err != 0)
+	err = gve_adminq_kick_and_wait(priv);
+	if (err != 0) {
+		device_printf(priv->dev,
+		    "Failed to destroy rxqs %d to %d, err: %d\n",
+		    start_idx, stop_idx - 1, err);
 		return (err);
+	}
 
-	device_printf(priv->dev, "Destroyed %d rx queues\n", num_queues);
+	device_printf(priv->dev, "Destroyed %d rx queues\n",
+	    stop_idx - start_idx);
 	return (0);
 }
 
+/* Queues one destroy command per queue and waits for them all at once. */
 int
-gve_adminq_destroy_tx_queues(struct gve_priv *priv, uint32_t num_queues)
+gve_adminq_destroy_tx_queues(struct gve_priv *priv, uint32_t start_idx,
+    uint32_t stop_idx)
 {
 	int err;
 	int i;
 
-	for (i = 0; i < num_queues; i++) {
+	err = gve_adminq_check_idle(priv);
+	if (err != 0)
+		return (err);
+
+	for (i = start_idx; i < stop_idx; i++) {
 		err = gve_adminq_destroy_tx_queue(priv, i);
 		if (err != 0) {
 			device_printf(priv->dev, "Failed to destroy txq %d, err: %d\n",
 			    i, err);
+			gve_adminq_flush(priv);
+			return (err);
 		}
 	}
 
-	if (err != 0)
+	err = gve_adminq_kick_and_wait(priv);
+	if (err != 0) {
+		device_printf(priv->dev,
+		    "Failed to destroy txqs %d to %d, err: %d\n",
+		    start_idx, stop_idx - 1, err);
 		return (err);
+	}
 
-	device_printf(priv->dev, "Destroyed %d tx queues\n", num_queues);
+	device_printf(priv->dev, "Destroyed %d tx queues\n",
+	    stop_idx - start_idx);
 	return (0);
 }
 
@@ -320,18 +413,27 @@ gve_adminq_create_rx_queue(struct gve_priv *priv, uint32_t queue_index)
 		cmd.create_rx_queue.enable_rsc =
 		    !!((if_getcapenable(priv->ifp) & IFCAP_LRO) &&
 			!gve_disable_hw_lro);
+		if (priv->header_split_enabled)
+			cmd.create_rx_queue.header_buffer_size =
+			    htobe16(priv->header_buf_size);
 	}
 
-	return (gve_adminq_execute_cmd(priv, &cmd));
+	return (gve_adminq_issue_cmd(priv, &cmd));
 }
 
+/* Queues one create command per queue and waits for them all at once. */
 int
-gve_adminq_create_rx_queues(struct gve_priv *priv, uint32_t num_queues)
+gve_adminq_create_rx_queues(struct gve_priv *priv, uint32_t start_idx,
+    uint32_t stop_idx)
 {
 	int err;
 	int i;
 
-	for (i = 0; i < num_queues; i++) {
+	err = gve_adminq_check_idle(priv);
+	if (err != 0)
+		return (err);
+
+	for (i = start_idx; i < stop_idx; i++) {
 		err = gve_adminq_create_rx_queue(priv, i);
 		if (err != 0) {
 			device_printf(priv->dev, "Failed to create rxq %d, err: %d\n",
@@ -340,12 +442,23 @@ gve_adminq_create_rx_queues(struct gve_priv *priv, uint32_t num_queues)
 		}
 	}
 
+	err = gve_adminq_kick_and_wait(priv);
+	if (err != 0) {
+		device_printf(priv->dev,
+		    "Failed to create rxqs %d to %d, err: %d\n",
+		    start_idx, stop_idx - 1, err);
+		goto abort;
+	}
+
 	if (bootverbose)
-		device_printf(priv->dev, "Created %d rx queues\n", num_queues);
+		device_printf(priv->dev, "Created %d rx queues\n",
+		    stop_idx - start_idx);
 	return (0);
 
 abort:
-	gve_adminq_destroy_rx_queues(priv, i);
+	/* Only the queues whose create command made it onto the adminq */
+	gve_adminq_flush(priv);
+	gve_adminq_destroy_rx_queues(priv, start_idx, i);
 	return (err);
 }
 
@@ -378,16 +491,22 @@ gve_adminq_create_tx_queue(struct gve_priv *priv, uint32_t queue_index)
 		cmd.create_tx_queue.tx_comp_ring_size =
 		    htobe16(priv->tx_desc_cnt);
 	}
-	return (gve_adminq_execute_cmd(priv, &cmd));
+	return (gve_adminq_issue_cmd(priv, &cmd));
 }
 
+/* Queues one create command per queue and waits for them all at once. */
 int
-gve_adminq_create_tx_queues(struct gve_priv *priv, uint32_t num_queues)
+gve_adminq_create_tx_queues(struct gve_priv *priv, uint32_t start_idx,
+    uint32_t stop_idx)
 {
 	int err;
 	int i;
 
-	for (i = 0; i < num_queues; i++) {
+	err = gve_adminq_check_idle(priv);
+	if (err != 0)
+		return (err);
+
+	for (i = start_idx; i < stop_idx; i++) {
 		err = gve_adminq_create_tx_queue(priv, i);
 		if (err != 0) {
 			device_printf(priv->dev, "Failed to create txq %d, err: %d\n",
@@ -396,12 +515,23 @@ gve_adminq_create_tx_queues(struct gve_priv *priv, uint32_t num_queues)
 		}
 	}
 
+	err = gve_adminq_kick_and_wait(priv);
+	if (err != 0) {
+		device_printf(priv->dev,
+		    "Failed to create txqs %d to %d, err: %d\n",
+		    start_idx, stop_idx - 1, err);
+		goto abort;
+	}
+
 	if (bootverbose)
-		device_printf(priv->dev, "Created %d tx queues\n", num_queues);
+		device_printf(priv->dev, "Created %d tx queues\n",
+		    stop_idx - start_idx);
 	return (0);
 
 abort:
-	gve_adminq_destroy_tx_queues(priv, i);
+	/* Only the queues whose create command made it onto the adminq */
+	gve_adminq_flush(priv);
+	gve_adminq_destroy_tx_queues(priv, start_idx, i);
 	return (err);
 }
 
@@ -422,7 +552,10 @@ static void
 gve_enable_supported_features(struct gve_priv *priv,
     uint32_t supported_features_mask,
     const struct gve_device_option_modify_ring *dev_op_modify_ring,
-    const struct gve_device_option_jumbo_frames *dev_op_jumbo_frames)
+    const struct gve_device_option_jumbo_frames *dev_op_jumbo_frames,
+    const struct gve_device_option_buffer_sizes *dev_op_buffer_sizes,
+    const struct gve_device_option_rss_config *dev_op_rss_config,
+    const struct gve_device_option_nic_timestamp *dev_op_nic_timestamp)
 {
 	if (dev_op_modify_ring &&
 	    (supported_features_mask & GVE_SUP_MODIFY_RING_MASK)) {
@@ -440,6 +573,60 @@ gve_enable_supported_features(struct gve_priv *priv,
 			    be16toh(dev_op_jumbo_frames->max_mtu));
 		priv->max_mtu = be16toh(dev_op_jumbo_frames->max_mtu);
 	}
+
+	/* Header split needs the split-aware DQO RDA receive path. */
+	if (dev_op_buffer_sizes &&
+	    (supported_features_mask & GVE_SUP_BUFFER_SIZES_MASK) &&
+	    priv->queue_format == GVE_DQO_RDA_FORMAT) {
+		priv->header_buf_size =
+		    be16toh(dev_op_buffer_sizes->header_buffer_size);
+		if (priv->header_buf_size < GVE_HEADER_BUF_SIZE_MIN ||
+		    priv->header_buf_size > GVE_HEADER_BUF_SIZE_MAX) {
+			device_printf(priv->dev,
+			    "Buffer sizes device option has unsupported "
+			    "header buffer size %u.\n", priv->header_buf_size);
+			priv->header_buf_size = 0;
+		} else {
+			if (bootverbose)
+				device_printf(priv->dev,
+				    "BUFFER SIZES device option enabled: "
+				    "header buffer %u.\n",
+				    priv->header_buf_size);
+			priv->header_split_supported = true;
+		}
+	}
+
+	if (dev_op_rss_config &&
+	    (supported_features_mask & GVE_SUP_RSS_CONFIG_MASK)) {
+		priv->rss_config.key_size =
+		    be16toh(dev_op_rss_config->hash_key_size);
+		priv->rss_config.lut_size =
+		    be16toh(dev_op_rss_config->hash_lut_size);
+		if (priv->rss_config.key_size == 0 ||
+		    priv->rss_config.key_size > GVE_RSS_KEY_MAX_SIZE ||
+		    priv->rss_config.lut_size == 0 ||
+		    priv->rss_config.lut_size > GVE_RSS_LUT_MAX_SIZE) {
+			device_printf(priv->dev,
+			    "RSS config device option has unsupported sizes: "
+			    "key %u, lut %u.\n", priv->rss_config.key_size,
+			    priv->rss_config.lut_size);
+		} else {
+			if (bootverbose)
+				device_printf(priv->dev,
+				    "RSS CONFIG device option enabled.\n");
+			priv->rss_config_enabled = true;
+		}
+	}
+
+	/* Only DQO completions carry the rx timestamp. */
+	if (dev_op_nic_timestamp &&
+	    (supported_features_mask & GVE_SUP_NIC_TIMESTAMP_MASK) &&
+	    !gve_is_gqi(priv)) {
+		if (bootverbose)
+			device_printf(priv->dev,
+			    "NIC TIMESTAMP device option enabled.\n");
+		priv->nic_ts_supported = true;
+	}
 }
 
 int
@@ -453,6 +640,9 @@ gve_adminq_describe_device(struct gve_priv *priv)
 	struct gve_device_option_dqo_qpl *dev_op_dqo_qpl = NULL;
 	struct gve_device_option_modify_ring *dev_op_modify_ring = NULL;
 	struct gve_device_option_jumbo_frames *dev_op_jumbo_frames = NULL;
+	struct gve_device_option_buffer_sizes *dev_op_buffer_sizes = NULL;
+	struct gve_device_option_rss_config *dev_op_rss_config = NULL;
+	struct gve_device_option_nic_timestamp *dev_op_nic_timestamp = NULL;
 	uint32_t supported_features_mask = 0;
 	int rc;
 	int i;
@@ -489,7 +679,10 @@ gve_adminq_describe_device(struct gve_priv *priv)
 	    &dev_op_dqo_rda,
 	    &dev_op_dqo_qpl,
 	    &dev_op_modify_ring,
-	    &dev_op_jumbo_frames);
+	    &dev_op_jumbo_frames,
+	    &dev_op_buffer_sizes,
+	    &dev_op_rss_config,
+	    &dev_op_nic_timestamp);
 	if (rc != 0)
 		goto free_device_descriptor;
 
@@ -541,7 +734,8 @@ gve_adminq_describe_device(struct gve_priv *priv)
 	priv->max_tx_desc_cnt = priv->tx_desc_cnt;
 
 	gve_enable_supported_features(priv, supported_features_mask,
-	    dev_op_modify_ring, dev_op_jumbo_frames);
+	    dev_op_modify_ring, dev_op_jumbo_frames, dev_op_buffer_sizes,
+	    dev_op_rss_config, dev_op_nic_timestamp);
 
 	for (i = 0; i < ETHER_ADDR_LEN; i++)
 		priv->mac[i] = desc->mac[i];
@@ -552,42 +746,113 @@ free_device_descriptor:
 	return (rc);
 }
 
-int
-gve_adminq_register_page_list(struct gve_priv *priv,
-    struct gve_queue_page_list *qpl)
+/* Copies the qpl's page addresses into dma and points cmd at them. */
+static int
+gve_adminq_fill_page_list_cmd(struct gve_priv *priv,
+    struct gve_queue_page_list *qpl, struct gve_dma_handle *dma,
+    struct gve_adminq_command *cmd)
 {
-	struct gve_adminq_command cmd = (struct gve_adminq_command){};
 	uint32_t num_entries = qpl->num_pages;
 	uint32_t size = num_entries * sizeof(qpl->dmas[0].bus_addr);
 	__be64 *page_list;
-	struct gve_dma_handle dma;
 	int err;
 	int i;
 
-	err = gve_dma_alloc_coherent(priv, size, PAGE_SIZE, &dma);
+	err = gve_dma_alloc_coherent(priv, size, PAGE_SIZE, dma);
 	if (err != 0)
 		return (ENOMEM);
 
-	page_list = dma.cpu_addr;
+	page_list = dma->cpu_addr;
 
 	for (i = 0; i < num_entries; i++)
 		page_list[i] = htobe64(qpl->dmas[i].bus_addr);
 
-	bus_dmamap_sync(dma.tag, dma.map, BUS_DMASYNC_PREWRITE);
+	bus_dmamap_sync(dma->tag, dma->map, BUS_DMASYNC_PREWRITE);
 
-	cmd.opcode = htobe32(GVE_ADMINQ_REGISTER_PAGE_LIST);
-	cmd.reg_page_list = (struct gve_adminq_register_page_list) {
+	cmd->opcode = htobe32(GVE_ADMINQ_REGISTER_PAGE_LIST);
+	cmd->reg_page_list = (struct gve_adminq_register_page_list) {
 		.page_list_id = htobe32(qpl->id),
 		.num_pages = htobe32(num_entries),
-		.page_address_list_addr = htobe64(dma.bus_addr),
+		.page_address_list_addr = htobe64(dma->bus_addr),
 		.page_size = htobe64(PAGE_SIZE),
 	};
 
+	return (0);
+}
+
+int
+gve_adminq_register_page_list(struct gve_priv *priv,
+    struct gve_queue_page_list *qpl)
+{
+	struct gve_adminq_command cmd = (struct gve_adminq_command){};
+	struct gve_dma_handle dma;
+	int err;
+
+	err = gve_adminq_fill_page_list_cmd(priv, qpl, &dma, &cmd);
+	if (err != 0)
+		return (err);
+
 	err = gve_adminq_execute_cmd(priv, &cmd);
 	gve_dma_free_coherent(&dma);
 	return (err);
 }
 
+static struct gve_queue_page_list *
+gve_adminq_ring_qpl(struct gve_priv *priv, bool is_rx, int i)
+{
+	return (is_rx ? priv->rx[i].com.qpl : priv->tx[i].com.qpl);
+}
+
+/*
+ * Registers the qpls of the rx or tx rings in [start_idx, stop_idx) with a
+ * single kick and wait. The page address lists must stay around until the
+ * device has gone through every command.
+ */
+int
+gve_adminq_register_page_lists(struct gve_priv *priv, bool is_rx,
+    uint32_t start_idx, uint32_t stop_idx)
+{
+	struct gve_adminq_command cmd;
+	struct gve_dma_handle *dmas;
+	int wait_err;
+	int err;
+	int i;
+
+	if (start_idx == stop_idx)
+		return (0);
+
+	err = gve_adminq_check_idle(priv);
+	if (err != 0)
+		return (err);
+
+	dmas = malloc(sizeof(*dmas) * (stop_idx - start_idx), M_GVE,
+	    M_WAITOK | M_ZERO);
+
+	for (i = start_idx; i < stop_idx; i++) {
+		cmd = (struct gve_adminq_command){};
+		err = gve_adminq_fill_page_list_cmd(priv,
+		    gve_adminq_ring_qpl(priv, is_rx, i), &dmas[i - start_idx],
+		    &cmd);
+		if (err != 0)
+			break;
+		err = gve_adminq_issue_cmd(priv, &cmd);
+		if (err != 0)
+			break;
+	}
+
+	/* Whatever got queued is run before its page lists are freed */
+	wait_err = gve_adminq_kick_and_wait(priv);
+	if (err == 0)
+		err = wait_err;
+
+	for (i = 0; i < stop_idx - start_idx; i++) {
+		if (dmas[i].cpu_addr != NULL)
+			gve_dma_free_coherent(&dmas[i]);
+	}
+	free(dmas, M_GVE);
+	return (err);
+}
+
 int
 gve_adminq_unregister_page_list(struct gve_priv *priv, uint32_t page_list_id)
 {
@@ -601,6 +866,38 @@ gve_adminq_unregister_page_list(struct gve_priv *priv, uint32_t page_list_id)
 	return (gve_adminq_execute_cmd(priv, &cmd));
 }
 
+int
+gve_adminq_unregister_page_lists(struct gve_priv *priv, bool is_rx,
+    uint32_t start_idx, uint32_t stop_idx)
+{
+	struct gve_adminq_command cmd;
+	int err;
+	int i;
+
+	if (start_idx == stop_idx)
+		return (0);
+
+	err = gve_adminq_check_idle(priv);
+	if (err != 0)
+		return (err);
+
+	for (i = start_idx; i < stop_idx; i++) {
+		cmd = (struct gve_adminq_command){};
+		cmd.opcode = htobe32(GVE_ADMINQ_UNREGISTER_PAGE_LIST);
+		cmd.unreg_page_list = (struct gve_adminq_unregister_page_list) {
+			.page_list_id =
+			    htobe32(gve_adminq_ring_qpl(priv, is_rx, i)->id),
+		};
+		err = gve_adminq_issue_cmd(priv, &cmd);
+		if (err != 0) {
+			gve_adminq_flush(priv);
+			return (err);
+		}
+	}
+
+	return (gve_adminq_kick_and_wait(priv));
+}
+
 #define GVE_NTFY_BLK_BASE_MSIX_IDX	0
 int
 gve_adminq_configure_device_resources(struct gve_priv *priv)
@@ -652,6 +949,37 @@ gve_adminq_verify_driver_compatibility(struct gve_priv *priv,
 	return (gve_adminq_execute_cmd(priv, &aq_cmd));
 }
 
+int
+gve_adminq_report_stats(struct gve_priv *priv, uint64_t stats_report_len,
+    vm_paddr_t stats_report_addr, uint64_t interval)
+{
+	struct gve_adminq_command aq_cmd = (struct gve_adminq_command){};
+
+	aq_cmd.opcode = htobe32(GVE_ADMINQ_REPORT_STATS);
+	aq_cmd.report_stats = (struct gve_adminq_report_stats) {
+		.stats_report_len = htobe64(stats_report_len),
+		.stats_report_addr = htobe64(stats_report_addr),
+		.interval = htobe64(interval),
+	};
+
+	return (gve_adminq_execute_cmd(priv, &aq_cmd));
+}
+
+/* Has the device write its current clock into a gve_nic_ts_report. */
+int
+gve_adminq_report_nic_ts(struct gve_priv *priv, vm_paddr_t nic_ts_report_addr)
+{
+	struct gve_adminq_command aq_cmd = (struct gve_adminq_command){};
+
+	aq_cmd.opcode = htobe32(GVE_ADMINQ_REPORT_NIC_TIMESTAMP);
+	aq_cmd.report_nic_ts = (struct gve_adminq_report_nic_ts) {
+		.nic_ts_report_len = htobe64(sizeof(struct gve_nic_ts_report)),
+		.nic_ts_report_addr = htobe64(nic_ts_report_addr),
+	};
+
+	return (gve_adminq_execute_cmd(priv, &aq_cmd));
+}
+
 int
 gve_adminq_get_ptype_map_dqo(struct gve_priv *priv,
     struct gve_ptype_lut *ptype_lut_dqo)
@@ -687,6 +1015,106 @@ err:
 	return (err);
 }
 
+int
+gve_adminq_configure_rss(struct gve_priv *priv)
+{
+	struct gve_adminq_command aq_cmd = (struct gve_adminq_command){};
+	struct gve_rss_config *rss_config = &priv->rss_config;
+	struct gve_dma_handle key_mem;
+	struct gve_dma_handle lut_mem;
+	__be32 *lut;
+	int err;
+	int i;
+
+	err = gve_dma_alloc_coherent(priv, rss_config->key_size, PAGE_SIZE,
+	    &key_mem);
+	if (err != 0)
+		return (err);
+
+	err = gve_dma_alloc_coherent(priv,
+	    rss_config->lut_size * sizeof(*lut), PAGE_SIZE, &lut_mem);
+	if (err != 0)
+		goto free_key;
+
+	memcpy(key_mem.cpu_addr, rss_config->key, rss_config->key_size);
+	lut = lut_mem.cpu_addr;
+	for (i = 0; i < rss_config->lut_size; i++)
+		lut[i] = htobe32(rss_config->lut[i]);
+
+	bus_dmamap_sync(key_mem.tag, key_mem.map, BUS_DMASYNC_PREWRITE);
+	bus_dmamap_sync(lut_mem.tag, lut_mem.map, BUS_DMASYNC_PREWRITE);
+
+	aq_cmd.opcode = htobe32(GVE_ADMINQ_CONFIGURE_RSS);
+	aq_cmd.configure_rss = (struct gve_adminq_configure_rss) {
+		.hash_types = htobe16(rss_config->hash_types),
+		.hash_alg = GVE_RSS_HASH_TOEPLITZ,
+		.hash_key_size = htobe16(rss_config->key_size),
+		.hash_lut_size = htobe16(rss_config->lut_size),
+		.hash_key_addr = htobe64(key_mem.bus_addr),
+		.hash_lut_addr = htobe64(lut_mem.bus_addr),
+	};
+
+	err = gve_adminq_execute_cmd(priv, &aq_cmd);
+
+	gve_dma_free_coherent(&lut_mem);
+free_key:
+	gve_dma_free_coherent(&key_mem);
+	return (err);
+}
+
+/* Reads the device's current RSS config into priv->rss_config. */
+int
+gve_adminq_query_rss(struct gve_priv *priv)
+{
+	struct gve_adminq_command aq_cmd = (struct gve_adminq_command){};
+	struct gve_rss_config *rss_config = &priv->rss_config;
+	struct gve_query_rss_descriptor *desc;
+	struct gve_dma_handle dma;
+	uint32_t lut_entry;
+	size_t len;
+	__be32 *lut;
+	int err;
+	int i;
+
+	len = sizeof(*desc) + rss_config->key_size +
+	    rss_config->lut_size * sizeof(*lut);
+	err = gve_dma_alloc_coherent(priv, len, PAGE_SIZE, &dma);
+	if (err != 0)
+		return (err);
+	desc = dma.cpu_addr;
+
+	aq_cmd.opcode = htobe32(GVE_ADMINQ_QUERY_RSS);
+	aq_cmd.query_rss = (struct gve_adminq_query_rss) {
+		.available_length = htobe64(len),
+		.rss_descriptor_addr = htobe64(dma.bus_addr),
+	};
+
+	err = gve_adminq_execute_cmd(priv, &aq_cmd);
+	if (err != 0)
+		goto free_desc;
+
+	bus_dmamap_sync(dma.tag, dma.map, BUS_DMASYNC_POSTREAD);
+
+	if (be32toh(desc->total_length) < len) {
+		err = EINVAL;
+		goto free_desc;
+	}
+
+	rss_config->hash_types = be16toh(desc->hash_types);
+	memcpy(rss_config->key, desc + 1, rss_config->key_size);
+	lut = (__be32 *)((char *)(desc + 1) + rss_config->key_size);
+	for (i = 0; i < rss_config->lut_size; i++) {
+		lut_entry = be32toh(lut[i]);
+		/* Keep the cached LUT pointing at rx queues that exist */
+		rss_config->lut[i] = lut_entry < priv->rx_cfg.num_queues ?
+		    lut_entry : i % priv->rx_cfg.num_queues;
+	}
+
+free_desc:
+	gve_dma_free_coherent(&dma);
+	return (err);
+}
+
 int
 gve_adminq_alloc(struct gve_priv *priv)
 {
@@ -733,8 +1161,13 @@ gve_adminq_alloc(struct gve_priv *priv)
 	return (0);
 }
 
+/*
+ * Takes the adminq away from the device, which makes it drop everything that
+ * was registered through it. The memory is kept for gve_adminq_alloc to hand
+ * back to the device.
+ */
 void
-gve_release_adminq(struct gve_priv *priv)
+gve_reset_adminq(struct gve_priv *priv)
 {
 	if (!gve_get_state_flag(priv, GVE_STATE_FLAG_ADMINQ_OK))
 		return;
@@ -745,17 +1178,24 @@ gve_release_adminq(struct gve_priv *priv)
 		pause("gve release adminq", GVE_ADMINQ_SLEEP_LEN_MS);
 	}
 
-	gve_dma_free_coherent(&priv->aq_mem);
-	priv->aq_mem = (struct gve_dma_handle){};
-	priv->adminq = 0;
-	priv->adminq_bus_addr = 0;
-
 	gve_clear_state_flag(priv, GVE_STATE_FLAG_ADMINQ_OK);
 
 	if (bootverbose)
 		device_printf(priv->dev, "Admin queue released\n");
 }
 
+void
+gve_release_adminq(struct gve_priv *priv)
+{
+	gve_reset_adminq(priv);
+
+	if (priv->aq_mem.cpu_addr != NULL)
+		gve_dma_free_coherent(&priv->aq_mem);
+	priv->aq_mem = (struct gve_dma_handle){};
+	priv->adminq = 0;
+	priv->adminq_bus_addr = 0;
+}
+
 static int
 gve_adminq_parse_err(struct gve_priv *priv, uint32_t opcode, uint32_t status)
 {
@@ -816,14 +1256,26 @@ gve_adminq_kick_cmd(struct gve_priv *priv, uint32_t prod_cnt)
 
 }
 
+/*
+ * The timeout applies to each command rather than to the whole batch: the
+ * budget starts over whenever the device is seen completing a command.
+ */
 static bool
 gve_adminq_wait_for_cmd(struct gve_priv *priv, uint32_t prod_cnt)
 {
-	int i;
+	uint32_t last_cnt, cnt;
+	int stalled = 0;
 
-	for (i = 0; i < GVE_MAX_ADMINQ_EVENT_COUNTER_CHECK; i++) {
-		if (gve_reg_bar_read_4(priv, ADMINQ_EVENT_COUNTER) == prod_cnt)
+	last_cnt = gve_reg_bar_read_4(priv, ADMINQ_EVENT_COUNTER);
+	while (stalled < GVE_MAX_ADMINQ_EVENT_COUNTER_CHECK) {
+		cnt = gve_reg_bar_read_4(priv, ADMINQ_EVENT_COUNTER);
+		if (cnt == prod_cnt)
 			return (true);
+		if (cnt != last_cnt) {
+			last_cnt = cnt;
+			stalled = 0;
+		} else
+			stalled++;
 		pause("gve adminq cmd", GVE_ADMINQ_SLEEP_LEN_MS);
 	}
 
@@ -958,6 +1410,22 @@ gve_adminq_issue_cmd(struct gve_priv *priv, struct gve_adminq_command *cmd_orig)
 		priv->adminq_get_ptype_map_cnt++;
 		break;
 
+	case GVE_ADMINQ_CONFIGURE_RSS:
+		priv->adminq_configure_rss_cnt++;
+		break;
+
+	case GVE_ADMINQ_QUERY_RSS:
+		priv->adminq_query_rss_cnt++;
+		break;
+
+	case GVE_ADMINQ_REPORT_STATS:
+		priv->adminq_report_stats_cnt++;
+		break;
+
+	case GVE_ADMINQ_REPORT_NIC_TIMESTAMP:
+		priv->adminq_report_nic_ts_cnt++;
+		break;
+
 	default:
 		device_printf(priv->dev, "Unknown AQ command opcode %d\n", opcode);
 	}
@@ -966,22 +1434,47 @@ gve_adminq_issue_cmd(struct gve_priv *priv, struct gve_adminq_command *cmd_orig)
 }
 
 /*
- * This function is not threadsafe - the caller is responsible for any
- * necessary locks.
- * The caller is also responsible for making sure there are no commands
- * waiting to be executed.
+ * Batches of commands queued with gve_adminq_issue_cmd and run with a single
+ * gve_adminq_kick_and_wait must, like single commands, start on an idle queue.
  */
 static int
-gve_adminq_execute_cmd(struct gve_priv *priv, struct gve_adminq_command *cmd_orig)
+gve_adminq_check_idle(struct gve_priv *priv)
 {
 	uint32_t tail, head;
-	int err;
 
 	tail = gve_reg_bar_read_4(priv, ADMINQ_EVENT_COUNTER);
 	head = priv->adminq_prod_cnt;
 
 	if (tail != head)
 		return (EINVAL);
+	return (0);
+}
+
+/*
+ * Runs whatever a batch had queued before one of its commands could not be
+ * issued, so that the adminq is idle again for the unwind and later commands.
+ */
+static void
+gve_adminq_flush(struct gve_priv *priv)
+{
+	if (gve_adminq_check_idle(priv) != 0)
+		gve_adminq_kick_and_wait(priv);
+}
+
+/*
+ * This function is not threadsafe - the caller is responsible for any
+ * necessary locks.
+ * The caller is also responsible for making sure there are no commands
+ * waiting to be executed.
+ */
+static int
+gve_adminq_execute_cmd(struct gve_priv *priv, struct gve_adminq_command *cmd_orig)
+{
+	int err;
+
+	err = gve_adminq_check_idle(priv);
+	if (err != 0)
+		return (err);
 	err = gve_adminq_issue_cmd(priv, cmd_orig);
 	if (err != 0)
 		return (err);
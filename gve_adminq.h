@@ -48,11 +48,14 @@ enum gve_adminq_opcodes {
 	GVE_ADMINQ_DESTROY_TX_QUEUE		= 0x7,
 	GVE_ADMINQ_DESTROY_RX_QUEUE		= 0x8,
 	GVE_ADMINQ_DECONFIGURE_DEVICE_RESOURCES	= 0x9,
+	GVE_ADMINQ_CONFIGURE_RSS		= 0xA,
 	GVE_ADMINQ_SET_DRIVER_PARAMETER		= 0xB,
 	GVE_ADMINQ_REPORT_STATS			= 0xC,
 	GVE_ADMINQ_REPORT_LINK_SPEED		= 0xD,
 	GVE_ADMINQ_GET_PTYPE_MAP		= 0xE,
 	GVE_ADMINQ_VERIFY_DRIVER_COMPATIBILITY	= 0xF,
+	GVE_ADMINQ_REPORT_NIC_TIMESTAMP		= 0x11,
+	GVE_ADMINQ_QUERY_RSS			= 0x12,
 };
 
 /* Admin queue status codes */
@@ -179,6 +182,30 @@ struct gve_device_option_jumbo_frames {
 _Static_assert(sizeof(struct gve_device_option_jumbo_frames) == 8,
     "gve: bad admin queue struct length");
 
+struct gve_device_option_buffer_sizes {
+	__be32 supported_features_mask;
+	__be16 packet_buffer_size;
+	__be16 header_buffer_size;
+};
+
+_Static_assert(sizeof(struct gve_device_option_buffer_sizes) == 8,
+    "gve: bad admin queue struct length");
+
+struct gve_device_option_rss_config {
+	__be16 hash_key_size;
+	__be16 hash_lut_size;
+};
+
+_Static_assert(sizeof(struct gve_device_option_rss_config) == 4,
+    "gve: bad admin queue struct length");
+
+struct gve_device_option_nic_timestamp {
+	__be32 supported_features_mask;
+};
+
+_Static_assert(sizeof(struct gve_device_option_nic_timestamp) == 4,
+    "gve: bad admin queue struct length");
+
 enum gve_dev_opt_id {
 	GVE_DEV_OPT_ID_GQI_RAW_ADDRESSING = 0x1,
 	GVE_DEV_OPT_ID_GQI_RDA = 0x2,
@@ -187,6 +214,9 @@ enum gve_dev_opt_id {
 	GVE_DEV_OPT_ID_MODIFY_RING = 0x6,
 	GVE_DEV_OPT_ID_DQO_QPL = 0x7,
 	GVE_DEV_OPT_ID_JUMBO_FRAMES = 0x8,
+	GVE_DEV_OPT_ID_BUFFER_SIZES = 0xa,
+	GVE_DEV_OPT_ID_NIC_TIMESTAMP = 0xd,
+	GVE_DEV_OPT_ID_RSS_CONFIG = 0xe,
 };
 
 /*
@@ -203,11 +233,17 @@ enum gve_dev_opt_req_feat_mask {
 	GVE_DEV_OPT_REQ_FEAT_MASK_DQO_QPL = 0x0,
 	GVE_DEV_OPT_REQ_FEAT_MASK_MODIFY_RING = 0x0,
 	GVE_DEV_OPT_REQ_FEAT_MASK_JUMBO_FRAMES = 0x0,
+	GVE_DEV_OPT_REQ_FEAT_MASK_BUFFER_SIZES = 0x0,
+	GVE_DEV_OPT_REQ_FEAT_MASK_RSS_CONFIG = 0x0,
+	GVE_DEV_OPT_REQ_FEAT_MASK_NIC_TIMESTAMP = 0x0,
 };
 
 enum gve_sup_feature_mask {
 	GVE_SUP_MODIFY_RING_MASK  = 1 << 0,
 	GVE_SUP_JUMBO_FRAMES_MASK = 1 << 2,
+	GVE_SUP_BUFFER_SIZES_MASK = 1 << 4,
+	GVE_SUP_RSS_CONFIG_MASK   = 1 << 7,
+	GVE_SUP_NIC_TIMESTAMP_MASK = 1 << 8,
 };
 
 #define GVE_VERSION_STR_LEN 128
@@ -320,7 +356,9 @@ struct gve_adminq_create_rx_queue {
 	__be16 packet_buffer_size;
 	__be16 rx_buff_ring_size;
 	uint8_t enable_rsc;
-	uint8_t padding[5];
+	uint8_t padding1;
+	__be16 header_buffer_size; /* 0 unless header split is enabled */
+	uint8_t padding2[2];
 };
 
 _Static_assert(sizeof(struct gve_adminq_create_rx_queue) == 56,
@@ -368,6 +406,59 @@ struct gve_adminq_set_driver_parameter {
 _Static_assert(sizeof(struct gve_adminq_set_driver_parameter) == 16,
     "gve: bad admin queue struct length");
 
+/* RSS hash types, a bitmask of the packet fields fed to the hash */
+#define GVE_RSS_HASH_IPV4	BIT(0)
+#define GVE_RSS_HASH_TCPV4	BIT(1)
+#define GVE_RSS_HASH_IPV6	BIT(2)
+#define GVE_RSS_HASH_IPV6_EX	BIT(3)
+#define GVE_RSS_HASH_TCPV6	BIT(4)
+#define GVE_RSS_HASH_TCPV6_EX	BIT(5)
+#define GVE_RSS_HASH_UDPV4	BIT(6)
+#define GVE_RSS_HASH_UDPV6	BIT(7)
+#define GVE_RSS_HASH_UDPV6_EX	BIT(8)
+
+#define GVE_RSS_HASH_TYPES_ALL	(GVE_RSS_HASH_IPV4 | GVE_RSS_HASH_TCPV4 | \
+    GVE_RSS_HASH_IPV6 | GVE_RSS_HASH_IPV6_EX | GVE_RSS_HASH_TCPV6 |	  \
+    GVE_RSS_HASH_TCPV6_EX | GVE_RSS_HASH_UDPV4 | GVE_RSS_HASH_UDPV6 |	  \
+    GVE_RSS_HASH_UDPV6_EX)
+
+enum gve_rss_hash_algorithm {
+	GVE_RSS_HASH_UNDEFINED	= 0,
+	GVE_RSS_HASH_TOEPLITZ	= 1,
+};
+
+struct gve_adminq_configure_rss {
+	__be16 hash_types;
+	uint8_t hash_alg;
+	uint8_t reserved;
+	__be16 hash_key_size;
+	__be16 hash_lut_size;
+	__be64 hash_key_addr;
+	__be64 hash_lut_addr;
+};
+
+_Static_assert(sizeof(struct gve_adminq_configure_rss) == 24,
+    "gve: bad admin queue struct length");
+
+struct gve_adminq_query_rss {
+	__be64 available_length;
+	__be64 rss_descriptor_addr;
+};
+
+_Static_assert(sizeof(struct gve_adminq_query_rss) == 16,
+    "gve: bad admin queue struct length");
+
+/* The hash key and then the __be32 LUT entries directly follow this struct. */
+struct gve_query_rss_descriptor {
+	__be32 total_length;
+	__be16 hash_types;
+	uint8_t hash_alg;
+	uint8_t reserved;
+};
+
+_Static_assert(sizeof(struct gve_query_rss_descriptor) == 8,
+    "gve: bad admin queue struct length");
+
 struct stats {
 	__be32 stat_name;
 	__be32 queue_id;
@@ -377,6 +468,50 @@ struct stats {
 _Static_assert(sizeof(struct stats) == 16,
     "gve: bad admin queue struct length");
 
+struct gve_adminq_report_stats {
+	__be64 stats_report_len;
+	__be64 stats_report_addr;
+	__be64 interval; /* milliseconds */
+};
+
+_Static_assert(sizeof(struct gve_adminq_report_stats) == 24,
+    "gve: bad admin queue struct length");
+
+/*
+ * The stats report region shared with the device. The driver fills in
+ * GVE_TX_STATS_REPORT_NUM entries per tx queue and then GVE_RX_STATS_REPORT_NUM
+ * per rx queue, and the device writes its own entries right after those.
+ */
+struct gve_stats_report {
+	__be64 written_count;
+	struct stats stats[0];
+};
+
+_Static_assert(sizeof(struct gve_stats_report) == 8,
+    "gve: bad admin queue struct length");
+
+enum gve_stat_names {
+	/* Stats from the driver */
+	TX_WAKE_CNT			= 1,
+	TX_STOP_CNT			= 2,
+	TX_FRAMES_SENT			= 3,
+	TX_BYTES_SENT			= 4,
+	TX_LAST_COMPLETION_PROCESSED	= 5,
+	RX_NEXT_EXPECTED_SEQUENCE	= 6,
+	RX_BUFFERS_POSTED		= 7,
+	TX_TIMEOUT_CNT			= 8,
+	/* Stats from the NIC */
+	RX_QUEUE_DROP_CNT		= 65,
+	RX_NO_BUFFERS_POSTED		= 66,
+	RX_DROPS_PACKET_OVER_MRU	= 67,
+	RX_DROPS_INVALID_CHECKSUM	= 68,
+};
+
+#define GVE_TX_STATS_REPORT_NUM	6
+#define GVE_RX_STATS_REPORT_NUM	2
+#define NIC_TX_STATS_REPORT_NUM	0
+#define NIC_RX_STATS_REPORT_NUM	4
+
 /*
  * These are control path types for PTYPE which are the same as the data path
  * types.
@@ -395,6 +530,26 @@ struct gve_adminq_get_ptype_map {
 	__be64 ptype_map_addr;
 };
 
+struct gve_adminq_report_nic_ts {
+	__be64 nic_ts_report_len;
+	__be64 nic_ts_report_addr;
+};
+
+_Static_assert(sizeof(struct gve_adminq_report_nic_ts) == 16,
+    "gve: bad admin queue struct length");
+
+/* Written by the device in response to GVE_ADMINQ_REPORT_NIC_TIMESTAMP */
+struct gve_nic_ts_report {
+	__be64 nic_timestamp; /* NIC clock in nanoseconds */
+	__be64 reserved1;
+	__be64 reserved2;
+	__be64 reserved3;
+	__be64 reserved4;
+};
+
+_Static_assert(sizeof(struct gve_nic_ts_report) == 40,
+    "gve: bad admin queue struct length");
+
 struct gve_adminq_command {
 	__be32 opcode;
 	__be32 status;
@@ -412,6 +567,10 @@ struct gve_adminq_command {
 		struct gve_adminq_verify_driver_compatibility
 					verify_driver_compatibility;
 		struct gve_adminq_get_ptype_map get_ptype_map;
+		struct gve_adminq_configure_rss configure_rss;
+		struct gve_adminq_query_rss query_rss;
+		struct gve_adminq_report_stats report_stats;
+		struct gve_adminq_report_nic_ts report_nic_ts;
 		uint8_t reserved[56];
 	};
 };
@@ -437,10 +596,14 @@ enum gve_l4_type {
 	GVE_L4_TYPE_SCTP,
 };
 
-int gve_adminq_create_rx_queues(struct gve_priv *priv, uint32_t num_queues);
-int gve_adminq_create_tx_queues(struct gve_priv *priv, uint32_t num_queues);
-int gve_adminq_destroy_tx_queues(struct gve_priv *priv, uint32_t num_queues);
-int gve_adminq_destroy_rx_queues(struct gve_priv *priv, uint32_t num_queues);
+int gve_adminq_create_rx_queues(struct gve_priv *priv, uint32_t start_idx,
+    uint32_t stop_idx);
+int gve_adminq_create_tx_queues(struct gve_priv *priv, uint32_t start_idx,
+    uint32_t stop_idx);
+int gve_adminq_destroy_tx_queues(struct gve_priv *priv, uint32_t start_idx,
+    uint32_t stop_idx);
+int gve_adminq_destroy_rx_queues(struct gve_priv *priv, uint32_t start_idx,
+    uint32_t stop_idx);
 int gve_adminq_set_mtu(struct gve_priv *priv, uint32_t mtu);
 int gve_adminq_alloc(struct gve_priv *priv);
 void gve_reset_adminq(struct gve_priv *priv);
@@ -448,11 +611,22 @@ int gve_adminq_describe_device(struct gve_priv *priv);
 int gve_adminq_configure_device_resources(struct gve_priv *priv);
 int gve_adminq_deconfigure_device_resources(struct gve_priv *priv);
 void gve_release_adminq(struct gve_priv *priv);
+void gve_reset_adminq(struct gve_priv *priv);
 int gve_adminq_register_page_list(struct gve_priv *priv,
     struct gve_queue_page_list *qpl);
 int gve_adminq_unregister_page_list(struct gve_priv *priv, uint32_t page_list_id);
+int gve_adminq_register_page_lists(struct gve_priv *priv, bool is_rx,
+    uint32_t start_idx, uint32_t stop_idx);
+int gve_adminq_unregister_page_lists(struct gve_priv *priv, bool is_rx,
+    uint32_t start_idx, uint32_t stop_idx);
 int gve_adminq_verify_driver_compatibility(struct gve_priv *priv,
     uint64_t driver_info_len, vm_paddr_t driver_info_addr);
 int gve_adminq_get_ptype_map_dqo(struct gve_priv *priv,
     struct gve_ptype_lut *ptype_lut);
+int gve_adminq_configure_rss(struct gve_priv *priv);
+int gve_adminq_query_rss(struct gve_priv *priv);
+int gve_adminq_report_stats(struct gve_priv *priv, uint64_t stats_report_len,
+    vm_paddr_t stats_report_addr, uint64_t interval);
+int gve_adminq_report_nic_ts(struct gve_priv *priv,
+    vm_paddr_t nic_ts_report_addr);
 #endif /* _GVE_AQ_H_ */
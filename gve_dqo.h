@@ -67,6 +67,15 @@
  */
 #define GVE_RX_NUM_QPL_PAGES_DQO 2048
 
+/*
+ * In RDA mode buf_ids with this bit set name a frag of a page pool page, the
+ * rest being page index * GVE_DQ_NUM_FRAGS_IN_PAGE + frag. That caps the
+ * pool at GVE_RX_MAX_POOL_PAGES_DQO pages.
+ */
+#define GVE_RX_POOL_BUF_ID_DQO 0x8000
+#define GVE_RX_MAX_POOL_PAGES_DQO \
+    (GVE_RX_POOL_BUF_ID_DQO / GVE_DQ_NUM_FRAGS_IN_PAGE)
+
 /* 2K TX buffers for DQO-QPL */
 #define GVE_TX_BUF_SHIFT_DQO 11
 #define GVE_TX_BUF_SIZE_DQO BIT(GVE_TX_BUF_SHIFT_DQO)
@@ -253,6 +262,11 @@ union gve_tx_desc_dqo {
 #define GVE_COMPL_TYPE_DQO_PKT 0x2 /* Packet completion */
 #define GVE_COMPL_TYPE_DQO_DESC 0x4 /* Descriptor completion */
 
+/* How many tx completions, four cache lines' worth, to prefetch ahead */
+#define GVE_TX_COMPL_PREFETCH_DQO 32
+
+#define GVE_DQO_RX_HWTSTAMP_VALID 0x1
+
 /* Descriptor to post buffers to HW on buffer queue. */
 struct gve_rx_desc_dqo {
 	__le16 buf_id; /* ID returned in Rx completion descriptor */
@@ -314,7 +328,9 @@ struct gve_rx_compl_desc_dqo {
 
 	uint8_t status_error1;
 
-	__le16 reserved5;
+	uint8_t reserved5;
+	/* Bit 0 is GVE_DQO_RX_HWTSTAMP_VALID */
+	uint8_t ts_sub_nsecs_low;
 	__le16 buf_id; /* Buffer ID which was sent on the buffer queue. */
 
 	union {
@@ -325,7 +341,9 @@ struct gve_rx_compl_desc_dqo {
 	};
 	__le32 hash;
 	__le32 reserved6;
-	__le64 reserved7;
+	__le32 reserved7;
+	/* Low 32 bits of the NIC clock in nanoseconds at reception */
+	__le32 ts;
 } __packed;
 
 _Static_assert(sizeof(struct gve_rx_compl_desc_dqo) == 32,
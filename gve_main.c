@@ -28,6 +28,10 @@
  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#include "opt_netmap.h"
+#include "opt_ratelimit.h"
+#include "opt_rss.h"
+
 #include "gve.h"
 #include "gve_adminq.h"
 #include "gve_dqo.h"
@@ -38,6 +42,11 @@
 #define GVE_VERSION_SUB 4
 
 #define GVE_DEFAULT_RX_COPYBREAK 256
+#define GVE_DEFAULT_TX_DB_BATCH_PKTS 32
+#define GVE_DEFAULT_TX_DB_BATCH_BYTES (128 * 1024)
+/* Low-latency tx class defaults: no length rule, and DSCP EF (46) */
+#define GVE_DEFAULT_TX_LL_MAX_LEN 0
+#define GVE_DEFAULT_TX_LL_DSCP_MASK (1ULL << 46)
 
 /* Devices supported by this driver. */
 static struct gve_dev {
@@ -51,6 +60,33 @@ static struct gve_dev {
 
 struct sx gve_global_lock;
 
+/*
+ * Static probes on the data path, e.g. `dtrace -n 'gve::tx:xmit-done'`.
+ * xmit-start and xmit-done bracket every packet the br drain hands to the
+ * queue format's xmit function, xmit-done reporting the error and the number
+ * of descriptors written. The doorbell probes report the index written to
+ * the ring's doorbell, completion every DQO packet completion, packet every
+ * received packet with its frag count, copybreak every frag with whether it
+ * was copied, post-fail every DQO buffer that could not be posted and reset
+ * every reset request, whose trigger `stack()` shows.
+ */
+SDT_PROVIDER_DEFINE(gve);
+SDT_PROBE_DEFINE2(gve, , tx, xmit__start, "struct gve_tx_ring *",
+    "struct mbuf *");
+SDT_PROBE_DEFINE3(gve, , tx, xmit__done, "struct gve_tx_ring *", "int",
+    "uint32_t");
+SDT_PROBE_DEFINE2(gve, , tx, doorbell, "struct gve_tx_ring *", "uint32_t");
+SDT_PROBE_DEFINE3(gve, , tx, completion, "struct gve_tx_ring *", "uint16_t",
+    "uint64_t");
+SDT_PROBE_DEFINE4(gve, , rx, packet, "struct gve_rx_ring *", "struct mbuf *",
+    "uint8_t", "uint32_t");
+SDT_PROBE_DEFINE3(gve, , rx, copybreak, "struct gve_rx_ring *", "uint16_t",
+    "bool");
+SDT_PROBE_DEFINE2(gve, , rx, doorbell, "struct gve_rx_ring *", "uint32_t");
+SDT_PROBE_DEFINE3(gve, , rx, post__fail, "struct gve_rx_ring *", "int",
+    "uint32_t");
+SDT_PROBE_DEFINE1(gve, , main, reset, "struct gve_priv *");
+
 static void gve_start_tx_timeout_service(struct gve_priv *priv);
 static void gve_stop_tx_timeout_service(struct gve_priv *priv);
 
@@ -168,7 +204,51 @@ gve_stop_tx_timeout_service(struct gve_priv *priv)
 	callout_drain(&priv->tx_timeout_service);
 }
 
-static int
+/* Spreads the indirection table evenly over the current rx queues. */
+static void
+gve_rss_reset_lut(struct gve_priv *priv)
+{
+	struct gve_rss_config *rss_config = &priv->rss_config;
+	uint32_t qid;
+	int i;
+
+	for (i = 0; i < rss_config->lut_size; i++) {
+#ifdef RSS
+		/* The device table can be larger than the stack's, so repeat it */
+		qid = rss_get_indirection_to_bucket(i % RSS_TABLE_MAXLEN);
+#else
+		qid = i;
+#endif
+		rss_config->lut[i] = qid % priv->rx_cfg.num_queues;
+	}
+}
+
+static void
+gve_init_rss_config(struct gve_priv *priv)
+{
+	struct gve_rss_config *rss_config = &priv->rss_config;
+
+	if (!priv->rss_config_enabled)
+		return;
+
+	/*
+	 * Start from whatever the device is using so that a driver reload
+	 * does not reshuffle flows; fall back to a random key otherwise.
+	 */
+	if (gve_adminq_query_rss(priv) != 0) {
+		arc4random_buf(rss_config->key, rss_config->key_size);
+		rss_config->hash_types = GVE_RSS_HASH_TYPES_ALL;
+	}
+
+#ifdef RSS
+	/* The kernel's RSS key must match for software hashes to agree */
+	if (rss_config->key_size == RSS_KEYSIZE)
+		rss_getkey(rss_config->key);
+#endif
+	gve_rss_reset_lut(priv);
+}
+
+int
 gve_up(struct gve_priv *priv)
 {
 	if_t ifp = priv->ifp;
@@ -200,6 +280,8 @@ gve_up(struct gve_priv *priv)
 			goto reset;
 	}
 
+	gve_update_cpu_txq(priv);
+
 	err = gve_create_rx_rings(priv);
 	if (err != 0)
 		goto reset;
@@ -208,6 +290,12 @@ gve_up(struct gve_priv *priv)
 	if (err != 0)
 		goto reset;
 
+	if (priv->rss_config_enabled) {
+		err = gve_adminq_configure_rss(priv);
+		if (err != 0)
+			goto reset;
+	}
+
 	if_setdrvflagbits(ifp, IFF_DRV_RUNNING, IFF_DRV_OACTIVE);
 
 	if (!gve_get_state_flag(priv, GVE_STATE_FLAG_LINK_UP)) {
@@ -228,7 +316,7 @@ reset:
 	return (err);
 }
 
-static void
+void
 gve_down(struct gve_priv *priv)
 {
 	GVE_IFACE_LOCK_ASSERT(priv->gve_iface_lock);
@@ -266,72 +354,223 @@ reset:
 	gve_schedule_reset(priv);
 }
 
+/*
+ * Brings up the allocated rx or tx rings in [start_idx, stop_idx) next to the
+ * queues already running, which keep passing traffic throughout.
+ */
+static int
+gve_start_queue_range(struct gve_priv *priv, bool is_rx, uint16_t start_idx,
+    uint16_t stop_idx)
+{
+	int err;
+	int i;
+
+	if (gve_is_qpl(priv)) {
+		err = gve_register_qpl_range(priv, is_rx, start_idx, stop_idx);
+		if (err != 0)
+			return (err);
+	}
+
+	if (is_rx)
+		err = gve_create_rx_ring_range(priv, start_idx, stop_idx);
+	else
+		err = gve_create_tx_ring_range(priv, start_idx, stop_idx);
+	if (err != 0) {
+		if (gve_is_qpl(priv))
+			gve_unregister_qpl_range(priv, is_rx, start_idx, stop_idx);
+		return (err);
+	}
+
+	for (i = start_idx; i < stop_idx; i++)
+		gve_unmask_queue_irq(priv,
+		    is_rx ? &priv->rx[i].com : &priv->tx[i].com);
+	return (0);
+}
+
+/* The reverse of gve_start_queue_range, for queues no longer handed traffic. */
+static int
+gve_stop_queue_range(struct gve_priv *priv, bool is_rx, uint16_t start_idx,
+    uint16_t stop_idx)
+{
+	int err;
+	int i;
+
+	if (is_rx)
+		err = gve_destroy_rx_ring_range(priv, start_idx, stop_idx);
+	else
+		err = gve_destroy_tx_ring_range(priv, start_idx, stop_idx);
+	if (err != 0)
+		return (err);
+
+	if (gve_is_gqi(priv)) {
+		for (i = start_idx; i < stop_idx; i++)
+			gve_mask_queue_irq(priv,
+			    is_rx ? &priv->rx[i].com : &priv->tx[i].com);
+	}
+
+	if (gve_is_qpl(priv))
+		err = gve_unregister_qpl_range(priv, is_rx, start_idx, stop_idx);
+	return (err);
+}
+
+/*
+ * Only the queues being added or removed are touched: new rings are allocated
+ * and created before flows are steered to them, and flows are steered away
+ * from rings before they are destroyed.
+ */
 int
 gve_adjust_rx_queues(struct gve_priv *priv, uint16_t new_queue_cnt)
 {
+	uint16_t old_queue_cnt = priv->rx_cfg.num_queues;
+	bool is_up;
 	int err;
 
 	GVE_IFACE_LOCK_ASSERT(priv->gve_iface_lock);
 
-	gve_down(priv);
+#ifdef DEV_NETMAP
+	/* Netmap clients have the current ring layout mapped. */
+	if (gve_netmap_on(priv))
+		return (EBUSY);
+#endif
 
-	if (new_queue_cnt < priv->rx_cfg.num_queues) {
-		/*
-		 * Freeing a ring still preserves its ntfy_id,
-		 * which is needed if we create the ring again.
-		 */
-		gve_free_rx_rings(priv, new_queue_cnt, priv->rx_cfg.num_queues);
-	} else {
-		err = gve_alloc_rx_rings(priv, priv->rx_cfg.num_queues, new_queue_cnt);
+	if (new_queue_cnt == old_queue_cnt)
+		return (0);
+
+	is_up = gve_get_state_flag(priv, GVE_STATE_FLAG_QUEUES_UP);
+
+	if (new_queue_cnt > old_queue_cnt) {
+		err = gve_alloc_rx_rings(priv, old_queue_cnt, new_queue_cnt);
 		if (err != 0) {
 			device_printf(priv->dev, "Failed to allocate new queues");
-			/* Failed to allocate rings, start back up with old ones */
-			gve_up(priv);
 			return (err);
+		}
 
+		if (is_up) {
+			err = gve_start_queue_range(priv, /*is_rx=*/true,
+			    old_queue_cnt, new_queue_cnt);
+			if (err != 0) {
+				device_printf(priv->dev,
+				    "Failed to create new queues, err: %d\n", err);
+				gve_free_rx_rings(priv, old_queue_cnt, new_queue_cnt);
+				return (err);
+			}
 		}
+
+		priv->rx_cfg.num_queues = new_queue_cnt;
+		gve_rss_reset_lut(priv);
+		if (is_up && priv->rss_config_enabled) {
+			err = gve_adminq_configure_rss(priv);
+			if (err != 0)
+				gve_schedule_reset(priv);
+		}
+		return (err);
 	}
+
+	/*
+	 * Freeing a ring still preserves its ntfy_id,
+	 * which is needed if we create the ring again.
+	 */
 	priv->rx_cfg.num_queues = new_queue_cnt;
+	gve_rss_reset_lut(priv);
+	if (!is_up) {
+		gve_free_rx_rings(priv, new_queue_cnt, old_queue_cnt);
+		return (0);
+	}
 
-	err = gve_up(priv);
+	if (priv->rss_config_enabled) {
+		err = gve_adminq_configure_rss(priv);
+		if (err != 0)
+			goto reset;
+	}
+
+	err = gve_stop_queue_range(priv, /*is_rx=*/true, new_queue_cnt,
+	    old_queue_cnt);
 	if (err != 0)
-		gve_schedule_reset(priv);
+		goto reset;
+
+	gve_free_rx_rings(priv, new_queue_cnt, old_queue_cnt);
+	return (0);
 
+reset:
+	/* Let the reset tear down every ring still allocated */
+	priv->rx_cfg.num_queues = old_queue_cnt;
+	gve_schedule_reset(priv);
 	return (err);
 }
 
 int
 gve_adjust_tx_queues(struct gve_priv *priv, uint16_t new_queue_cnt)
 {
+	uint16_t old_queue_cnt = priv->tx_cfg.num_queues;
+	bool is_up;
 	int err;
 
 	GVE_IFACE_LOCK_ASSERT(priv->gve_iface_lock);
 
-	gve_down(priv);
+#ifdef DEV_NETMAP
+	/* Netmap clients have the current ring layout mapped. */
+	if (gve_netmap_on(priv))
+		return (EBUSY);
+#endif
 
-	if (new_queue_cnt < priv->tx_cfg.num_queues) {
-		/*
-		 * Freeing a ring still preserves its ntfy_id,
-		 * which is needed if we create the ring again.
-		 */
-		gve_free_tx_rings(priv, new_queue_cnt, priv->tx_cfg.num_queues);
-	} else {
-		err = gve_alloc_tx_rings(priv, priv->tx_cfg.num_queues, new_queue_cnt);
+	if (new_queue_cnt == old_queue_cnt)
+		return (0);
+
+	is_up = gve_get_state_flag(priv, GVE_STATE_FLAG_QUEUES_UP);
+
+	if (new_queue_cnt > old_queue_cnt) {
+		err = gve_alloc_tx_rings(priv, old_queue_cnt, new_queue_cnt);
 		if (err != 0) {
 			device_printf(priv->dev, "Failed to allocate new queues");
-			/* Failed to allocate rings, start back up with old ones */
-			gve_up(priv);
 			return (err);
+		}
 
+		if (is_up) {
+			err = gve_start_queue_range(priv, /*is_rx=*/false,
+			    old_queue_cnt, new_queue_cnt);
+			if (err != 0) {
+				device_printf(priv->dev,
+				    "Failed to create new queues, err: %d\n", err);
+				gve_free_tx_rings(priv, old_queue_cnt, new_queue_cnt);
+				return (err);
+			}
 		}
+
+		atomic_store_rel_16(&priv->tx_cfg.num_queues, new_queue_cnt);
+		gve_update_cpu_txq(priv);
+		return (0);
 	}
-	priv->tx_cfg.num_queues = new_queue_cnt;
 
-	err = gve_up(priv);
-	if (err != 0)
+	if (is_up)
+		gve_stop_tx_timeout_service(priv);
+
+	atomic_store_rel_16(&priv->tx_cfg.num_queues, new_queue_cnt);
+	gve_update_cpu_txq(priv);
+
+	/*
+	 * Wait out senders that picked one of the queues going away; they all
+	 * pick their queue inside the net epoch, see gve_xmit_ifp.
+	 */
+	NET_EPOCH_WAIT();
+
+	if (!is_up) {
+		gve_free_tx_rings(priv, new_queue_cnt, old_queue_cnt);
+		return (0);
+	}
+
+	err = gve_stop_queue_range(priv, /*is_rx=*/false, new_queue_cnt,
+	    old_queue_cnt);
+	if (err != 0) {
+		/* Let the reset tear down every ring still allocated */
+		atomic_store_rel_16(&priv->tx_cfg.num_queues, old_queue_cnt);
+		gve_update_cpu_txq(priv);
 		gve_schedule_reset(priv);
+		return (err);
+	}
 
-	return (err);
+	gve_free_tx_rings(priv, new_queue_cnt, old_queue_cnt);
+	gve_start_tx_timeout_service(priv);
+	return (0);
 }
 
 int
@@ -342,6 +581,12 @@ gve_adjust_ring_sizes(struct gve_priv *priv, uint16_t new_desc_cnt, bool is_rx)
 
 	GVE_IFACE_LOCK_ASSERT(priv->gve_iface_lock);
 
+#ifdef DEV_NETMAP
+	/* Netmap clients have the current ring layout mapped. */
+	if (gve_netmap_on(priv))
+		return (EBUSY);
+#endif
+
 	gve_down(priv);
 
 	if (is_rx) {
@@ -382,6 +627,52 @@ gve_adjust_ring_sizes(struct gve_priv *priv, uint16_t new_desc_cnt, bool is_rx)
 	return (0);
 }
 
+/*
+ * Turns header split on or off. The header buffers are allocated along with
+ * the rx rings, so those are rebuilt and the queues restarted.
+ */
+int
+gve_set_header_split(struct gve_priv *priv, bool enable)
+{
+	int err;
+
+	GVE_IFACE_LOCK_ASSERT(priv->gve_iface_lock);
+
+	if (enable && !priv->header_split_supported)
+		return (EOPNOTSUPP);
+
+#ifdef DEV_NETMAP
+	if (gve_netmap_on(priv))
+		return (EBUSY);
+#endif
+
+	gve_down(priv);
+
+	gve_free_rx_rings(priv, 0, priv->rx_cfg.num_queues);
+	priv->header_split_enabled = enable;
+	err = gve_alloc_rx_rings(priv, 0, priv->rx_cfg.num_queues);
+	if (err != 0) {
+		device_printf(priv->dev,
+		    "Failed to allocate rings. Trying to start back up with header split %s.",
+		    enable ? "off" : "on");
+		priv->header_split_enabled = !enable;
+		err = gve_alloc_rx_rings(priv, 0, priv->rx_cfg.num_queues);
+	}
+
+	if (err != 0) {
+		device_printf(priv->dev, "Failed to allocate rings! Cannot start device back up!");
+		return (err);
+	}
+
+	err = gve_up(priv);
+	if (err != 0) {
+		gve_schedule_reset(priv);
+		return (err);
+	}
+
+	return (0);
+}
+
 static int
 gve_set_mtu(if_t ifp, uint32_t new_mtu)
 {
@@ -480,6 +771,51 @@ gve_ioctl(if_t ifp, u_long command, caddr_t data)
 		GVE_IFACE_LOCK_UNLOCK(priv->gve_iface_lock);
 		break;
 
+	case SIOCGIFRSSKEY: {
+		struct ifrsskey *ifrk = (struct ifrsskey *)data;
+
+		if (!priv->rss_config_enabled) {
+			rc = EOPNOTSUPP;
+			break;
+		}
+		ifrk->ifrk_func = RSS_FUNC_TOEPLITZ;
+		ifrk->ifrk_keylen = MIN(priv->rss_config.key_size, RSS_KEYLEN);
+		memcpy(ifrk->ifrk_key, priv->rss_config.key,
+		    ifrk->ifrk_keylen);
+		break;
+	}
+
+	case SIOCGIFRSSHASH: {
+		struct ifrsshash *ifrh = (struct ifrsshash *)data;
+		uint16_t hash_types = priv->rss_config.hash_types;
+
+		if (!priv->rss_config_enabled) {
+			rc = EOPNOTSUPP;
+			break;
+		}
+		ifrh->ifrh_func = RSS_FUNC_TOEPLITZ;
+		ifrh->ifrh_types = 0;
+		if (hash_types & GVE_RSS_HASH_IPV4)
+			ifrh->ifrh_types |= RSS_TYPE_IPV4;
+		if (hash_types & GVE_RSS_HASH_TCPV4)
+			ifrh->ifrh_types |= RSS_TYPE_TCP_IPV4;
+		if (hash_types & GVE_RSS_HASH_IPV6)
+			ifrh->ifrh_types |= RSS_TYPE_IPV6;
+		if (hash_types & GVE_RSS_HASH_IPV6_EX)
+			ifrh->ifrh_types |= RSS_TYPE_IPV6_EX;
+		if (hash_types & GVE_RSS_HASH_TCPV6)
+			ifrh->ifrh_types |= RSS_TYPE_TCP_IPV6;
+		if (hash_types & GVE_RSS_HASH_TCPV6_EX)
+			ifrh->ifrh_types |= RSS_TYPE_TCP_IPV6_EX;
+		if (hash_types & GVE_RSS_HASH_UDPV4)
+			ifrh->ifrh_types |= RSS_TYPE_UDP_IPV4;
+		if (hash_types & GVE_RSS_HASH_UDPV6)
+			ifrh->ifrh_types |= RSS_TYPE_UDP_IPV6;
+		if (hash_types & GVE_RSS_HASH_UDPV6_EX)
+			ifrh->ifrh_types |= RSS_TYPE_UDP_IPV6_EX;
+		break;
+	}
+
 	case SIOCSIFMEDIA:
 		/* FALLTHROUGH */
 	case SIOCGIFMEDIA:
@@ -563,6 +899,88 @@ gve_get_counter(if_t ifp, ift_counter cnt)
 	}
 }
 
+static void
+gve_register_rx_pfil(struct gve_priv *priv)
+{
+	struct pfil_head_args pa = {
+		.pa_version = PFIL_VERSION,
+		.pa_flags = PFIL_IN,
+		.pa_type = PFIL_TYPE_ETHERNET,
+		.pa_headname = priv->rx_pfil_name,
+	};
+	pfil_head_t head;
+
+	priv->rx_pfil_vnet = gve_if_getvnet(priv->ifp);
+	CURVNET_SET(priv->rx_pfil_vnet);
+	head = pfil_head_register(&pa);
+	CURVNET_RESTORE();
+	atomic_store_rel_ptr((volatile uintptr_t *)&priv->rx_pfil,
+	    (uintptr_t)head);
+}
+
+static void
+gve_unregister_rx_pfil(struct gve_priv *priv)
+{
+	pfil_head_t head = priv->rx_pfil;
+
+	if (head == NULL)
+		return;
+
+	/* The rx path only runs the hooks from within the net epoch */
+	atomic_store_ptr(&priv->rx_pfil, NULL);
+	NET_EPOCH_WAIT();
+
+	CURVNET_SET(priv->rx_pfil_vnet);
+	pfil_head_unregister(head);
+	CURVNET_RESTORE();
+}
+
+/* Moves the rx pfil head along with an ifnet that changed vnets */
+static void
+gve_rx_pfil_arrival(void *arg, if_t ifp)
+{
+	struct gve_priv *priv = arg;
+
+	if (ifp != priv->ifp)
+		return;
+
+	GVE_IFACE_LOCK_LOCK(priv->gve_iface_lock);
+	if (priv->rx_pfil_vnet != gve_if_getvnet(ifp)) {
+		gve_unregister_rx_pfil(priv);
+		gve_register_rx_pfil(priv);
+	}
+	GVE_IFACE_LOCK_UNLOCK(priv->gve_iface_lock);
+}
+
+/*
+ * iflib drivers run the Ethernet head that ether_ifattach registers for the
+ * ifnet over their rx buffers, but that head only exists from FreeBSD 14 on
+ * and is only reachable through struct ifnet, which this driver otherwise
+ * leaves to the if_t accessors. So the driver registers a head of its own,
+ * named after the device with an "-rx" suffix, for hooks that want to drop
+ * traffic while it is still in the rx buffers.
+ */
+static void
+gve_setup_rx_pfil(struct gve_priv *priv)
+{
+	snprintf(priv->rx_pfil_name, sizeof(priv->rx_pfil_name), "%s-rx",
+	    device_get_nameunit(priv->dev));
+	gve_register_rx_pfil(priv);
+	priv->rx_pfil_arrival = EVENTHANDLER_REGISTER(ifnet_arrival_event,
+	    gve_rx_pfil_arrival, priv, EVENTHANDLER_PRI_ANY);
+}
+
+static void
+gve_free_rx_pfil(struct gve_priv *priv)
+{
+	if (priv->rx_pfil_arrival != NULL) {
+		EVENTHANDLER_DEREGISTER(ifnet_arrival_event,
+		    priv->rx_pfil_arrival);
+		priv->rx_pfil_arrival = NULL;
+	}
+	gve_unregister_rx_pfil(priv);
+}
+
 static int
 gve_setup_ifnet(device_t dev, struct gve_priv *priv)
 {
@@ -582,6 +1000,9 @@ gve_setup_ifnet(device_t dev, struct gve_priv *priv)
 	if_setioctlfn(ifp, gve_ioctl);
 	if_settransmitfn(ifp, gve_xmit_ifp);
 	if_setqflushfn(ifp, gve_qflush);
+#ifdef RATELIMIT
+	if_setsndtagallocfn(ifp, gve_snd_tag_alloc);
+#endif
 
 	/*
 	 * Set TSO limits, must match the arguments to bus_dma_tag_create
@@ -608,11 +1029,22 @@ gve_setup_ifnet(device_t dev, struct gve_priv *priv)
 	       IFCAP_TXCSUM |
 	       IFCAP_TXCSUM_IPV6 |
 	       IFCAP_TSO |
-	       IFCAP_LRO;
+	       IFCAP_LRO |
+	       IFCAP_VLAN_MTU |
+	       IFCAP_VLAN_HWTAGGING |
+	       IFCAP_VLAN_HWCSUM |
+	       IFCAP_VLAN_HWTSO;
 
 	if ((priv->supported_features & GVE_SUP_JUMBO_FRAMES_MASK) != 0)
 		caps |= IFCAP_JUMBO_MTU;
 
+	if (priv->nic_ts_report != NULL)
+		caps |= IFCAP_HWRXTSTMP;
+
+#ifdef RATELIMIT
+	caps |= IFCAP_TXRTLMT;
+#endif
+
 	if_setcapabilities(ifp, caps);
 	if_setcapenable(ifp, caps);
 
@@ -621,6 +1053,10 @@ gve_setup_ifnet(device_t dev, struct gve_priv *priv)
 	if_setmtu(ifp, priv->max_mtu);
 
 	ether_ifattach(ifp, priv->mac);
+#ifdef DEV_NETMAP
+	gve_netmap_attach(priv);
+#endif
+	gve_setup_rx_pfil(priv);
 
 	ifmedia_add(&priv->media, IFM_ETHER | IFM_AUTO, 0, NULL);
 	ifmedia_set(&priv->media, IFM_ETHER | IFM_AUTO);
@@ -685,21 +1121,35 @@ gve_free_rings(struct gve_priv *priv)
 	gve_free_rx_rings(priv, 0, priv->rx_cfg.num_queues);
 	free(priv->rx, M_GVE);
 	priv->rx = NULL;
+
+	gve_free_qpl_pool(priv);
+	gve_free_queue_cpus(priv);
 }
 
 static int
 gve_alloc_rings(struct gve_priv *priv)
 {
 	int err;
+	int i;
+
+	gve_alloc_queue_cpus(priv);
+	if (gve_is_qpl(priv))
+		gve_alloc_qpl_pool(priv);
 
 	priv->rx = malloc(sizeof(struct gve_rx_ring) * priv->rx_cfg.max_queues,
 	    M_GVE, M_WAITOK | M_ZERO);
+	for (i = 0; i < priv->rx_cfg.max_queues; i++)
+		gve_itr_init(&priv->rx[i].com,
+		    gve_is_gqi(priv) ? 0 : GVE_RX_IRQ_RATELIMIT_US_DQO);
 	err = gve_alloc_rx_rings(priv, 0, priv->rx_cfg.num_queues);
 	if (err != 0)
 		goto abort;
 
 	priv->tx = malloc(sizeof(struct gve_tx_ring) * priv->tx_cfg.max_queues,
 	    M_GVE, M_WAITOK | M_ZERO);
+	for (i = 0; i < priv->tx_cfg.max_queues; i++)
+		gve_itr_init(&priv->tx[i].com,
+		    gve_is_gqi(priv) ? 0 : GVE_TX_IRQ_RATELIMIT_US_DQO);
 	err = gve_alloc_tx_rings(priv, 0, priv->tx_cfg.num_queues);
 	if (err != 0)
 		goto abort;
@@ -715,6 +1165,264 @@ abort:
 	return (err);
 }
 
+static void
+gve_free_stats_report(struct gve_priv *priv)
+{
+	if (priv->stats_report != NULL)
+		gve_dma_free_coherent(&priv->stats_report_mem);
+	priv->stats_report_mem = (struct gve_dma_handle){};
+	priv->stats_report = NULL;
+}
+
+/*
+ * Hands the device the stats report region, allocating it on first use. The
+ * report is optional, so failing to set it up only leaves it off.
+ */
+static void
+gve_setup_stats_report(struct gve_priv *priv)
+{
+	int err;
+
+	if (gve_stats_report_interval == 0)
+		return;
+
+	if (priv->stats_report == NULL) {
+		priv->stats_report_len = sizeof(struct gve_stats_report) +
+		    sizeof(struct stats) *
+		    ((GVE_TX_STATS_REPORT_NUM + NIC_TX_STATS_REPORT_NUM) *
+		    priv->tx_cfg.max_queues +
+		    (GVE_RX_STATS_REPORT_NUM + NIC_RX_STATS_REPORT_NUM) *
+		    priv->rx_cfg.max_queues);
+		err = gve_dma_alloc_coherent(priv, priv->stats_report_len,
+		    PAGE_SIZE, &priv->stats_report_mem);
+		if (err != 0)
+			return;
+		priv->stats_report = priv->stats_report_mem.cpu_addr;
+	}
+
+	err = gve_adminq_report_stats(priv, priv->stats_report_len,
+	    priv->stats_report_mem.bus_addr, gve_stats_report_interval);
+	if (err != 0) {
+		if (err != EOPNOTSUPP)
+			device_printf(priv->dev,
+			    "Failed to set up the stats report: err=%d\n", err);
+		gve_free_stats_report(priv);
+	}
+}
+
+static void
+gve_put_stat(struct stats *stat, uint32_t name, uint32_t queue_id,
+    uint64_t value)
+{
+	*stat = (struct stats) {
+		.stat_name = htobe32(name),
+		.queue_id = htobe32(queue_id),
+		.value = htobe64(value),
+	};
+}
+
+/*
+ * Refreshes the driver's entries of the stats report and picks up the ones
+ * the device wrote after them.
+ */
+static void
+gve_handle_stats_report(struct gve_priv *priv)
+{
+	struct gve_stats_report *report;
+	struct gve_tx_ring *tx;
+	struct gve_rx_ring *rx;
+	struct stats *stats;
+	uint32_t num_stats;
+	uint32_t queue_id;
+	uint64_t value;
+	int idx = 0;
+	int i;
+
+	GVE_IFACE_LOCK_LOCK(priv->gve_iface_lock);
+	report = priv->stats_report;
+	if (report == NULL ||
+	    !gve_get_state_flag(priv, GVE_STATE_FLAG_QUEUES_UP))
+		goto out;
+	stats = report->stats;
+	num_stats = (priv->stats_report_len - sizeof(*report)) /
+	    sizeof(*stats);
+
+	bus_dmamap_sync(priv->stats_report_mem.tag, priv->stats_report_mem.map,
+	    BUS_DMASYNC_POSTREAD);
+
+	for (i = 0; i < priv->tx_cfg.num_queues; i++) {
+		tx = &priv->tx[i];
+		/* The driver keeps no count of xmit queue wakeups */
+		gve_put_stat(&stats[idx++], TX_WAKE_CNT, i, 0);
+		gve_put_stat(&stats[idx++], TX_STOP_CNT, i,
+		    counter_u64_fetch(tx->stats.tx_delayed_pkt_nospace_device) +
+		    counter_u64_fetch(tx->stats.tx_delayed_pkt_nospace_descring) +
+		    counter_u64_fetch(tx->stats.tx_delayed_pkt_nospace_compring) +
+		    counter_u64_fetch(tx->stats.tx_delayed_pkt_nospace_qpl_bufs));
+		gve_put_stat(&stats[idx++], TX_FRAMES_SENT, i,
+		    counter_u64_fetch(tx->stats.tpackets));
+		gve_put_stat(&stats[idx++], TX_BYTES_SENT, i,
+		    counter_u64_fetch(tx->stats.tbytes));
+		gve_put_stat(&stats[idx++], TX_LAST_COMPLETION_PROCESSED, i,
+		    tx->done);
+		gve_put_stat(&stats[idx++], TX_TIMEOUT_CNT, i,
+		    counter_u64_fetch(tx->stats.tx_timeout));
+	}
+	for (i = 0; i < priv->rx_cfg.num_queues; i++) {
+		rx = &priv->rx[i];
+		gve_put_stat(&stats[idx++], RX_NEXT_EXPECTED_SEQUENCE, i,
+		    gve_is_gqi(priv) ? rx->seq_no : rx->dqo.tail);
+		gve_put_stat(&stats[idx++], RX_BUFFERS_POSTED, i, rx->fill_cnt);
+	}
+	report->written_count = htobe64(be64toh(report->written_count) + 1);
+
+	for (; idx < num_stats && stats[idx].stat_name != 0; idx++) {
+		queue_id = be32toh(stats[idx].queue_id);
+		if (queue_id >= priv->rx_cfg.num_queues)
+			continue;
+		rx = &priv->rx[queue_id];
+		value = be64toh(stats[idx].value);
+
+		switch (be32toh(stats[idx].stat_name)) {
+		case RX_QUEUE_DROP_CNT:
+			rx->nic_queue_drops = value;
+			break;
+		case RX_NO_BUFFERS_POSTED:
+			rx->nic_no_buffers_drops = value;
+			break;
+		case RX_DROPS_PACKET_OVER_MRU:
+			rx->nic_over_mru_drops = value;
+			break;
+		case RX_DROPS_INVALID_CHECKSUM:
+			rx->nic_bad_csum_drops = value;
+			break;
+		}
+	}
+
+	bus_dmamap_sync(priv->stats_report_mem.tag, priv->stats_report_mem.map,
+	    BUS_DMASYNC_PREWRITE);
+out:
+	GVE_IFACE_LOCK_UNLOCK(priv->gve_iface_lock);
+}
+
+/* Stops re-arming once the device has no stats report region to fill */
+static void
+gve_stats_report_callback(void *data)
+{
+	struct gve_priv *priv = (struct gve_priv *)data;
+
+	if (priv->stats_report == NULL)
+		return;
+
+	taskqueue_enqueue(priv->service_tq, &priv->service_task);
+	callout_reset_sbt(&priv->stats_report_callout,
+	    SBT_1MS * gve_stats_report_interval, 0,
+	    gve_stats_report_callback, (void *)priv, 0);
+}
+
+static void
+gve_start_stats_report(struct gve_priv *priv)
+{
+	if (priv->stats_report == NULL ||
+	    callout_pending(&priv->stats_report_callout))
+		return;
+
+	callout_reset_sbt(&priv->stats_report_callout,
+	    SBT_1MS * gve_stats_report_interval, 0,
+	    gve_stats_report_callback, (void *)priv, 0);
+}
+
+static void
+gve_free_nic_ts(struct gve_priv *priv)
+{
+	if (priv->nic_ts_report != NULL)
+		gve_dma_free_coherent(&priv->nic_ts_report_mem);
+	priv->nic_ts_report_mem = (struct gve_dma_handle){};
+	priv->nic_ts_report = NULL;
+}
+
+/*
+ * Allocates the region the device reports its clock into. Rx timestamps are
+ * optional, so failing here only leaves IFCAP_HWRXTSTMP unadvertised.
+ */
+static void
+gve_setup_nic_ts(struct gve_priv *priv)
+{
+	int err;
+
+	if (!priv->nic_ts_supported)
+		return;
+
+	err = gve_dma_alloc_coherent(priv, sizeof(struct gve_nic_ts_report),
+	    PAGE_SIZE, &priv->nic_ts_report_mem);
+	if (err != 0) {
+		device_printf(priv->dev,
+		    "Failed to alloc the NIC timestamp report: err=%d\n", err);
+		priv->nic_ts_supported = false;
+		return;
+	}
+	priv->nic_ts_report = priv->nic_ts_report_mem.cpu_addr;
+}
+
+static uint64_t
+gve_realtime_ns(void)
+{
+	struct timespec ts;
+
+	nanotime(&ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+/*
+ * Reads the NIC clock and publishes it along with the real time halfway
+ * through the adminq command. Readers copy the slot nic_ts_gen picks and
+ * retry if nic_ts_gen moved on meanwhile, as the slot may have been rewritten.
+ */
+static void
+gve_nic_ts_task(void *arg, int pending)
+{
+	struct gve_priv *priv = arg;
+	struct gve_nic_ts_sync *sync;
+	uint64_t before, after;
+	uint32_t gen;
+	int err;
+
+	GVE_IFACE_LOCK_LOCK(priv->gve_iface_lock);
+	if (!gve_get_state_flag(priv, GVE_STATE_FLAG_RESOURCES_OK) ||
+	    (if_getcapenable(priv->ifp) & IFCAP_HWRXTSTMP) == 0)
+		goto out;
+
+	before = gve_realtime_ns();
+	err = gve_adminq_report_nic_ts(priv, priv->nic_ts_report_mem.bus_addr);
+	after = gve_realtime_ns();
+	if (err != 0)
+		goto out;
+
+	bus_dmamap_sync(priv->nic_ts_report_mem.tag, priv->nic_ts_report_mem.map,
+	    BUS_DMASYNC_POSTREAD);
+	gen = priv->nic_ts_gen + 1;
+	if (gen == 0)
+		gen = 2;
+	sync = &priv->nic_ts_sync[gen & 1];
+	/* Order the last publish before the slot writes it lets readers notice */
+	atomic_thread_fence_rel();
+	sync->nic_ns = be64toh(priv->nic_ts_report->nic_timestamp);
+	sync->real_ns = before + (after - before) / 2;
+	atomic_store_rel_32(&priv->nic_ts_gen, gen);
+out:
+	GVE_IFACE_LOCK_UNLOCK(priv->gve_iface_lock);
+}
+
+static void
+gve_nic_ts_callback(void *data)
+{
+	struct gve_priv *priv = (struct gve_priv *)data;
+
+	taskqueue_enqueue(priv->service_tq, &priv->nic_ts_task);
+	callout_reset_sbt(&priv->nic_ts_callout, SBT_1MS * GVE_NIC_TS_SYNC_MS,
+	    0, gve_nic_ts_callback, (void *)priv, 0);
+}
+
 static void
 gve_deconfigure_and_free_device_resources(struct gve_priv *priv)
 {
@@ -734,6 +1442,7 @@ gve_deconfigure_and_free_device_resources(struct gve_priv *priv)
 
 	gve_free_irq_db_array(priv);
 	gve_free_counter_array(priv);
+	gve_free_stats_report(priv);
 
 	if (priv->ptype_lut_dqo) {
 		free(priv->ptype_lut_dqo, M_GVE);
@@ -777,6 +1486,8 @@ gve_alloc_and_configure_device_resources(struct gve_priv *priv)
 		}
 	}
 
+	gve_setup_stats_report(priv);
+
 	gve_set_state_flag(priv, GVE_STATE_FLAG_RESOURCES_OK);
 	if (bootverbose)
 		device_printf(priv->dev, "Configured device resources\n");
@@ -839,6 +1550,7 @@ gve_schedule_reset(struct gve_priv *priv)
 	if (gve_get_state_flag(priv, GVE_STATE_FLAG_IN_RESET))
 		return;
 
+	SDT_PROBE1(gve, , main, reset, priv);
 	device_printf(priv->dev, "Scheduling reset task!\n");
 	gve_set_state_flag(priv, GVE_STATE_FLAG_DO_RESET);
 	taskqueue_enqueue(priv->service_tq, &priv->service_task);
@@ -852,7 +1564,7 @@ gve_destroy(struct gve_priv *priv)
 	gve_release_adminq(priv);
 }
 
-static void
+static int
 gve_restore(struct gve_priv *priv)
 {
 	int err;
@@ -868,7 +1580,9 @@ gve_restore(struct gve_priv *priv)
 		err = (ENXIO);
 		goto abort;
 	}
-	if (!gve_is_gqi(priv)) {
+	/* The ptype map is a property of the device and survives a fast reset */
+	if (!gve_is_gqi(priv) &&
+	    !gve_get_state_flag(priv, GVE_STATE_FLAG_FAST_RESET)) {
 		err = gve_adminq_get_ptype_map_dqo(priv, priv->ptype_lut_dqo);
 		if (err != 0) {
 			device_printf(priv->dev, "Failed to configure ptype lut: err=%d\n",
@@ -877,15 +1591,18 @@ gve_restore(struct gve_priv *priv)
 		}
 	}
 
+	gve_setup_stats_report(priv);
+	gve_start_stats_report(priv);
+
 	err = gve_up(priv);
 	if (err != 0)
 		goto abort;
 
-	return;
+	return (0);
 
 abort:
 	device_printf(priv->dev, "Restore failed!\n");
-	return;
+	return (err);
 }
 
 static void
@@ -903,24 +1620,30 @@ gve_clear_device_resources(struct gve_priv *priv)
 	bus_dmamap_sync(priv->irqs_db_mem.tag, priv->irqs_db_mem.map,
 	    BUS_DMASYNC_PREWRITE);
 
-	if (priv->ptype_lut_dqo)
+	if (priv->ptype_lut_dqo &&
+	    !gve_get_state_flag(priv, GVE_STATE_FLAG_FAST_RESET))
 		*priv->ptype_lut_dqo = (struct gve_ptype_lut){0};
+
+	if (priv->stats_report != NULL) {
+		memset(priv->stats_report, 0, priv->stats_report_len);
+		bus_dmamap_sync(priv->stats_report_mem.tag,
+		    priv->stats_report_mem.map, BUS_DMASYNC_PREWRITE);
+	}
 }
 
-static void
-gve_handle_reset(struct gve_priv *priv)
+/*
+ * Takes the device through a reset. The QPLs, rings and their DMA memory stay
+ * allocated either way and only their registration with the device is redone.
+ * A fast reset also keeps the adminq memory, the ring taskqueues and the LRO
+ * state, and trusts the ptype map fetched earlier.
+ */
+static int
+gve_reset_and_restore(struct gve_priv *priv, bool fast)
 {
-	if (!gve_get_state_flag(priv, GVE_STATE_FLAG_DO_RESET))
-		return;
-
-	gve_clear_state_flag(priv, GVE_STATE_FLAG_DO_RESET);
-	gve_set_state_flag(priv, GVE_STATE_FLAG_IN_RESET);
-
-	GVE_IFACE_LOCK_LOCK(priv->gve_iface_lock);
+	int err;
 
-	if_setdrvflagbits(priv->ifp, IFF_DRV_OACTIVE, IFF_DRV_RUNNING);
-	if_link_state_change(priv->ifp, LINK_STATE_DOWN);
-	gve_clear_state_flag(priv, GVE_STATE_FLAG_LINK_UP);
+	if (fast)
+		gve_set_state_flag(priv, GVE_STATE_FLAG_FAST_RESET);
 
 	/*
 	 * Releasing the adminq causes the NIC to destroy all resources
@@ -931,7 +1654,10 @@ gve_handle_reset(struct gve_priv *priv)
 	 * The call to gve_down is needed in the first place to refresh
 	 * the state and the DMA-able memory within each driver ring.
 	 */
-	gve_release_adminq(priv);
+	if (fast)
+		gve_reset_adminq(priv);
+	else
+		gve_release_adminq(priv);
 	gve_clear_state_flag(priv, GVE_STATE_FLAG_RESOURCES_OK);
 	gve_clear_state_flag(priv, GVE_STATE_FLAG_QPLREG_OK);
 	gve_clear_state_flag(priv, GVE_STATE_FLAG_RX_RINGS_OK);
@@ -940,11 +1666,59 @@ gve_handle_reset(struct gve_priv *priv)
 	gve_down(priv);
 	gve_clear_device_resources(priv);
 
-	gve_restore(priv);
+	err = gve_restore(priv);
+
+	gve_clear_state_flag(priv, GVE_STATE_FLAG_FAST_RESET);
+	return (err);
+}
+
+static void
+gve_record_reset_outage(struct gve_priv *priv, sbintime_t outage)
+{
+	uint64_t ms = outage / SBT_1MS;
+	int bucket;
+
+	priv->reset_last_outage_us = MIN(outage / SBT_1US, UINT32_MAX);
+	bucket = ms < 2 ? 0 : flsll(ms) - 1;
+	priv->reset_outage_ms[MIN(bucket, GVE_RESET_OUTAGE_BUCKETS - 1)]++;
+}
+
+static void
+gve_handle_reset(struct gve_priv *priv)
+{
+	sbintime_t start;
+	bool fast;
+	int err;
+
+	if (!gve_get_state_flag(priv, GVE_STATE_FLAG_DO_RESET))
+		return;
 
+	gve_clear_state_flag(priv, GVE_STATE_FLAG_DO_RESET);
+	gve_set_state_flag(priv, GVE_STATE_FLAG_IN_RESET);
+
+	GVE_IFACE_LOCK_LOCK(priv->gve_iface_lock);
+
+	start = sbinuptime();
+	if_setdrvflagbits(priv->ifp, IFF_DRV_OACTIVE, IFF_DRV_RUNNING);
+	if_link_state_change(priv->ifp, LINK_STATE_DOWN);
+	gve_clear_state_flag(priv, GVE_STATE_FLAG_LINK_UP);
+
+	fast = priv->fast_reset;
+	err = gve_reset_and_restore(priv, fast);
+	if (err != 0 && fast) {
+		device_printf(priv->dev,
+		    "Fast reset failed: err=%d, falling back to a full reset\n",
+		    err);
+		fast = false;
+		gve_reset_and_restore(priv, fast);
+	}
+
+	gve_record_reset_outage(priv, sbinuptime() - start);
 	GVE_IFACE_LOCK_UNLOCK(priv->gve_iface_lock);
 
 	priv->reset_cnt++;
+	if (fast)
+		priv->reset_fast_cnt++;
 	gve_clear_state_flag(priv, GVE_STATE_FLAG_IN_RESET);
 }
 
@@ -983,6 +1757,7 @@ gve_service_task(void *arg, int pending)
 
 	gve_handle_reset(priv);
 	gve_handle_link_status(priv);
+	gve_handle_stats_report(priv);
 }
 
 static int
@@ -1071,16 +1846,28 @@ gve_attach(device_t dev)
 	if (err != 0)
 		goto abort;
 
+	/* The rings pick up their copybreak threshold as they are allocated */
+	priv->rx_copybreak = GVE_DEFAULT_RX_COPYBREAK;
+	priv->lro_entries = 0;
+	priv->lro_mbufs = 0;
+	priv->tx_db_batch_pkts = GVE_DEFAULT_TX_DB_BATCH_PKTS;
+	priv->tx_db_batch_bytes = GVE_DEFAULT_TX_DB_BATCH_BYTES;
+	priv->tx_ll_queues = 0;
+	priv->tx_ll_max_len = GVE_DEFAULT_TX_LL_MAX_LEN;
+	priv->tx_ll_dscp_mask = GVE_DEFAULT_TX_LL_DSCP_MASK;
+	priv->fast_reset = true;
+
 	err = gve_alloc_rings(priv);
 	if (err != 0)
 		goto abort;
 
+	gve_init_rss_config(priv);
+	gve_setup_nic_ts(priv);
+
 	err = gve_setup_ifnet(dev, priv);
 	if (err != 0)
 		goto abort;
 
-	priv->rx_copybreak = GVE_DEFAULT_RX_COPYBREAK;
-
 	bus_write_multi_1(priv->reg_bar, DRIVER_VERSION, GVE_DRIVER_VERSION,
 	    sizeof(GVE_DRIVER_VERSION) - 1);
 
@@ -1090,6 +1877,16 @@ gve_attach(device_t dev)
 	taskqueue_start_threads(&priv->service_tq, 1, PI_NET, "%s service tq",
 	    device_get_nameunit(priv->dev));
 
+	callout_init(&priv->stats_report_callout, true);
+	gve_start_stats_report(priv);
+
+	TASK_INIT(&priv->nic_ts_task, 0, gve_nic_ts_task, priv);
+	callout_init(&priv->nic_ts_callout, true);
+	if (priv->nic_ts_report != NULL)
+		callout_reset_sbt(&priv->nic_ts_callout,
+		    SBT_1MS * GVE_NIC_TS_SYNC_MS, 0,
+		    gve_nic_ts_callback, (void *)priv, 0);
+
         gve_setup_sysctl(priv);
 
 	if (bootverbose)
@@ -1097,6 +1894,7 @@ gve_attach(device_t dev)
 	return (0);
 
 abort:
+	gve_free_nic_ts(priv);
 	gve_free_rings(priv);
 	gve_deconfigure_and_free_device_resources(priv);
 	gve_release_adminq(priv);
@@ -1111,22 +1909,39 @@ gve_detach(device_t dev)
 	struct gve_priv *priv = device_get_softc(dev);
 	if_t ifp = priv->ifp;
 
+#ifdef DEV_NETMAP
+	netmap_detach(ifp);
+#endif
 	ether_ifdetach(ifp);
+#ifdef RATELIMIT
+	gve_snd_tag_detach(priv);
+#endif
 
 	ifmedia_removeall(&priv->media);
 
+	/* The stats report callout queues the service task */
+	callout_drain(&priv->stats_report_callout);
+	while (taskqueue_cancel(priv->service_tq, &priv->service_task, NULL))
+		taskqueue_drain(priv->service_tq, &priv->service_task);
+
+	callout_drain(&priv->nic_ts_callout);
+	taskqueue_drain(priv->service_tq, &priv->nic_ts_task);
+	gve_free_nic_ts(priv);
+
 	GVE_IFACE_LOCK_LOCK(priv->gve_iface_lock);
 	gve_destroy(priv);
 	GVE_IFACE_LOCK_UNLOCK(priv->gve_iface_lock);
 
-	gve_free_rings(priv);
-	gve_free_sys_res_mem(priv);
-	GVE_IFACE_LOCK_DESTROY(priv->gve_iface_lock);
-
+	/* A reset scheduled while going down must not outlive the device */
 	while (taskqueue_cancel(priv->service_tq, &priv->service_task, NULL))
 		taskqueue_drain(priv->service_tq, &priv->service_task);
 	taskqueue_free(priv->service_tq);
 
+	gve_free_rx_pfil(priv);
+	gve_free_rings(priv);
+	gve_free_sys_res_mem(priv);
+	GVE_IFACE_LOCK_DESTROY(priv->gve_iface_lock);
+
 	if_free(ifp);
 	return (bus_generic_detach(dev));
 }
@@ -1144,12 +1959,30 @@ static driver_t gve_driver = {
 	sizeof(struct gve_priv)
 };
 
+#ifdef RATELIMIT
+/* Send tags held by sockets can outlive every device */
+static int
+gve_modevent(module_t mod, int type, void *arg)
+{
+	switch (type) {
+	case MOD_QUIESCE:
+	case MOD_UNLOAD:
+		return (gve_snd_tag_unload());
+	default:
+		return (0);
+	}
+}
+#define GVE_MODEVENT gve_modevent
+#else
+#define GVE_MODEVENT 0
+#endif
+
 #if __FreeBSD_version < 1301503
 static devclass_t gve_devclass;
 
-DRIVER_MODULE(gve, pci, gve_driver, gve_devclass, 0, 0);
+DRIVER_MODULE(gve, pci, gve_driver, gve_devclass, GVE_MODEVENT, 0);
 #else
-DRIVER_MODULE(gve, pci, gve_driver, 0, 0);
+DRIVER_MODULE(gve, pci, gve_driver, GVE_MODEVENT, 0);
 #endif
 MODULE_PNP_INFO("U16:vendor;U16:device", pci, gve, gve_devs,
     GVE_DEVS_COUNT);
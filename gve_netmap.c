@@ -0,0 +1,240 @@
+/*-
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2024 Google LLC
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "opt_netmap.h"
+
+#include "gve.h"
+#include "gve_dqo.h"
+
+#ifdef DEV_NETMAP
+
+MODULE_DEPEND(gve, netmap, 1, 1, 1);
+
+/*
+ * The netmap rings sit on top of the regular device rings. The NIC keeps
+ * writing into and reading out of its own buffers (QPL pages or, in DQO RDA
+ * mode, cluster mbufs on RX), and the format-specific sync routines move
+ * packets between those and the netmap slots without ever building an mbuf
+ * or going through the network stack.
+ */
+
+static uint32_t
+gve_netmap_num_tx_slots(struct gve_priv *priv)
+{
+	/*
+	 * DQO netmap tx slots are backed 1:1 by pending packets, which
+	 * hand out the completion tags.
+	 */
+	if (gve_is_gqi(priv))
+		return (priv->tx_desc_cnt);
+	return (priv->tx[0].dqo.num_pending_pkts);
+}
+
+static int
+gve_netmap_config(struct netmap_adapter *na, struct nm_config_info *info)
+{
+	struct gve_priv *priv = if_getsoftc(na->ifp);
+
+	info->num_tx_rings = priv->tx_cfg.num_queues;
+	info->num_rx_rings = priv->rx_cfg.num_queues;
+	info->num_tx_descs = gve_netmap_num_tx_slots(priv);
+	info->num_rx_descs = priv->rx_desc_cnt;
+	info->rx_buf_maxsize = GVE_DEFAULT_RX_BUFFER_SIZE;
+	return (0);
+}
+
+static int
+gve_netmap_register(struct netmap_adapter *na, int onoff)
+{
+	struct gve_priv *priv = if_getsoftc(na->ifp);
+	bool was_up;
+	int err = 0;
+
+	GVE_IFACE_LOCK_LOCK(priv->gve_iface_lock);
+	/* Netmap slots cannot take the headers from the header buffers. */
+	if (onoff && priv->header_split_enabled) {
+		GVE_IFACE_LOCK_UNLOCK(priv->gve_iface_lock);
+		return (EOPNOTSUPP);
+	}
+
+	was_up = gve_get_state_flag(priv, GVE_STATE_FLAG_QUEUES_UP);
+	if (was_up)
+		gve_down(priv);
+
+	if (onoff)
+		nm_set_native_flags(na);
+	else
+		nm_clear_native_flags(na);
+
+	/*
+	 * A downed interface stays down; the rings call netmap_reset as they
+	 * are started, whenever that is.
+	 */
+	if (was_up) {
+		err = gve_up(priv);
+		if (err != 0 && onoff)
+			nm_clear_native_flags(na);
+	}
+	GVE_IFACE_LOCK_UNLOCK(priv->gve_iface_lock);
+
+	return (err);
+}
+
+void
+gve_netmap_attach(struct gve_priv *priv)
+{
+	struct netmap_adapter na;
+	int err;
+
+	bzero(&na, sizeof(na));
+
+	na.ifp = priv->ifp;
+	na.na_flags = NAF_BDG_MAYSLEEP;
+	na.num_tx_desc = gve_netmap_num_tx_slots(priv);
+	na.num_rx_desc = priv->rx_desc_cnt;
+	na.num_tx_rings = priv->tx_cfg.num_queues;
+	na.num_rx_rings = priv->rx_cfg.num_queues;
+	na.rx_buf_maxsize = GVE_DEFAULT_RX_BUFFER_SIZE;
+	na.nm_register = gve_netmap_register;
+	na.nm_config = gve_netmap_config;
+	if (gve_is_gqi(priv)) {
+		na.nm_txsync = gve_netmap_txsync_gqi;
+		na.nm_rxsync = gve_netmap_rxsync_gqi;
+	} else {
+		na.nm_txsync = gve_netmap_txsync_dqo;
+		na.nm_rxsync = gve_netmap_rxsync_dqo;
+	}
+
+	err = netmap_attach(&na);
+	if (err != 0)
+		device_printf(priv->dev, "Failed to attach netmap: err=%d\n",
+		    err);
+}
+
+bool
+gve_netmap_on(struct gve_priv *priv)
+{
+	return (nm_netmap_on(NA(priv->ifp)));
+}
+
+void
+gve_netmap_reset_ring(struct gve_priv *priv, int i, bool is_rx)
+{
+	struct netmap_adapter *na = NA(priv->ifp);
+
+	if (na == NULL)
+		return;
+
+	/* Puts the kring in netmap mode if userspace asked for it */
+	netmap_reset(na, is_rx ? NR_RX : NR_TX, i, 0);
+}
+
+/*
+ * Returns true if the ring is in netmap mode, in which case the netmap
+ * client has been woken up and the regular cleanup must not run.
+ */
+bool
+gve_netmap_rx_irq(struct gve_rx_ring *rx)
+{
+	u_int work_done;
+
+	return (netmap_rx_irq(rx->com.priv->ifp, rx->com.id,
+	    &work_done) != NM_IRQ_PASS);
+}
+
+bool
+gve_netmap_tx_irq(struct gve_tx_ring *tx)
+{
+	return (netmap_tx_irq(tx->com.priv->ifp, tx->com.id) != NM_IRQ_PASS);
+}
+
+/*
+ * Copies len bytes, starting at byte off of the packet held in the chain of
+ * slots beginning at nm_i, into dst.
+ */
+void
+gve_netmap_copy_slots(struct netmap_kring *kring, u_int nm_i, uint32_t off,
+    uint32_t len, char *dst)
+{
+	struct netmap_adapter *na = kring->na;
+	u_int lim = kring->nkr_num_slots - 1;
+	struct netmap_slot *slot;
+	uint32_t copy_len;
+
+	while (len > 0) {
+		slot = &kring->ring->slot[nm_i];
+		nm_i = nm_next(nm_i, lim);
+
+		if (off >= slot->len) {
+			off -= slot->len;
+			continue;
+		}
+
+		copy_len = MIN(len, slot->len - off);
+		memcpy(dst, (char *)NMB(na, slot) + off, copy_len);
+		dst += copy_len;
+		len -= copy_len;
+		off = 0;
+	}
+}
+
+/*
+ * Finds the slot holding the end of the packet starting at nm_i, never
+ * looking past stop_i. Returns false if that packet is not complete yet and
+ * otherwise reports its last slot, its length and whether any of its slots
+ * is empty.
+ */
+bool
+gve_netmap_tx_pkt_bounds(struct netmap_kring *kring, u_int nm_i, u_int stop_i,
+    u_int *last_i, uint32_t *pkt_len, bool *has_empty_slot)
+{
+	u_int lim = kring->nkr_num_slots - 1;
+	struct netmap_slot *slot;
+
+	*pkt_len = 0;
+	*has_empty_slot = false;
+
+	while (nm_i != stop_i) {
+		slot = &kring->ring->slot[nm_i];
+		*pkt_len += slot->len;
+		if (slot->len == 0)
+			*has_empty_slot = true;
+
+		if ((slot->flags & NS_MOREFRAG) == 0) {
+			*last_i = nm_i;
+			return (true);
+		}
+		nm_i = nm_next(nm_i, lim);
+	}
+
+	return (false);
+}
+
+#endif /* DEV_NETMAP */
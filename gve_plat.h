@@ -35,6 +35,7 @@
 #include <sys/systm.h>
 #include <sys/bitset.h>
 #include <sys/bus.h>
+#include <sys/cpuset.h>
 #include <sys/endian.h>
 #include <sys/eventhandler.h>
 #include <sys/kernel.h>
@@ -42,7 +43,9 @@
 #include <sys/malloc.h>
 #include <sys/mbuf.h>
 #include <sys/module.h>
+#include <sys/pcpu.h>
 #include <sys/rman.h>
+#include <sys/sdt.h>
 #include <sys/smp.h>
 #include <sys/socket.h>
 #include <sys/sockio.h>
@@ -59,6 +62,8 @@
 #include <net/if_types.h>
 #include <net/if_var.h>
 #include <net/if_vlan_var.h>
+#include <net/pfil.h>
+#include <net/vnet.h>
 #include <netinet/in.h>
 #include <netinet/in_systm.h>
 #include <netinet/if_ether.h>
@@ -82,6 +87,16 @@
 #include <dev/pci/pcireg.h>
 #include <dev/pci/pcivar.h>
 
+#ifdef RSS
+#include <net/rss_config.h>
+#endif
+
+#ifdef DEV_NETMAP
+#include <net/netmap.h>
+#include <sys/selinfo.h>
+#include <dev/netmap/netmap_kern.h>
+#endif
+
 typedef uint16_t __be16;
 typedef uint32_t __be32;
 typedef uint64_t __be64;
@@ -94,4 +109,10 @@ typedef uint64_t __le64;
 #define FBSD_VERSION_MINOR ((__FreeBSD_version / 1000) - FBSD_VERSION_MAJOR * 100)
 #define FBSD_VERSION_PATCH (__FreeBSD_version - ((FBSD_VERSION_MAJOR * 100 + FBSD_VERSION_MINOR) * 1000))
 
+#if __FreeBSD_version >= 1400086
+#define gve_if_getvnet(ifp) if_getvnet(ifp)
+#else
+#define gve_if_getvnet(ifp) ((ifp)->if_vnet)
+#endif
+
 #endif  // _GVE_PLAT_FBSD_H
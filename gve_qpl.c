@@ -36,8 +36,19 @@
 
 static MALLOC_DEFINE(M_GVE_QPL, "gve qpl", "gve qpl allocations");
 
-void
-gve_free_qpl(struct gve_priv *priv, struct gve_queue_page_list *qpl)
+/* A queue's pages come from the NUMA domain of the CPU the queue is bound to. */
+static int
+gve_qpl_domain(struct gve_priv *priv, uint32_t id)
+{
+	uint32_t idx = id;
+
+	if (idx >= priv->tx_cfg.max_queues)
+		idx -= priv->tx_cfg.max_queues;
+	return (pcpu_find(priv->queue_cpus[idx])->pc_domain);
+}
+
+static void
+gve_destroy_qpl(struct gve_queue_page_list *qpl)
 {
 	int i;
 
@@ -64,8 +75,6 @@ gve_free_qpl(struct gve_priv *priv, struct gve_queue_page_list *qpl)
 			}
 			vm_page_free(qpl->pages[i]);
 		}
-
-		priv->num_registered_pages--;
 	}
 
 	if (qpl->pages != NULL)
@@ -77,20 +86,14 @@ gve_free_qpl(struct gve_priv *priv, struct gve_queue_page_list *qpl)
 	free(qpl, M_GVE_QPL);
 }
 
-struct gve_queue_page_list *
-gve_alloc_qpl(struct gve_priv *priv, uint32_t id, int npages, bool single_kva)
+static struct gve_queue_page_list *
+gve_create_qpl(struct gve_priv *priv, uint32_t id, int npages, bool single_kva)
 {
 	struct gve_queue_page_list *qpl;
+	int domain;
 	int err;
 	int i;
 
-	if (npages + priv->num_registered_pages > priv->max_registered_pages) {
-		device_printf(priv->dev, "Reached max number of registered pages %ju > %ju\n",
-		    (uintmax_t)npages + priv->num_registered_pages,
-		    (uintmax_t)priv->max_registered_pages);
-		return (NULL);
-	}
-
 	qpl = malloc(sizeof(struct gve_queue_page_list), M_GVE_QPL,
 	    M_WAITOK | M_ZERO);
 
@@ -114,10 +117,14 @@ gve_alloc_qpl(struct gve_priv *priv, uint32_t id, int npages, bool single_kva)
 		}
 	}
 
+	domain = gve_qpl_domain(priv, id);
 	for (i = 0; i < npages; i++) {
-		qpl->pages[i] = vm_page_alloc_noobj(VM_ALLOC_WIRED |
-						    VM_ALLOC_WAITOK |
-						    VM_ALLOC_ZERO);
+		/* Take a page from anywhere rather than wait on a short domain */
+		qpl->pages[i] = vm_page_alloc_noobj_domain(domain,
+		    VM_ALLOC_WIRED | VM_ALLOC_NOWAIT | VM_ALLOC_ZERO);
+		if (qpl->pages[i] == NULL)
+			qpl->pages[i] = vm_page_alloc_noobj(
+			    VM_ALLOC_WIRED | VM_ALLOC_WAITOK | VM_ALLOC_ZERO);
 
 		if (!single_kva) {
 			qpl->dmas[i].cpu_addr = (void *)kva_alloc(PAGE_SIZE);
@@ -146,55 +153,287 @@ gve_alloc_qpl(struct gve_priv *priv, uint32_t id, int npages, bool single_kva)
 		}
 
 		qpl->num_dmas++;
-		priv->num_registered_pages++;
 	}
 
 	return (qpl);
 
 abort:
-	gve_free_qpl(priv, qpl);
+	gve_destroy_qpl(qpl);
 	return (NULL);
 }
 
-int
-gve_register_qpls(struct gve_priv *priv)
+/*
+ * Only a qpl none of whose pages the stack still holds can be handed to a
+ * ring again, see gve_mextadd_free.
+ */
+static bool
+gve_qpl_reusable(struct gve_queue_page_list *qpl)
 {
-	struct gve_ring_com *com;
-	struct gve_tx_ring *tx;
-	struct gve_rx_ring *rx;
-	int err;
 	int i;
 
-	if (gve_get_state_flag(priv, GVE_STATE_FLAG_QPLREG_OK))
-		return (0);
+	for (i = 0; i < qpl->num_pages; i++) {
+		if (VPRC_WIRE_COUNT(qpl->pages[i]->ref_count) != 1)
+			return (false);
+	}
+	return (true);
+}
 
-	/* Register TX qpls */
-	for (i = 0; i < priv->tx_cfg.num_queues; i++) {
-		tx = &priv->tx[i];
-		com = &tx->com;
-		err = gve_adminq_register_page_list(priv, com->qpl);
-		if (err != 0) {
-			device_printf(priv->dev,
-			    "Failed to register qpl %d, err: %d\n",
-			    com->qpl->id, err);
-			/* Caller schedules a reset when this fails */
-			return (err);
+static bool
+gve_qpl_fits(struct gve_queue_page_list *qpl, int npages, bool single_kva)
+{
+	return (qpl->num_pages == npages && (qpl->kva != 0) == single_kva);
+}
+
+/* Drops parked qpls other than id's until npages more fit under the limit. */
+static void
+gve_qpl_pool_evict(struct gve_priv *priv, uint32_t id, int npages)
+{
+	uint32_t num_qpls = priv->tx_cfg.max_queues + priv->rx_cfg.max_queues;
+	uint64_t parked_pages = 0;
+	int i;
+
+	for (i = 0; i < num_qpls; i++) {
+		if (priv->qpl_pool[i] != NULL)
+			parked_pages += priv->qpl_pool[i]->num_pages;
+	}
+
+	for (i = 0; i < num_qpls &&
+	    npages + priv->num_registered_pages + parked_pages >
+	    priv->max_registered_pages; i++) {
+		if (i == id || priv->qpl_pool[i] == NULL)
+			continue;
+		parked_pages -= priv->qpl_pool[i]->num_pages;
+		gve_destroy_qpl(priv->qpl_pool[i]);
+		priv->qpl_pool[i] = NULL;
+	}
+}
+
+/*
+ * Returns the qpl to the pool rather than unwiring it, so that ring size and
+ * queue count changes or a detach-free reset do not have to wire it again.
+ */
+void
+gve_free_qpl(struct gve_priv *priv, struct gve_queue_page_list *qpl)
+{
+	priv->num_registered_pages -= qpl->num_pages;
+
+	if (priv->qpl_pool != NULL && priv->qpl_pool[qpl->id] == NULL &&
+	    gve_qpl_reusable(qpl)) {
+		priv->qpl_pool[qpl->id] = qpl;
+		return;
+	}
+
+	gve_destroy_qpl(qpl);
+}
+
+struct gve_queue_page_list *
+gve_alloc_qpl(struct gve_priv *priv, uint32_t id, int npages, bool single_kva)
+{
+	struct gve_queue_page_list *qpl = NULL;
+
+	if (priv->qpl_pool != NULL) {
+		qpl = priv->qpl_pool[id];
+		priv->qpl_pool[id] = NULL;
+		if (qpl != NULL && !gve_qpl_fits(qpl, npages, single_kva)) {
+			gve_destroy_qpl(qpl);
+			qpl = NULL;
 		}
+		if (qpl == NULL)
+			gve_qpl_pool_evict(priv, id, npages);
 	}
 
-	/* Register RX qpls */
-	for (i = 0; i < priv->rx_cfg.num_queues; i++) {
-		rx = &priv->rx[i];
-		com = &rx->com;
-		err = gve_adminq_register_page_list(priv, com->qpl);
-		if (err != 0) {
-			device_printf(priv->dev,
-			    "Failed to register qpl %d, err: %d\n",
-			    com->qpl->id, err);
-			/* Caller schedules a reset when this fails */
-			return (err);
+	if (qpl == NULL &&
+	    npages + priv->num_registered_pages > priv->max_registered_pages) {
+		device_printf(priv->dev, "Reached max number of registered pages %ju > %ju\n",
+		    (uintmax_t)npages + priv->num_registered_pages,
+		    (uintmax_t)priv->max_registered_pages);
+		return (NULL);
+	}
+
+	if (qpl == NULL)
+		qpl = gve_create_qpl(priv, id, npages, single_kva);
+	if (qpl != NULL)
+		priv->num_registered_pages += qpl->num_pages;
+	return (qpl);
+}
+
+/*
+ * A page pool is a qpl that is never registered with the device, so it does
+ * not count against max_registered_pages. RDA rx rings post its pages by bus
+ * address.
+ */
+struct gve_queue_page_list *
+gve_alloc_page_pool(struct gve_priv *priv, uint32_t id, int npages)
+{
+	return (gve_create_qpl(priv, id, npages, /*single_kva=*/false));
+}
+
+void
+gve_free_page_pool(struct gve_queue_page_list *qpl)
+{
+	gve_destroy_qpl(qpl);
+}
+
+struct gve_qpl_alloc_job {
+	struct task task;
+	struct gve_priv *priv;
+	uint32_t id;
+	int npages;
+	bool single_kva;
+	struct gve_queue_page_list *qpl;
+};
+
+static void
+gve_qpl_alloc_task(void *arg, int pending)
+{
+	struct gve_qpl_alloc_job *job = arg;
+
+	job->qpl = gve_create_qpl(job->priv, job->id, job->npages,
+	    job->single_kva);
+}
+
+/*
+ * Wires the pages of the qpls [first_id, first_id + num_qpls) in parallel,
+ * one task per qpl, and parks them in the pool for the serial ring allocation
+ * to pick up. Failures are left for that allocation to hit and report.
+ */
+void
+gve_prealloc_qpls(struct gve_priv *priv, uint32_t first_id, int num_qpls,
+    int npages, bool single_kva)
+{
+	struct gve_queue_page_list **pool = priv->qpl_pool;
+	struct gve_qpl_alloc_job *jobs;
+	struct taskqueue *tq;
+	int num_jobs = 0;
+	int i;
+
+	if (pool == NULL)
+		return;
+
+	jobs = malloc(num_qpls * sizeof(*jobs), M_GVE_QPL, M_WAITOK | M_ZERO);
+	for (i = 0; i < num_qpls; i++) {
+		if (pool[first_id + i] != NULL &&
+		    gve_qpl_fits(pool[first_id + i], npages, single_kva))
+			continue;
+		jobs[num_jobs] = (struct gve_qpl_alloc_job){
+			.priv = priv,
+			.id = first_id + i,
+			.npages = npages,
+			.single_kva = single_kva,
+		};
+		TASK_INIT(&jobs[num_jobs].task, 0, gve_qpl_alloc_task,
+		    &jobs[num_jobs]);
+		num_jobs++;
+	}
+
+	if (num_jobs < 2 || (uint64_t)num_jobs * npages +
+	    priv->num_registered_pages > priv->max_registered_pages)
+		goto out;
+
+	for (i = 0; i < num_jobs; i++) {
+		if (pool[jobs[i].id] != NULL) {
+			gve_destroy_qpl(pool[jobs[i].id]);
+			pool[jobs[i].id] = NULL;
 		}
 	}
+	gve_qpl_pool_evict(priv, UINT32_MAX, num_jobs * npages);
+
+	tq = taskqueue_create("gve qpl", M_WAITOK, taskqueue_thread_enqueue,
+	    &tq);
+	taskqueue_start_threads(&tq, MIN(num_jobs, mp_ncpus), PVM,
+	    "%s qpl alloc", device_get_nameunit(priv->dev));
+	for (i = 0; i < num_jobs; i++)
+		taskqueue_enqueue(tq, &jobs[i].task);
+	taskqueue_drain_all(tq);
+	taskqueue_free(tq);
+
+	for (i = 0; i < num_jobs; i++)
+		pool[jobs[i].id] = jobs[i].qpl;
+
+out:
+	free(jobs, M_GVE_QPL);
+}
+
+void
+gve_alloc_qpl_pool(struct gve_priv *priv)
+{
+	priv->qpl_pool = malloc((priv->tx_cfg.max_queues +
+	    priv->rx_cfg.max_queues) * sizeof(*priv->qpl_pool), M_GVE_QPL,
+	    M_WAITOK | M_ZERO);
+}
+
+/* Unwires the parked qpls; the ones held by rings must be freed first. */
+void
+gve_free_qpl_pool(struct gve_priv *priv)
+{
+	int i;
+
+	if (priv->qpl_pool == NULL)
+		return;
+
+	for (i = 0; i < priv->tx_cfg.max_queues + priv->rx_cfg.max_queues; i++) {
+		if (priv->qpl_pool[i] != NULL)
+			gve_destroy_qpl(priv->qpl_pool[i]);
+	}
+	free(priv->qpl_pool, M_GVE_QPL);
+	priv->qpl_pool = NULL;
+}
+
+/* Registers the qpls of the rx or tx rings in [start_idx, stop_idx). */
+int
+gve_register_qpl_range(struct gve_priv *priv, bool is_rx, uint16_t start_idx,
+    uint16_t stop_idx)
+{
+	int err;
+
+	err = gve_adminq_register_page_lists(priv, is_rx, start_idx, stop_idx);
+	if (err != 0) {
+		device_printf(priv->dev,
+		    "Failed to register %s qpls %d to %d, err: %d\n",
+		    is_rx ? "rx" : "tx", start_idx, stop_idx - 1, err);
+		/* Some of the batch may have gone through */
+		gve_adminq_unregister_page_lists(priv, is_rx, start_idx,
+		    stop_idx);
+	}
+
+	return (err);
+}
+
+int
+gve_unregister_qpl_range(struct gve_priv *priv, bool is_rx, uint16_t start_idx,
+    uint16_t stop_idx)
+{
+	int err;
+
+	err = gve_adminq_unregister_page_lists(priv, is_rx, start_idx, stop_idx);
+	if (err != 0) {
+		device_printf(priv->dev,
+		    "Failed to unregister %s qpls %d to %d, err: %d\n",
+		    is_rx ? "rx" : "tx", start_idx, stop_idx - 1, err);
+	}
+
+	return (err);
+}
+
+int
+gve_register_qpls(struct gve_priv *priv)
+{
+	int err;
+
+	if (gve_get_state_flag(priv, GVE_STATE_FLAG_QPLREG_OK))
+		return (0);
+
+	/* Caller schedules a reset when this fails */
+	err = gve_register_qpl_range(priv, /*is_rx=*/false, 0,
+	    priv->tx_cfg.num_queues);
+	if (err != 0)
+		return (err);
+
+	err = gve_register_qpl_range(priv, /*is_rx=*/true, 0,
+	    priv->rx_cfg.num_queues);
+	if (err != 0)
+		return (err);
+
 	gve_set_state_flag(priv, GVE_STATE_FLAG_QPLREG_OK);
 	return (0);
 }
@@ -202,37 +441,18 @@ gve_register_qpls(struct gve_priv *priv)
 int
 gve_unregister_qpls(struct gve_priv *priv)
 {
+	int tx_err;
 	int err;
-	int i;
-	struct gve_ring_com *com;
-	struct gve_tx_ring *tx;
-	struct gve_rx_ring *rx;
 
 	if (!gve_get_state_flag(priv, GVE_STATE_FLAG_QPLREG_OK))
 		return (0);
 
-	for (i = 0; i < priv->tx_cfg.num_queues; i++) {
-		tx = &priv->tx[i];
-		com = &tx->com;
-		err = gve_adminq_unregister_page_list(priv, com->qpl->id);
-		if (err != 0) {
-			device_printf(priv->dev,
-			    "Failed to unregister qpl %d, err: %d\n",
-			    com->qpl->id, err);
-		}
-	}
-
-	for (i = 0; i < priv->rx_cfg.num_queues; i++) {
-		rx = &priv->rx[i];
-		com = &rx->com;
-		err = gve_adminq_unregister_page_list(priv, com->qpl->id);
-		if (err != 0) {
-			device_printf(priv->dev,
-			    "Failed to unregister qpl %d, err: %d\n",
-			    com->qpl->id, err);
-		}
-	}
-
+	tx_err = gve_unregister_qpl_range(priv, /*is_rx=*/false, 0,
+	    priv->tx_cfg.num_queues);
+	err = gve_unregister_qpl_range(priv, /*is_rx=*/true, 0,
+	    priv->rx_cfg.num_queues);
+	if (err == 0)
+		err = tx_err;
 	if (err != 0)
 		return (err);
 
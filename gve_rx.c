@@ -28,6 +28,8 @@
  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#include "opt_netmap.h"
+
 #include "gve.h"
 #include "gve_adminq.h"
 #include "gve_dqo.h"
@@ -43,6 +45,16 @@ gve_rx_free_ring_gqi(struct gve_priv *priv, int i)
 		rx->page_info = NULL;
 	}
 
+	if (rx->free_pages != NULL) {
+		free(rx->free_pages, M_GVE);
+		rx->free_pages = NULL;
+	}
+
+	if (rx->used_pages != NULL) {
+		free(rx->used_pages, M_GVE);
+		rx->used_pages = NULL;
+	}
+
 	if (rx->data_ring != NULL) {
 		gve_dma_free_coherent(&rx->data_ring_mem);
 		rx->data_ring = NULL;
@@ -59,12 +71,162 @@ gve_rx_free_ring_gqi(struct gve_priv *priv, int i)
 	}
 }
 
+static void
+gve_rx_mbuf_cache_drain(struct gve_rx_ring *rx)
+{
+	struct gve_rx_mbuf_cache *cache = &rx->mbuf_cache;
+
+	while (cache->cnt != 0)
+		m_free(cache->mbufs[--cache->cnt]);
+}
+
+/*
+ * Tops the cache back up once it runs below the low watermark. Called outside
+ * the descriptor loops so that a burst draws on mbufs allocated beforehand.
+ * UMA has no bulk interface for mbufs, but m_getcl is served from the
+ * pre-assembled packet zone and a run of back to back allocations stays on
+ * the per-cpu UMA bucket.
+ */
+void
+gve_rx_mbuf_cache_refill(struct gve_rx_ring *rx, int how)
+{
+	struct gve_rx_mbuf_cache *cache = &rx->mbuf_cache;
+	struct gve_priv *priv = rx->com.priv;
+	struct mbuf *mbuf;
+
+	/* DQO QPL buffers are all qpl pages */
+	if (!gve_is_gqi(priv) && gve_is_qpl(priv))
+		return;
+
+	if (cache->cnt >= GVE_RX_MBUF_CACHE_LOWAT)
+		return;
+
+	while (cache->cnt < GVE_RX_MBUF_CACHE_SIZE) {
+		if (cache->cluster)
+			mbuf = m_getcl(how, MT_DATA, M_PKTHDR);
+		else
+			mbuf = m_gethdr(how, MT_DATA);
+		if (__predict_false(mbuf == NULL))
+			break;
+		cache->mbufs[cache->cnt++] = mbuf;
+	}
+}
+
+/*
+ * Called at the end of every cleanup pass. Buffers being scarce makes copying
+ * the cheaper option, while copying mid-size frags with buffers to spare only
+ * burns cycles, all the more so when most frags end up copied.
+ */
+void
+gve_rx_copybreak_adapt(struct gve_rx_ring *rx)
+{
+	struct gve_rx_copybreak *cb = &rx->copybreak;
+	uint32_t base = rx->com.priv->rx_copybreak;
+	uint32_t override;
+
+	override = atomic_load_32(&cb->override);
+	if (override != 0)
+		cb->thresh = override;
+	else if (cb->frags < GVE_RX_COPYBREAK_WINDOW)
+		return;
+	else if (cb->starved * GVE_RX_COPYBREAK_STARVED_DIV >= cb->frags)
+		cb->thresh = MIN(MAX(cb->thresh * 2, MHLEN),
+		    GVE_RX_COPYBREAK_MAX);
+	else if (cb->starved == 0 && cb->thresh > base) {
+		if (cb->copies * 2 > cb->frags)
+			cb->thresh = MAX(cb->thresh / 2, base);
+		else
+			cb->thresh = MAX(cb->thresh - cb->thresh / 4, base);
+	}
+	if (override == 0)
+		cb->thresh = MAX(cb->thresh, base);
+
+	cb->frags = 0;
+	cb->copies = 0;
+	cb->starved = 0;
+}
+
+/*
+ * Runs the rx pfil hooks over a packet that sits whole in one buffer, before
+ * an mbuf is built for it. Returns true if the hooks dropped or consumed the
+ * packet, or handed back a copy of it which has been input in its place; the
+ * caller then reposts the buffer as it is.
+ */
+bool
+gve_rx_pfil(struct gve_rx_ring *rx, pfil_head_t head, void *va, uint16_t len)
+{
+	struct gve_priv *priv = rx->com.priv;
+	struct mbuf *mbuf = NULL;
+	pfil_return_t rv;
+
+	/* Hooks can use V_ state, so they run in the vnet of the ifnet */
+	CURVNET_SET(gve_if_getvnet(priv->ifp));
+#if __FreeBSD_version >= 1400086
+	rv = pfil_mem_in(head, va, len, priv->ifp, &mbuf);
+#else
+	rv = pfil_run_hooks(head, va, priv->ifp,
+	    len | PFIL_MEMPTR | PFIL_IN, NULL);
+	if (rv == PFIL_REALLOCED)
+		mbuf = pfil_mem2mbuf(va);
+#endif
+	CURVNET_RESTORE();
+	switch (rv) {
+	case PFIL_PASS:
+		return (false);
+	case PFIL_REALLOCED:
+		gve_rx_input(rx, mbuf);
+		counter_enter();
+		counter_u64_add_protected(rx->stats.rbytes, len);
+		counter_u64_add_protected(rx->stats.rpackets, 1);
+		counter_exit();
+		return (true);
+	default:
+		counter_enter();
+		counter_u64_add_protected(rx->stats.rx_pfil_dropped, 1);
+		counter_exit();
+		return (true);
+	}
+}
+
+/*
+ * Returns a packet header mbuf, with a cluster if the ring caches those,
+ * falling back on allocating one when the cache has run dry. Only the misses
+ * of the cleanup path are counted: a M_WAITOK ring start posts more buffers
+ * than the cache holds.
+ */
+struct mbuf *
+gve_rx_mbuf_cache_get(struct gve_rx_ring *rx, int how)
+{
+	struct gve_rx_mbuf_cache *cache = &rx->mbuf_cache;
+
+	if (__predict_true(cache->cnt != 0))
+		return (cache->mbufs[--cache->cnt]);
+
+	if (how == M_NOWAIT) {
+		counter_enter();
+		counter_u64_add_protected(rx->stats.rx_mbuf_cache_empty, 1);
+		counter_exit();
+	}
+	if (cache->cluster)
+		return (m_getcl(how, MT_DATA, M_PKTHDR));
+	return (m_gethdr(how, MT_DATA));
+}
+
 static void
 gve_rx_free_ring(struct gve_priv *priv, int i)
 {
 	struct gve_rx_ring *rx = &priv->rx[i];
 	struct gve_ring_com *com = &rx->com;
 
+	gve_rx_mbuf_cache_drain(rx);
+
+	/* Left behind by a fast reset that failed to bring the ring back up */
+	if (com->cleanup_tq != NULL) {
+		taskqueue_free(com->cleanup_tq);
+		com->cleanup_tq = NULL;
+		tcp_lro_free(&rx->lro);
+	}
+
         /* Safe to call even if never allocated */
 	gve_free_counters((counter_u64_t *)&rx->stats, NUM_RX_STATS);
 
@@ -79,6 +241,26 @@ gve_rx_free_ring(struct gve_priv *priv, int i)
 	}
 }
 
+/*
+ * Spare pages come out of what max_registered_pages leaves once every qpl the
+ * queue maximums can call for has its ring's worth of pages, split evenly
+ * between the rx rings and up to one per slot. The device's rx_pages_per_qpl
+ * is normally just the ring size, so it leaves no room for spares.
+ */
+static uint32_t
+gve_rx_spare_pages_gqi(struct gve_priv *priv)
+{
+	uint64_t base;
+
+	base = (uint64_t)priv->tx_cfg.max_queues *
+	    (priv->tx_desc_cnt / GVE_QPL_DIVISOR) +
+	    (uint64_t)priv->rx_cfg.max_queues * priv->rx_desc_cnt;
+	if (base >= priv->max_registered_pages)
+		return (0);
+	return (MIN((priv->max_registered_pages - base) /
+	    priv->rx_cfg.max_queues, priv->rx_desc_cnt));
+}
+
 static void
 gve_prefill_rx_slots(struct gve_rx_ring *rx)
 {
@@ -86,8 +268,15 @@ gve_prefill_rx_slots(struct gve_rx_ring *rx)
 	struct gve_dma_handle *dma;
 	int i;
 
+	for (i = 0; i < rx->num_spare_pages; i++)
+		rx->free_pages[i] = com->priv->rx_desc_cnt + i;
+	rx->free_page_cnt = rx->num_spare_pages;
+	rx->used_page_head = 0;
+	rx->used_page_cnt = 0;
+
 	for (i = 0; i < com->priv->rx_desc_cnt; i++) {
 		rx->data_ring[i].qpl_offset = htobe64(PAGE_SIZE * i);
+		rx->page_info[i].page_idx = i;
 		rx->page_info[i].page_offset = 0;
 		rx->page_info[i].page_address = com->qpl->dmas[i].cpu_addr;
 		rx->page_info[i].page = com->qpl->pages[i];
@@ -119,8 +308,9 @@ gve_rx_alloc_ring_gqi(struct gve_priv *priv, int i)
 	rx->mask = priv->rx_pages_per_qpl - 1;
 	rx->desc_ring = rx->desc_ring_mem.cpu_addr;
 
+	rx->num_spare_pages = gve_rx_spare_pages_gqi(priv);
 	com->qpl = gve_alloc_qpl(priv, i + priv->tx_cfg.max_queues,
-	    priv->rx_desc_cnt, /*single_kva=*/false);
+	    priv->rx_desc_cnt + rx->num_spare_pages, /*single_kva=*/false);
 	if (com->qpl == NULL) {
 		device_printf(priv->dev,
 		    "Failed to alloc QPL for rx ring %d", i);
@@ -131,6 +321,13 @@ gve_rx_alloc_ring_gqi(struct gve_priv *priv, int i)
 	rx->page_info = malloc(priv->rx_desc_cnt * sizeof(*rx->page_info),
 	    M_GVE, M_WAITOK | M_ZERO);
 
+	if (rx->num_spare_pages != 0) {
+		rx->free_pages = malloc(rx->num_spare_pages *
+		    sizeof(*rx->free_pages), M_GVE, M_WAITOK);
+		rx->used_pages = malloc(rx->num_spare_pages *
+		    sizeof(*rx->used_pages), M_GVE, M_WAITOK);
+	}
+
 	err = gve_dma_alloc_coherent(priv,
 	    sizeof(union gve_rx_data_slot) * priv->rx_desc_cnt,
 	    CACHE_LINE_SIZE, &rx->data_ring_mem);
@@ -158,6 +355,13 @@ gve_rx_alloc_ring(struct gve_priv *priv, int i)
 
 	com->priv = priv;
 	com->id = i;
+	rx->mbuf_cache.cnt = 0;
+	rx->mbuf_cache.cluster = !gve_is_gqi(priv);
+	rx->copybreak.thresh = rx->copybreak.override != 0 ?
+	    rx->copybreak.override : priv->rx_copybreak;
+	rx->copybreak.frags = 0;
+	rx->copybreak.copies = 0;
+	rx->copybreak.starved = 0;
 
 	gve_alloc_counters((counter_u64_t *)&rx->stats, NUM_RX_STATS);
 
@@ -192,6 +396,15 @@ gve_alloc_rx_rings(struct gve_priv *priv, uint16_t start_idx, uint16_t stop_idx)
 
 	KASSERT(priv->rx != NULL, ("priv->rx is NULL!"));
 
+	/* Same shape as the gve_alloc_qpl calls made by the ring allocation */
+	if (gve_is_qpl(priv) && stop_idx > start_idx)
+		gve_prealloc_qpls(priv, start_idx + priv->tx_cfg.max_queues,
+		    stop_idx - start_idx,
+		    gve_is_gqi(priv) ?
+		    priv->rx_desc_cnt + gve_rx_spare_pages_gqi(priv) :
+		    GVE_RX_NUM_QPL_PAGES_DQO,
+		    /*single_kva=*/false);
+
 	for (i = start_idx; i < stop_idx; i++) {
 		err = gve_rx_alloc_ring(priv, i);
 		if (err != 0)
@@ -229,8 +442,8 @@ gve_rx_clear_data_ring(struct gve_rx_ring *rx)
 	 * can fill the ring without waiting on can_flip at each slot to become true.
 	 */
 	for (i = 0; i < priv->rx_desc_cnt; i++) {
-		rx->data_ring[i].qpl_offset = htobe64(PAGE_SIZE * i +
-		    rx->page_info[i].page_offset);
+		rx->data_ring[i].qpl_offset = htobe64(PAGE_SIZE *
+		    rx->page_info[i].page_idx + rx->page_info[i].page_offset);
 		rx->fill_cnt++;
 	}
 
@@ -275,52 +488,69 @@ gve_start_rx_ring(struct gve_priv *priv, int i)
 {
 	struct gve_rx_ring *rx = &priv->rx[i];
 	struct gve_ring_com *com = &rx->com;
+	cpuset_t cpuset;
 
-	if ((if_getcapenable(priv->ifp) & IFCAP_LRO) != 0) {
-		if (tcp_lro_init(&rx->lro) != 0)
+	if ((if_getcapenable(priv->ifp) & IFCAP_LRO) != 0 &&
+	    !gve_get_state_flag(priv, GVE_STATE_FLAG_FAST_RESET)) {
+		if (tcp_lro_init_args(&rx->lro, priv->ifp,
+		    priv->lro_entries != 0 ? priv->lro_entries : TCP_LRO_ENTRIES,
+		    priv->lro_mbufs) != 0)
 			device_printf(priv->dev, "Failed to init lro for rx ring %d", i);
 		rx->lro.ifp = priv->ifp;
 	}
 
-	if (gve_is_gqi(priv))
-		NET_TASK_INIT(&com->cleanup_task, 0, gve_rx_cleanup_tq, rx);
-	else
-		NET_TASK_INIT(&com->cleanup_task, 0, gve_rx_cleanup_tq_dqo, rx);
-	com->cleanup_tq = taskqueue_create_fast("gve rx", M_WAITOK,
-	    taskqueue_thread_enqueue, &com->cleanup_tq);
-
-	taskqueue_start_threads(&com->cleanup_tq, 1, PI_NET,
-	    "%s rxq %d", device_get_nameunit(priv->dev), i);
+	/* Kept across a fast reset */
+	if (com->cleanup_tq == NULL) {
+		if (gve_is_gqi(priv))
+			NET_TASK_INIT(&com->cleanup_task, 0, gve_rx_cleanup_tq, rx);
+		else
+			NET_TASK_INIT(&com->cleanup_task, 0,
+			    gve_rx_cleanup_tq_dqo, rx);
+		com->cleanup_tq = taskqueue_create_fast("gve rx", M_WAITOK,
+		    taskqueue_thread_enqueue, &com->cleanup_tq);
+
+		CPU_SETOF(priv->queue_cpus[i], &cpuset);
+		taskqueue_start_threads_cpuset(&com->cleanup_tq, 1, PI_NET,
+		    &cpuset, "%s rxq %d", device_get_nameunit(priv->dev), i);
+	}
+	gve_bind_queue(priv, com);
 
+	/* The DQO prefill takes its mbufs from the cache, topped up again after */
+	gve_rx_mbuf_cache_refill(rx, M_WAITOK);
 	if (gve_is_gqi(priv)) {
 		/* GQ RX bufs are prefilled at ring alloc time */
 		gve_db_bar_write_4(priv, com->db_offset, rx->fill_cnt);
-	} else
+	} else {
 		gve_rx_prefill_buffers_dqo(rx);
+		gve_rx_mbuf_cache_refill(rx, M_WAITOK);
+	}
+
+#ifdef DEV_NETMAP
+	gve_netmap_reset_ring(priv, i, /*is_rx=*/true);
+#endif
 }
 
+/* Creates and starts the rx rings in [start_idx, stop_idx), already allocated. */
 int
-gve_create_rx_rings(struct gve_priv *priv)
+gve_create_rx_ring_range(struct gve_priv *priv, uint16_t start_idx,
+    uint16_t stop_idx)
 {
 	struct gve_ring_com *com;
 	struct gve_rx_ring *rx;
 	int err;
 	int i;
 
-	if (gve_get_state_flag(priv, GVE_STATE_FLAG_RX_RINGS_OK))
-		return (0);
-
-	for (i = 0; i < priv->rx_cfg.num_queues; i++)
+	for (i = start_idx; i < stop_idx; i++)
 		gve_clear_rx_ring(priv, i);
 
-	err = gve_adminq_create_rx_queues(priv, priv->rx_cfg.num_queues);
+	err = gve_adminq_create_rx_queues(priv, start_idx, stop_idx);
 	if (err != 0)
 		return (err);
 
 	bus_dmamap_sync(priv->irqs_db_mem.tag, priv->irqs_db_mem.map,
 	    BUS_DMASYNC_POSTREAD);
 
-	for (i = 0; i < priv->rx_cfg.num_queues; i++) {
+	for (i = start_idx; i < stop_idx; i++) {
 		rx = &priv->rx[i];
 		com = &rx->com;
 
@@ -334,6 +564,21 @@ gve_create_rx_rings(struct gve_priv *priv)
 		gve_start_rx_ring(priv, i);
 	}
 
+	return (0);
+}
+
+int
+gve_create_rx_rings(struct gve_priv *priv)
+{
+	int err;
+
+	if (gve_get_state_flag(priv, GVE_STATE_FLAG_RX_RINGS_OK))
+		return (0);
+
+	err = gve_create_rx_ring_range(priv, 0, priv->rx_cfg.num_queues);
+	if (err != 0)
+		return (err);
+
 	gve_set_state_flag(priv, GVE_STATE_FLAG_RX_RINGS_OK);
 	return (0);
 }
@@ -344,14 +589,32 @@ gve_stop_rx_ring(struct gve_priv *priv, int i)
 	struct gve_rx_ring *rx = &priv->rx[i];
 	struct gve_ring_com *com = &rx->com;
 
+	if (com->cleanup_tq != NULL)
+		gve_itr_stop(com);
+	rx->ctx = (struct gve_rx_ctx){};
+
+	/* A fast reset starts the ring straight back up on the same tq */
+	if (gve_get_state_flag(priv, GVE_STATE_FLAG_FAST_RESET))
+		return;
+
 	if (com->cleanup_tq != NULL) {
-		taskqueue_quiesce(com->cleanup_tq);
 		taskqueue_free(com->cleanup_tq);
 		com->cleanup_tq = NULL;
 	}
-
 	tcp_lro_free(&rx->lro);
-	rx->ctx = (struct gve_rx_ctx){};
+}
+
+/* Stops and destroys the rx rings in [start_idx, stop_idx), leaving them allocated. */
+int
+gve_destroy_rx_ring_range(struct gve_priv *priv, uint16_t start_idx,
+    uint16_t stop_idx)
+{
+	int i;
+
+	for (i = start_idx; i < stop_idx; i++)
+		gve_stop_rx_ring(priv, i);
+
+	return (gve_adminq_destroy_rx_queues(priv, start_idx, stop_idx));
 }
 
 int
@@ -364,7 +627,8 @@ gve_destroy_rx_rings(struct gve_priv *priv)
 		gve_stop_rx_ring(priv, i);
 
 	if (gve_get_state_flag(priv, GVE_STATE_FLAG_RX_RINGS_OK)) {
-		err = gve_adminq_destroy_rx_queues(priv, priv->rx_cfg.num_queues);
+		err = gve_adminq_destroy_rx_queues(priv, 0,
+		    priv->rx_cfg.num_queues);
 		if (err != 0)
 			return (err);
 		gve_clear_state_flag(priv, GVE_STATE_FLAG_RX_RINGS_OK);
@@ -384,6 +648,9 @@ gve_rx_intr(void *arg)
 		return (FILTER_STRAY);
 
 	gve_db_bar_write_4(priv, com->irq_db_offset, GVE_IRQ_MASK);
+#ifdef GVE_HISTOGRAMS
+	com->intr_time = sbinuptime();
+#endif
 	taskqueue_enqueue(rx->com.cleanup_tq, &rx->com.cleanup_task);
 	return (FILTER_HANDLED);
 }
@@ -420,6 +687,62 @@ gve_rx_flip_buff(struct gve_rx_slot_page_info *page_info, __be64 *slot_addr)
 	*(slot_addr) ^= offset;
 }
 
+/* Moves the swapped out pages the stack is done with back to free_pages. */
+static void
+gve_rx_recycle_pages(struct gve_rx_ring *rx)
+{
+	struct gve_queue_page_list *qpl = rx->com.qpl;
+	uint32_t idx;
+
+	while (rx->used_page_cnt != 0) {
+		idx = rx->used_pages[rx->used_page_head];
+		if (VPRC_WIRE_COUNT(atomic_load_int(&qpl->pages[idx]->ref_count)) != 1)
+			break;
+		rx->free_pages[rx->free_page_cnt++] = idx;
+		if (++rx->used_page_head == rx->num_spare_pages)
+			rx->used_page_head = 0;
+		rx->used_page_cnt--;
+	}
+}
+
+static bool
+gve_rx_spare_page_ready(struct gve_rx_ring *rx)
+{
+	if (rx->free_page_cnt == 0)
+		gve_rx_recycle_pages(rx);
+	return (rx->free_page_cnt != 0);
+}
+
+/*
+ * Posts a free spare page in place of the slot's page, which queues on
+ * used_pages till the stack lets go of both its halves.
+ */
+static void
+gve_rx_swap_page(struct gve_rx_ring *rx, struct gve_rx_slot_page_info *page_info,
+    union gve_rx_data_slot *data_slot)
+{
+	struct gve_queue_page_list *qpl = rx->com.qpl;
+	struct gve_dma_handle *dma;
+	uint32_t tail;
+	uint32_t idx;
+
+	tail = rx->used_page_head + rx->used_page_cnt;
+	if (tail >= rx->num_spare_pages)
+		tail -= rx->num_spare_pages;
+	rx->used_pages[tail] = page_info->page_idx;
+	rx->used_page_cnt++;
+
+	idx = rx->free_pages[--rx->free_page_cnt];
+	dma = &qpl->dmas[idx];
+	bus_dmamap_sync(dma->tag, dma->map, BUS_DMASYNC_PREREAD);
+
+	page_info->page_idx = idx;
+	page_info->page = qpl->pages[idx];
+	page_info->page_address = dma->cpu_addr;
+	page_info->page_offset = 0;
+	data_slot->qpl_offset = htobe64(PAGE_SIZE * idx);
+}
+
 static struct mbuf *
 gve_rx_create_mbuf(struct gve_priv *priv, struct gve_rx_ring *rx,
     struct gve_rx_slot_page_info *page_info, uint16_t len,
@@ -428,13 +751,22 @@ gve_rx_create_mbuf(struct gve_priv *priv, struct gve_rx_ring *rx,
 	struct gve_rx_ctx *ctx = &rx->ctx;
 	struct mbuf *mbuf;
 	u_int ref_count;
+	bool zero_copy;
+	bool copybreak;
 	bool can_flip;
 
 	uint32_t offset = page_info->page_offset + page_info->pad;
 	void *va = (char *)page_info->page_address + offset;
 
-	if (len <= priv->rx_copybreak && is_only_frag) {
-		mbuf = m_get2(len, M_NOWAIT, MT_DATA, M_PKTHDR);
+	copybreak = len <= rx->copybreak.thresh && is_only_frag;
+	SDT_PROBE3(gve, , rx, copybreak, rx, len, copybreak);
+	rx->copybreak.frags++;
+	if (copybreak) {
+		rx->copybreak.copies++;
+		if (len <= MHLEN)
+			mbuf = gve_rx_mbuf_cache_get(rx, M_NOWAIT);
+		else
+			mbuf = m_get2(len, M_NOWAIT, MT_DATA, M_PKTHDR);
 		if (__predict_false(mbuf == NULL))
 			return (NULL);
 
@@ -464,8 +796,14 @@ gve_rx_create_mbuf(struct gve_priv *priv, struct gve_rx_ring *rx,
 		ref_count = atomic_load_int(&page_info->page->ref_count);
 		can_flip = VPRC_WIRE_COUNT(ref_count) == 1;
 
+		/*
+		 * Failing a flip, the frag still goes up without a copy if a
+		 * spare page can take over the slot. Copying is the last resort.
+		 */
+		zero_copy = can_flip || gve_rx_spare_page_ready(rx);
+
 		if (mbuf_tail == NULL) {
-			if (can_flip)
+			if (zero_copy)
 				mbuf = m_gethdr(M_NOWAIT, MT_DATA);
 			else
 				mbuf = m_getcl(M_NOWAIT, MT_DATA, M_PKTHDR);
@@ -473,7 +811,7 @@ gve_rx_create_mbuf(struct gve_priv *priv, struct gve_rx_ring *rx,
 			ctx->mbuf_head = mbuf;
 			ctx->mbuf_tail = mbuf;
 		} else {
-			if (can_flip)
+			if (zero_copy)
 				mbuf = m_get(M_NOWAIT, MT_DATA);
 			else
 				mbuf = m_getcl(M_NOWAIT, MT_DATA, 0);
@@ -485,13 +823,16 @@ gve_rx_create_mbuf(struct gve_priv *priv, struct gve_rx_ring *rx,
 		if (__predict_false(mbuf == NULL))
 			return (NULL);
 
-		if (can_flip) {
+		if (zero_copy) {
 			MEXTADD(mbuf, va, len, gve_mextadd_free,
 			    page_info->page, page_info->page_address,
 			    0, EXT_NET_DRV);
 
 			counter_enter();
-			counter_u64_add_protected(rx->stats.rx_frag_flip_cnt, 1);
+			if (can_flip)
+				counter_u64_add_protected(rx->stats.rx_frag_flip_cnt, 1);
+			else
+				counter_u64_add_protected(rx->stats.rx_page_swap_cnt, 1);
 			counter_exit();
 
 			/*
@@ -500,9 +841,13 @@ gve_rx_create_mbuf(struct gve_priv *priv, struct gve_rx_ring *rx,
 			 */
 			vm_page_wire(page_info->page);
 
-			gve_rx_flip_buff(page_info, &data_slot->qpl_offset);
+			if (can_flip)
+				gve_rx_flip_buff(page_info, &data_slot->qpl_offset);
+			else
+				gve_rx_swap_page(rx, page_info, data_slot);
 		} else {
 			m_copyback(mbuf, 0, len, va);
+			rx->copybreak.starved++;
 			counter_enter();
 			counter_u64_add_protected(rx->stats.rx_frag_copy_cnt, 1);
 			counter_exit();
@@ -534,7 +879,7 @@ gve_rx(struct gve_priv *priv, struct gve_rx_ring *rx, struct gve_rx_desc *desc,
 	union gve_rx_data_slot *data_slot;
 	struct gve_rx_ctx *ctx = &rx->ctx;
 	struct mbuf *mbuf = NULL;
-	if_t ifp = priv->ifp;
+	pfil_head_t pfil;
 	bool do_if_input;
 	uint16_t len;
 
@@ -557,7 +902,7 @@ gve_rx(struct gve_priv *priv, struct gve_rx_ring *rx, struct gve_rx_desc *desc,
 
 	page_info = &rx->page_info[idx];
 	data_slot = &rx->data_ring[idx];
-	page_dma_handle = &(rx->com.qpl->dmas[idx]);
+	page_dma_handle = &(rx->com.qpl->dmas[page_info->page_idx]);
 
 	page_info->pad = is_first_frag ? GVE_RX_PAD : 0;
 	len = be16toh(desc->len) - page_info->pad;
@@ -565,6 +910,12 @@ gve_rx(struct gve_priv *priv, struct gve_rx_ring *rx, struct gve_rx_desc *desc,
 	bus_dmamap_sync(page_dma_handle->tag, page_dma_handle->map,
 	    BUS_DMASYNC_POSTREAD);
 
+	/* Leaving the data slot alone hands the page half back to the device */
+	if (is_only_frag && (pfil = gve_rx_pfil_hooked(priv)) != NULL &&
+	    gve_rx_pfil(rx, pfil, (char *)page_info->page_address +
+	    page_info->page_offset + page_info->pad, len))
+		goto finish_frag;
+
 	mbuf = gve_rx_create_mbuf(priv, rx, page_info, len, data_slot,
 	    is_only_frag);
 	if (mbuf == NULL) {
@@ -600,15 +951,20 @@ gve_rx(struct gve_priv *priv, struct gve_rx_ring *rx, struct gve_rx_desc *desc,
 		mbuf->m_pkthdr.len = ctx->total_size;
 		do_if_input = true;
 
+		if ((if_getcapenable(priv->ifp) & IFCAP_VLAN_HWTAGGING) != 0)
+			gve_rx_strip_vlan(mbuf);
+
 		if (((if_getcapenable(priv->ifp) & IFCAP_LRO) != 0) &&      /* LRO is enabled */
 		    (ctx->is_tcp) &&                      		    /* pkt is a TCP pkt */
 		    ((mbuf->m_pkthdr.csum_flags & CSUM_DATA_VALID) != 0) && /* NIC verified csum */
 		    (rx->lro.lro_cnt != 0) &&                               /* LRO resources exist */
-		    (tcp_lro_rx(&rx->lro, mbuf, 0) == 0))
+		    gve_rx_lro(rx, mbuf))
 			do_if_input = false;
 
+		SDT_PROBE4(gve, , rx, packet, rx, mbuf, ctx->frag_cnt + 1,
+		    ctx->total_size);
 		if (do_if_input)
-			if_input(ifp, mbuf);
+			gve_rx_input(rx, mbuf);
 
 		counter_enter();
 		counter_u64_add_protected(rx->stats.rbytes, ctx->total_size);
@@ -643,7 +999,67 @@ gve_next_seqno(uint8_t seq)
 	return ((seq + 1) == 8 ? 1 : seq + 1);
 }
 
-static void
+/*
+ * Hands a packet to LRO, returning false if the caller still has to input it.
+ * With an mbuf queue the packet is instead held until the end of the cleanup
+ * pass, when tcp_lro_flush_all sorts the queue by flow and aggregates it.
+ */
+bool
+gve_rx_lro(struct gve_rx_ring *rx, struct mbuf *mbuf)
+{
+	if (rx->lro.lro_mbuf_max != 0) {
+		tcp_lro_queue_mbuf(&rx->lro, mbuf);
+		return (true);
+	}
+	return (tcp_lro_rx(&rx->lro, mbuf, 0) == 0);
+}
+
+/* Queues a packet for the if_input call that ends the cleanup pass. */
+void
+gve_rx_input(struct gve_rx_ring *rx, struct mbuf *mbuf)
+{
+	mbuf->m_nextpkt = NULL;
+	if (rx->input_head == NULL)
+		rx->input_head = mbuf;
+	else
+		rx->input_tail->m_nextpkt = mbuf;
+	rx->input_tail = mbuf;
+	rx->input_cnt++;
+}
+
+/* Hands the packets queued by gve_rx_input to the stack in one call. */
+void
+gve_rx_input_flush(struct gve_rx_ring *rx)
+{
+	int bucket;
+
+	if (rx->input_head == NULL)
+		return;
+
+	bucket = MIN(fls(rx->input_cnt) - 1, GVE_RX_INPUT_BATCH_BUCKETS - 1);
+	counter_u64_add(rx->stats.rx_input_batch[bucket], 1);
+
+	if_input(rx->com.priv->ifp, rx->input_head);
+	rx->input_head = NULL;
+	rx->input_tail = NULL;
+	rx->input_cnt = 0;
+}
+
+/* Spins for new descs while busy-polling, returning true if any showed up. */
+static bool
+gve_rx_busy_poll(struct gve_rx_ring *rx)
+{
+	sbintime_t deadline = 0;
+
+	while (gve_busy_poll_spin(&rx->com, &deadline)) {
+		if (gve_rx_work_pending(rx))
+			return (true);
+	}
+	return (false);
+}
+
+/* Returns the number of descs handled. */
+static uint32_t
 gve_rx_cleanup(struct gve_priv *priv, struct gve_rx_ring *rx, int budget)
 {
 	uint32_t idx = rx->cnt & rx->mask;
@@ -679,6 +1095,7 @@ gve_rx_cleanup(struct gve_priv *priv, struct gve_rx_ring *rx, int budget)
 		gve_schedule_reset(priv);
 	}
 
+	gve_rx_input_flush(rx);
 	if (work_done != 0)
 		tcp_lro_flush_all(&rx->lro);
 
@@ -687,7 +1104,12 @@ gve_rx_cleanup(struct gve_priv *priv, struct gve_rx_ring *rx, int budget)
 
 	/* Buffers are refilled as the descs are processed */
 	rx->fill_cnt += work_done;
+	SDT_PROBE2(gve, , rx, doorbell, rx, rx->fill_cnt);
 	gve_db_bar_write_4(priv, rx->com.db_offset, rx->fill_cnt);
+
+	gve_rx_mbuf_cache_refill(rx, M_NOWAIT);
+	gve_rx_copybreak_adapt(rx);
+	return (work_done);
 }
 
 void
@@ -695,11 +1117,45 @@ gve_rx_cleanup_tq(void *arg, int pending)
 {
 	struct gve_rx_ring *rx = arg;
 	struct gve_priv *priv = rx->com.priv;
+	uint32_t work_done;
+	uint32_t usecs;
 
 	if (__predict_false((if_getdrvflags(priv->ifp) & IFF_DRV_RUNNING) == 0))
 		return;
 
-	gve_rx_cleanup(priv, rx, /*budget=*/128);
+#ifdef GVE_HISTOGRAMS
+	gve_hist_intr_delay(&rx->com, rx->stats.rx_intr_delay_us);
+#endif
+
+#ifdef DEV_NETMAP
+	if (gve_netmap_rx_irq(rx)) {
+		gve_db_bar_write_4(priv, rx->com.irq_db_offset,
+		    GVE_IRQ_ACK | GVE_IRQ_EVENT);
+		atomic_thread_fence_seq_cst();
+		/* Descs that raced the ack will not interrupt, so poke again */
+		if (gve_rx_work_pending(rx))
+			gve_netmap_rx_irq(rx);
+		return;
+	}
+#endif
+
+	work_done = gve_rx_cleanup(priv, rx, /*budget=*/128);
+#ifdef GVE_HISTOGRAMS
+	gve_hist_add(rx->stats.rx_cleanup_work, work_done);
+#endif
+
+	if (gve_rx_busy_poll(rx)) {
+		taskqueue_enqueue(rx->com.cleanup_tq, &rx->com.cleanup_task);
+		return;
+	}
+
+	usecs = gve_itr_rearm_usecs(&rx->com, work_done, rx->stats.rpackets,
+	    rx->stats.rbytes);
+	if (work_done != 0 && usecs != 0) {
+		/* Leave the irq masked and batch whatever arrives meanwhile */
+		gve_itr_schedule_poll(&rx->com, usecs);
+		return;
+	}
 
 	gve_db_bar_write_4(priv, rx->com.irq_db_offset,
 	    GVE_IRQ_ACK | GVE_IRQ_EVENT);
@@ -716,3 +1172,134 @@ gve_rx_cleanup_tq(void *arg, int pending)
 		taskqueue_enqueue(rx->com.cleanup_tq, &rx->com.cleanup_task);
 	}
 }
+
+#ifdef DEV_NETMAP
+/*
+ * Returns the number of descs making up the packet starting at rx->cnt, or 0
+ * if the device has not finished writing all of them yet.
+ */
+static uint32_t
+gve_rx_peek_pkt_frags(struct gve_priv *priv, struct gve_rx_ring *rx)
+{
+	struct gve_rx_desc *desc;
+	uint8_t seq_no = rx->seq_no;
+	uint32_t cnt = rx->cnt;
+	uint32_t frags = 0;
+
+	while (frags < priv->rx_desc_cnt) {
+		desc = &rx->desc_ring[cnt & rx->mask];
+		if (GVE_SEQNO(desc->flags_seq) != seq_no)
+			return (0);
+		frags++;
+		if ((desc->flags_seq & GVE_RXF_PKT_CONT) == 0)
+			return (frags);
+		cnt++;
+		seq_no = gve_next_seqno(seq_no);
+	}
+
+	return (0);
+}
+
+int
+gve_netmap_rxsync_gqi(struct netmap_kring *kring, int flags)
+{
+	struct netmap_adapter *na = kring->na;
+	struct netmap_ring *ring = kring->ring;
+	struct gve_priv *priv = if_getsoftc(na->ifp);
+	struct gve_rx_ring *rx = &priv->rx[kring->ring_id];
+	struct gve_rx_slot_page_info *page_info;
+	struct gve_dma_handle *page_dma_handle;
+	struct gve_rx_desc *desc;
+	struct netmap_slot *slot;
+	u_int lim = kring->nkr_num_slots - 1;
+	u_int const head = kring->rhead;
+	u_int nm_i, pkt_start, room;
+	uint64_t rbytes = 0, rpackets = 0;
+	uint32_t frags, filled = 0;
+	uint32_t idx, len, i;
+	bool drop;
+
+	if (head > lim)
+		return (netmap_ring_reinit(kring));
+
+	if (netmap_no_pendintr || (flags & NAF_FORCE_READ) != 0 ||
+	    (kring->nr_kflags & NKR_PENDINTR) != 0) {
+		bus_dmamap_sync(rx->desc_ring_mem.tag, rx->desc_ring_mem.map,
+		    BUS_DMASYNC_POSTREAD);
+
+		nm_i = kring->nr_hwtail;
+		for (;;) {
+			/* One slot is kept empty to tell a full ring from an empty one */
+			room = (kring->nr_hwcur + lim - nm_i) % kring->nkr_num_slots;
+			frags = gve_rx_peek_pkt_frags(priv, rx);
+			if (frags == 0 || frags > room)
+				break;
+
+			pkt_start = nm_i;
+			drop = false;
+			len = 0;
+			for (i = 0; i < frags; i++) {
+				idx = rx->cnt & rx->mask;
+				desc = &rx->desc_ring[idx];
+				page_info = &rx->page_info[idx];
+				page_dma_handle =
+				    &(rx->com.qpl->dmas[page_info->page_idx]);
+				slot = &ring->slot[nm_i];
+
+				if ((desc->flags_seq & GVE_RXF_ERR) != 0)
+					drop = true;
+
+				/*
+				 * The data is copied out, so the same half of the
+				 * page can be handed straight back to the device.
+				 */
+				page_info->pad = (i == 0) ? GVE_RX_PAD : 0;
+				slot->len = be16toh(desc->len) - page_info->pad;
+				slot->flags = (i == frags - 1) ? 0 : NS_MOREFRAG;
+				bus_dmamap_sync(page_dma_handle->tag,
+				    page_dma_handle->map, BUS_DMASYNC_POSTREAD);
+				memcpy(NMB(na, slot), (char *)page_info->page_address +
+				    page_info->page_offset + page_info->pad, slot->len);
+				len += slot->len;
+
+				rx->cnt++;
+				rx->seq_no = gve_next_seqno(rx->seq_no);
+				nm_i = nm_next(nm_i, lim);
+			}
+			filled += frags;
+
+			if (__predict_false(drop)) {
+				nm_i = pkt_start;
+				counter_enter();
+				counter_u64_add_protected(
+				    rx->stats.rx_dropped_pkt_desc_err, 1);
+				counter_u64_add_protected(rx->stats.rx_dropped_pkt, 1);
+				counter_exit();
+				continue;
+			}
+
+			rbytes += len;
+			rpackets++;
+		}
+
+		if (filled != 0) {
+			rx->fill_cnt += filled;
+			gve_db_bar_write_4(priv, rx->com.db_offset, rx->fill_cnt);
+			kring->nr_hwtail = nm_i;
+		}
+		kring->nr_kflags &= ~NKR_PENDINTR;
+	}
+
+	/* Slots are only ever copied into, so returning them is free. */
+	kring->nr_hwcur = head;
+
+	if (rpackets != 0) {
+		counter_enter();
+		counter_u64_add_protected(rx->stats.rbytes, rbytes);
+		counter_u64_add_protected(rx->stats.rpackets, rpackets);
+		counter_exit();
+	}
+
+	return (0);
+}
+#endif
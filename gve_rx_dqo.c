@@ -28,6 +28,8 @@
  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#include "opt_netmap.h"
+
 #include "gve.h"
 #include "gve_adminq.h"
 #include "gve_dqo.h"
@@ -71,6 +73,11 @@ gve_rx_free_ring_dqo(struct gve_priv *priv, int i)
 		rx->dqo.desc_ring = NULL;
 	}
 
+	if (rx->dqo.hdr_bufs != NULL) {
+		gve_dma_free_coherent(&rx->dqo.hdr_bufs_mem);
+		rx->dqo.hdr_bufs = NULL;
+	}
+
 	if (rx->dqo.bufs != NULL) {
 		gve_free_rx_mbufs_dqo(rx);
 
@@ -85,6 +92,16 @@ gve_rx_free_ring_dqo(struct gve_priv *priv, int i)
 		rx->dqo.bufs = NULL;
 	}
 
+	if (rx->dqo.pool_bufs != NULL) {
+		free(rx->dqo.pool_bufs, M_GVE);
+		rx->dqo.pool_bufs = NULL;
+	}
+
+	if (rx->dqo.page_pool != NULL) {
+		gve_free_page_pool(rx->dqo.page_pool);
+		rx->dqo.page_pool = NULL;
+	}
+
 	if (!gve_is_qpl(priv) && rx->dqo.buf_dmatag)
 		bus_dma_tag_destroy(rx->dqo.buf_dmatag);
 
@@ -123,6 +140,18 @@ gve_rx_alloc_ring_dqo(struct gve_priv *priv, int i)
 	rx->dqo.compl_ring = rx->dqo.compl_ring_mem.cpu_addr;
 	rx->dqo.mask = priv->rx_desc_cnt - 1;
 
+	if (priv->header_split_enabled) {
+		err = gve_dma_alloc_coherent(priv,
+		    priv->header_buf_size * priv->rx_desc_cnt,
+		    CACHE_LINE_SIZE, &rx->dqo.hdr_bufs_mem);
+		if (err != 0) {
+			device_printf(priv->dev,
+			    "Failed to alloc header buffers for rx ring %d", i);
+			goto abort;
+		}
+		rx->dqo.hdr_bufs = rx->dqo.hdr_bufs_mem.cpu_addr;
+	}
+
 	rx->dqo.buf_cnt = gve_is_qpl(priv) ? GVE_RX_NUM_QPL_PAGES_DQO :
 	    priv->rx_desc_cnt;
 	rx->dqo.bufs = malloc(rx->dqo.buf_cnt * sizeof(struct gve_rx_buf_dqo),
@@ -172,6 +201,21 @@ gve_rx_alloc_ring_dqo(struct gve_priv *priv, int i)
 		rx->dqo.bufs[j].mapped = true;
 	}
 
+	if (gve_rx_page_pool) {
+		rx->dqo.pool_buf_cnt = MIN(priv->rx_desc_cnt,
+		    GVE_RX_MAX_POOL_PAGES_DQO);
+		rx->dqo.page_pool = gve_alloc_page_pool(priv,
+		    i + priv->tx_cfg.max_queues, rx->dqo.pool_buf_cnt);
+		if (rx->dqo.page_pool == NULL) {
+			device_printf(priv->dev,
+			    "Failed to alloc page pool for rx ring %d", i);
+			err = ENOMEM;
+			goto abort;
+		}
+		rx->dqo.pool_bufs = malloc(rx->dqo.pool_buf_cnt *
+		    sizeof(struct gve_rx_buf_dqo), M_GVE, M_WAITOK | M_ZERO);
+	}
+
 	return (0);
 
 abort:
@@ -179,6 +223,32 @@ abort:
 	return (err);
 }
 
+/*
+ * Page bufs are backed by the ring's qpl in QPL mode and by its page pool in
+ * RDA mode. These find the page list, the bufs and the free list in use.
+ */
+static struct gve_queue_page_list *
+gve_rx_page_list_dqo(struct gve_rx_ring *rx)
+{
+	return (gve_is_qpl(rx->com.priv) ? rx->com.qpl : rx->dqo.page_pool);
+}
+
+static int
+gve_rx_page_idx_dqo(struct gve_rx_ring *rx, struct gve_rx_buf_dqo *buf)
+{
+	if (gve_is_qpl(rx->com.priv))
+		return (buf - rx->dqo.bufs);
+	return (buf - rx->dqo.pool_bufs);
+}
+
+static struct gve_rx_buf_list_dqo *
+gve_rx_page_free_bufs_dqo(struct gve_rx_ring *rx)
+{
+	if (gve_is_qpl(rx->com.priv))
+		return (&rx->dqo.free_bufs);
+	return (&rx->dqo.pool_free_bufs);
+}
+
 static void
 gve_rx_clear_desc_ring_dqo(struct gve_rx_ring *rx)
 {
@@ -207,6 +277,38 @@ gve_rx_clear_compl_ring_dqo(struct gve_rx_ring *rx)
 	    BUS_DMASYNC_PREWRITE);
 }
 
+static void
+gve_rx_init_page_bufs_dqo(struct gve_rx_ring *rx, struct gve_rx_buf_dqo *bufs,
+    int buf_cnt)
+{
+	struct gve_queue_page_list *qpl = gve_rx_page_list_dqo(rx);
+	struct gve_rx_buf_list_dqo *free_bufs = gve_rx_page_free_bufs_dqo(rx);
+	int j;
+
+	SLIST_INIT(free_bufs);
+	STAILQ_INIT(&rx->dqo.used_bufs);
+
+	for (j = 0; j < buf_cnt; j++) {
+		struct gve_rx_buf_dqo *buf = &bufs[j];
+
+		vm_page_t page = qpl->pages[j];
+		u_int ref_count = atomic_load_int(&page->ref_count);
+
+		/*
+		 * An ifconfig down+up might see pages still in flight
+		 * from the previous innings.
+		 */
+		if (VPRC_WIRE_COUNT(ref_count) == 1)
+			SLIST_INSERT_HEAD(free_bufs, buf, slist_entry);
+		else
+			STAILQ_INSERT_TAIL(&rx->dqo.used_bufs,
+			    buf, stailq_entry);
+
+		buf->num_nic_frags = 0;
+		buf->next_idx = 0;
+	}
+}
+
 void
 gve_clear_rx_ring_dqo(struct gve_priv *priv, int i)
 {
@@ -226,34 +328,15 @@ gve_clear_rx_ring_dqo(struct gve_priv *priv, int i)
 	gve_free_rx_mbufs_dqo(rx);
 
 	if (gve_is_qpl(priv)) {
-		SLIST_INIT(&rx->dqo.free_bufs);
-		STAILQ_INIT(&rx->dqo.used_bufs);
-
-		for (j = 0; j < rx->dqo.buf_cnt; j++) {
-			struct gve_rx_buf_dqo *buf = &rx->dqo.bufs[j];
-
-			vm_page_t page = rx->com.qpl->pages[buf - rx->dqo.bufs];
-			u_int ref_count = atomic_load_int(&page->ref_count);
-
-			/*
-			 * An ifconfig down+up might see pages still in flight
-			 * from the previous innings.
-			 */
-			if (VPRC_WIRE_COUNT(ref_count) == 1)
-				SLIST_INSERT_HEAD(&rx->dqo.free_bufs,
-				    buf, slist_entry);
-			else
-				STAILQ_INSERT_TAIL(&rx->dqo.used_bufs,
-				    buf, stailq_entry);
-
-			buf->num_nic_frags = 0;
-			buf->next_idx = 0;
-		}
+		gve_rx_init_page_bufs_dqo(rx, rx->dqo.bufs, rx->dqo.buf_cnt);
 	} else {
 		SLIST_INIT(&rx->dqo.free_bufs);
 		for (j = 0; j < rx->dqo.buf_cnt; j++)
 			SLIST_INSERT_HEAD(&rx->dqo.free_bufs,
 			    &rx->dqo.bufs[j], slist_entry);
+		if (rx->dqo.page_pool != NULL)
+			gve_rx_init_page_bufs_dqo(rx, rx->dqo.pool_bufs,
+			    rx->dqo.pool_buf_cnt);
 	}
 }
 
@@ -268,6 +351,9 @@ gve_rx_intr_dqo(void *arg)
 		return (FILTER_STRAY);
 
 	/* Interrupts are automatically masked */
+#ifdef GVE_HISTOGRAMS
+	com->intr_time = sbinuptime();
+#endif
 	taskqueue_enqueue(com->cleanup_tq, &com->cleanup_task);
 	return (FILTER_HANDLED);
 }
@@ -275,12 +361,18 @@ gve_rx_intr_dqo(void *arg)
 static void
 gve_rx_advance_head_dqo(struct gve_rx_ring *rx)
 {
+	if (rx->dqo.hdr_bufs != NULL)
+		rx->dqo.desc_ring[rx->dqo.head].header_buf_addr =
+		    htole64(rx->dqo.hdr_bufs_mem.bus_addr +
+		    rx->dqo.head * rx->com.priv->header_buf_size);
+
 	rx->dqo.head = (rx->dqo.head + 1) & rx->dqo.mask;
 	rx->fill_cnt++; /* rx->fill_cnt is just a sysctl counter */
 
 	if ((rx->dqo.head & (GVE_RX_BUF_THRESH_DQO - 1)) == 0) {
 		bus_dmamap_sync(rx->desc_ring_mem.tag, rx->desc_ring_mem.map,
 		    BUS_DMASYNC_PREWRITE);
+		SDT_PROBE2(gve, , rx, doorbell, rx, rx->dqo.head);
 		gve_db_bar_dqo_write_4(rx->com.priv, rx->com.db_offset,
 		    rx->dqo.head);
 	}
@@ -317,7 +409,7 @@ gve_rx_post_new_mbuf_dqo(struct gve_rx_ring *rx, int how)
 	}
 	SLIST_REMOVE_HEAD(&rx->dqo.free_bufs, slist_entry);
 
-	buf->mbuf = m_getcl(how, MT_DATA, M_PKTHDR);
+	buf->mbuf = gve_rx_mbuf_cache_get(rx, how);
 	if (__predict_false(!buf->mbuf)) {
 		err = ENOMEM;
 		counter_enter();
@@ -352,7 +444,34 @@ abort_with_buf:
 static struct gve_dma_handle *
 gve_get_page_dma_handle(struct gve_rx_ring *rx, struct gve_rx_buf_dqo *buf)
 {
-	return (&(rx->com.qpl->dmas[buf - rx->dqo.bufs]));
+	return (&(gve_rx_page_list_dqo(rx)->dmas[gve_rx_page_idx_dqo(rx, buf)]));
+}
+
+/*
+ * Decodes the page buf and frag a completion is for, returning NULL if the
+ * buf_id is out of range.
+ */
+static struct gve_rx_buf_dqo *
+gve_rx_page_buf_dqo(struct gve_rx_ring *rx,
+    struct gve_rx_compl_desc_dqo *compl_desc, uint8_t *buf_frag_num)
+{
+	union gve_rx_qpl_buf_id_dqo composed_id;
+	uint16_t buf_id;
+
+	if (gve_is_qpl(rx->com.priv)) {
+		composed_id.all = le16toh(compl_desc->buf_id);
+		*buf_frag_num = composed_id.frag_num;
+		if (__predict_false(composed_id.buf_id >= rx->dqo.buf_cnt))
+			return (NULL);
+		return (&rx->dqo.bufs[composed_id.buf_id]);
+	}
+
+	buf_id = le16toh(compl_desc->buf_id) & ~GVE_RX_POOL_BUF_ID_DQO;
+	*buf_frag_num = buf_id % GVE_DQ_NUM_FRAGS_IN_PAGE;
+	buf_id /= GVE_DQ_NUM_FRAGS_IN_PAGE;
+	if (__predict_false(buf_id >= rx->dqo.pool_buf_cnt))
+		return (NULL);
+	return (&rx->dqo.pool_bufs[buf_id]);
 }
 
 static void
@@ -363,9 +482,15 @@ gve_rx_post_qpl_buf_dqo(struct gve_rx_ring *rx, struct gve_rx_buf_dqo *buf,
 	union gve_rx_qpl_buf_id_dqo composed_id;
 	struct gve_dma_handle *page_dma_handle;
 
-	composed_id.buf_id = buf - rx->dqo.bufs;
-	composed_id.frag_num = frag_num;
-	desc->buf_id = htole16(composed_id.all);
+	if (gve_is_qpl(rx->com.priv)) {
+		composed_id.buf_id = buf - rx->dqo.bufs;
+		composed_id.frag_num = frag_num;
+		desc->buf_id = htole16(composed_id.all);
+	} else {
+		desc->buf_id = htole16(GVE_RX_POOL_BUF_ID_DQO |
+		    (gve_rx_page_idx_dqo(rx, buf) * GVE_DQ_NUM_FRAGS_IN_PAGE +
+		    frag_num));
+	}
 
 	page_dma_handle = gve_get_page_dma_handle(rx, buf);
 	bus_dmamap_sync(page_dma_handle->tag, page_dma_handle->map,
@@ -390,7 +515,7 @@ gve_rx_maybe_extract_from_used_bufs(struct gve_rx_ring *rx, bool just_one)
 		if (__predict_false(buf == NULL))
 			break;
 
-		page = rx->com.qpl->pages[buf - rx->dqo.bufs];
+		page = gve_rx_page_list_dqo(rx)->pages[gve_rx_page_idx_dqo(rx, buf)];
 		ref_count = atomic_load_int(&page->ref_count);
 
 		if (VPRC_WIRE_COUNT(ref_count) != 1) {
@@ -405,7 +530,7 @@ gve_rx_maybe_extract_from_used_bufs(struct gve_rx_ring *rx, bool just_one)
 
 		STAILQ_REMOVE_HEAD(&rx->dqo.used_bufs,
 		    stailq_entry);
-		SLIST_INSERT_HEAD(&rx->dqo.free_bufs,
+		SLIST_INSERT_HEAD(gve_rx_page_free_bufs_dqo(rx),
 		    buf, slist_entry);
 		if (just_one)
 			break;
@@ -416,15 +541,17 @@ gve_rx_maybe_extract_from_used_bufs(struct gve_rx_ring *rx, bool just_one)
 		    hol_blocker, stailq_entry);
 }
 
+/* Posts the next frag of a free page buf, see gve_rx_page_list_dqo. */
 static int
 gve_rx_post_new_dqo_qpl_buf(struct gve_rx_ring *rx)
 {
+	struct gve_rx_buf_list_dqo *free_bufs = gve_rx_page_free_bufs_dqo(rx);
 	struct gve_rx_buf_dqo *buf;
 
-	buf = SLIST_FIRST(&rx->dqo.free_bufs);
+	buf = SLIST_FIRST(free_bufs);
 	if (__predict_false(buf == NULL)) {
 		gve_rx_maybe_extract_from_used_bufs(rx, /*just_one=*/true);
-		buf = SLIST_FIRST(&rx->dqo.free_bufs);
+		buf = SLIST_FIRST(free_bufs);
 		if (__predict_false(buf == NULL))
 			return (ENOBUFS);
 	}
@@ -442,10 +569,34 @@ gve_rx_post_new_dqo_qpl_buf(struct gve_rx_ring *rx)
 	 *   when its wire count drops back to 1.
 	 */
 	if (buf->next_idx == 0)
-		SLIST_REMOVE_HEAD(&rx->dqo.free_bufs, slist_entry);
+		SLIST_REMOVE_HEAD(free_bufs, slist_entry);
 	return (0);
 }
 
+/*
+ * RDA buffers come from the page pool while it has a free page, and are
+ * freshly mapped cluster mbufs once the stack holds on to all of them.
+ */
+static int
+gve_rx_post_new_rda_buf_dqo(struct gve_rx_ring *rx, int how)
+{
+	int err;
+
+	if (rx->dqo.page_pool != NULL) {
+		err = gve_rx_post_new_dqo_qpl_buf(rx);
+		counter_enter();
+		if (err == 0)
+			counter_u64_add_protected(rx->stats.rx_pool_hit, 1);
+		else
+			counter_u64_add_protected(rx->stats.rx_pool_fallback, 1);
+		counter_exit();
+		if (err == 0)
+			return (0);
+	}
+
+	return (gve_rx_post_new_mbuf_dqo(rx, how));
+}
+
 static void
 gve_rx_post_buffers_dqo(struct gve_rx_ring *rx, int how)
 {
@@ -461,9 +612,12 @@ gve_rx_post_buffers_dqo(struct gve_rx_ring *rx, int how)
 		if (gve_is_qpl(rx->com.priv))
 			err = gve_rx_post_new_dqo_qpl_buf(rx);
 		else
-			err = gve_rx_post_new_mbuf_dqo(rx, how);
-		if (err)
+			err = gve_rx_post_new_rda_buf_dqo(rx, how);
+		if (err) {
+			SDT_PROBE3(gve, , rx, post__fail, rx, err,
+			    num_pending_bufs + i);
 			break;
+		}
 	}
 }
 
@@ -546,6 +700,35 @@ gve_rx_set_csum_flags_dqo(struct mbuf *mbuf,
 	}
 }
 
+/*
+ * Extends the 32 bit NIC clock stamp of the completion around the last clock
+ * sync, and hands it up as real time for SO_TIMESTAMP. The slot is copied and
+ * the generation checked again, so a copy that raced with the nic_ts task
+ * rewriting the slot is never used.
+ */
+static void
+gve_rx_set_tstmp_dqo(struct gve_priv *priv, struct mbuf *mbuf,
+    struct gve_rx_compl_desc_dqo *compl_desc)
+{
+	struct gve_nic_ts_sync sync;
+	uint32_t gen;
+	int32_t delta;
+
+	if ((compl_desc->ts_sub_nsecs_low & GVE_DQO_RX_HWTSTAMP_VALID) == 0)
+		return;
+	do {
+		gen = atomic_load_acq_32(&priv->nic_ts_gen);
+		if (__predict_false(gen == 0))
+			return;
+		sync = priv->nic_ts_sync[gen & 1];
+		atomic_thread_fence_acq();
+	} while (__predict_false(atomic_load_32(&priv->nic_ts_gen) != gen));
+
+	delta = le32toh(compl_desc->ts) - (uint32_t)sync.nic_ns;
+	mbuf->m_pkthdr.rcv_tstmp = sync.real_ns + delta;
+	mbuf->m_flags |= M_TSTMP | M_TSTMP_HPREC;
+}
+
 static void
 gve_rx_input_mbuf_dqo(struct gve_rx_ring *rx,
     struct gve_rx_compl_desc_dqo *compl_desc)
@@ -564,14 +747,22 @@ gve_rx_input_mbuf_dqo(struct gve_rx_ring *rx,
 	mbuf->m_pkthdr.rcvif = ifp;
 	mbuf->m_pkthdr.len = rx->ctx.total_size;
 
+	if ((if_getcapenable(ifp) & IFCAP_HWRXTSTMP) != 0)
+		gve_rx_set_tstmp_dqo(rx->com.priv, mbuf, compl_desc);
+
+	if ((if_getcapenable(ifp) & IFCAP_VLAN_HWTAGGING) != 0)
+		gve_rx_strip_vlan(mbuf);
+
 	if (((if_getcapenable(rx->com.priv->ifp) & IFCAP_LRO) != 0) &&
 	    is_tcp &&
 	    (rx->lro.lro_cnt != 0) &&
-	    (tcp_lro_rx(&rx->lro, mbuf, 0) == 0))
+	    gve_rx_lro(rx, mbuf))
 		do_if_input = false;
 
+	SDT_PROBE4(gve, , rx, packet, rx, mbuf, rx->ctx.frag_cnt,
+	    rx->ctx.total_size);
 	if (do_if_input)
-		if_input(ifp, mbuf);
+		gve_rx_input(rx, mbuf);
 
 	counter_enter();
 	counter_u64_add_protected(rx->stats.rbytes, rx->ctx.total_size);
@@ -606,6 +797,76 @@ gve_rx_copybreak_dqo(struct gve_rx_ring *rx, void *va,
 	return (0);
 }
 
+/*
+ * Starts the packet with an mbuf holding the headers the device split off
+ * into the header buffer of this completion's slot. A packet the device did
+ * not split arrives whole in the payload buffer and is left alone.
+ */
+static int
+gve_rx_hsplit_dqo(struct gve_rx_ring *rx,
+    struct gve_rx_compl_desc_dqo *compl_desc)
+{
+	struct gve_priv *priv = rx->com.priv;
+	uint16_t hdr_len = compl_desc->header_len;
+	struct mbuf *mbuf;
+	bool unsplit;
+	uint8_t *va;
+
+	unsplit = !compl_desc->split_header || hdr_len == 0 ||
+	    compl_desc->header_buffer_overflow;
+
+	counter_enter();
+	counter_u64_add_protected(rx->stats.rx_hsplit_pkt, 1);
+	if (unsplit)
+		counter_u64_add_protected(rx->stats.rx_hsplit_unsplit_pkt, 1);
+	else
+		counter_u64_add_protected(rx->stats.rx_hsplit_bytes, hdr_len);
+	counter_exit();
+
+	if (unsplit)
+		return (0);
+
+	if (__predict_false(hdr_len > priv->header_buf_size))
+		return (EINVAL);
+
+	mbuf = m_get2(hdr_len, M_NOWAIT, MT_DATA, M_PKTHDR);
+	if (__predict_false(mbuf == NULL))
+		return (ENOMEM);
+
+	bus_dmamap_sync(rx->dqo.hdr_bufs_mem.tag, rx->dqo.hdr_bufs_mem.map,
+	    BUS_DMASYNC_POSTREAD);
+	va = rx->dqo.hdr_bufs +
+	    (compl_desc - rx->dqo.compl_ring) * priv->header_buf_size;
+	memcpy(mtod(mbuf, char *), va, hdr_len);
+	mbuf->m_len = hdr_len;
+
+	rx->ctx.mbuf_head = mbuf;
+	rx->ctx.mbuf_tail = mbuf;
+	rx->ctx.total_size += hdr_len;
+	return (0);
+}
+
+/*
+ * Copies a short last payload in behind the split headers, which also covers
+ * packets the header buffer held entirely. Returns false if it does not fit.
+ */
+static bool
+gve_rx_append_to_hdr_dqo(struct gve_rx_ring *rx, void *va, uint16_t frag_len)
+{
+	struct gve_rx_ctx *ctx = &rx->ctx;
+
+	if (rx->dqo.hdr_bufs == NULL || ctx->mbuf_head == NULL ||
+	    ctx->mbuf_head != ctx->mbuf_tail ||
+	    frag_len > M_TRAILINGSPACE(ctx->mbuf_tail))
+		return (false);
+
+	memcpy(mtod(ctx->mbuf_tail, char *) + ctx->mbuf_tail->m_len, va,
+	    frag_len);
+	ctx->mbuf_tail->m_len += frag_len;
+	ctx->total_size += frag_len;
+	return (true);
+}
+
 static void
 gve_rx_dqo(struct gve_priv *priv, struct gve_rx_ring *rx,
     struct gve_rx_compl_desc_dqo *compl_desc,
@@ -615,7 +876,9 @@ gve_rx_dqo(struct gve_priv *priv, struct gve_rx_ring *rx,
 	struct gve_rx_ctx *ctx = &rx->ctx;
 	struct gve_rx_buf_dqo *buf;
 	uint32_t num_pending_bufs;
+	pfil_head_t pfil;
 	uint16_t frag_len;
+	bool copybreak;
 	uint16_t buf_id;
 	int err;
 
@@ -634,6 +897,7 @@ gve_rx_dqo(struct gve_priv *priv, struct gve_rx_ring *rx,
 		goto drop_frag_clear_ctx;
 	}
 
+	ctx->frag_cnt++;
 	if (__predict_false(ctx->drop_pkt))
 		goto drop_frag;
 
@@ -647,8 +911,37 @@ gve_rx_dqo(struct gve_priv *priv, struct gve_rx_ring *rx,
 	bus_dmamap_sync(rx->dqo.buf_dmatag, buf->dmamap,
 	    BUS_DMASYNC_POSTREAD);
 
+	if (rx->dqo.hdr_bufs != NULL && ctx->mbuf_head == NULL) {
+		err = gve_rx_hsplit_dqo(rx, compl_desc);
+		if (__predict_false(err != 0)) {
+			counter_enter();
+			if (err == ENOMEM)
+				counter_u64_add_protected(
+				    rx->stats.rx_dropped_pkt_mbuf_alloc_fail, 1);
+			else
+				counter_u64_add_protected(
+				    rx->stats.rx_dropped_pkt_desc_err, 1);
+			counter_exit();
+			goto drop_frag;
+		}
+	}
+
 	frag_len = compl_desc->packet_len;
-	if (frag_len <= priv->rx_copybreak && !ctx->mbuf_head && is_last_frag) {
+	if (ctx->mbuf_head == NULL && is_last_frag &&
+	    (pfil = gve_rx_pfil_hooked(priv)) != NULL &&
+	    gve_rx_pfil(rx, pfil, mtod(buf->mbuf, char *), frag_len)) {
+		rx->ctx = (struct gve_rx_ctx){};
+		(*work_done)++;
+		gve_rx_post_buf_dqo(rx, buf);
+		return;
+	}
+
+	copybreak = frag_len <= rx->copybreak.thresh && !ctx->mbuf_head &&
+	    is_last_frag;
+	SDT_PROBE3(gve, , rx, copybreak, rx, frag_len, copybreak);
+	rx->copybreak.frags++;
+	if (copybreak) {
+		rx->copybreak.copies++;
 		err = gve_rx_copybreak_dqo(rx, mtod(buf->mbuf, char*),
 		    compl_desc, frag_len);
 		if (__predict_false(err != 0))
@@ -658,6 +951,14 @@ gve_rx_dqo(struct gve_priv *priv, struct gve_rx_ring *rx,
 		return;
 	}
 
+	if (is_last_frag &&
+	    gve_rx_append_to_hdr_dqo(rx, mtod(buf->mbuf, char *), frag_len)) {
+		gve_rx_post_buf_dqo(rx, buf);
+		gve_rx_input_mbuf_dqo(rx, compl_desc);
+		(*work_done)++;
+		return;
+	}
+
 	/*
 	 * Although buffer completions may arrive out of order, buffer
 	 * descriptors are consumed by the NIC in order. That is, the
@@ -678,7 +979,11 @@ gve_rx_dqo(struct gve_priv *priv, struct gve_rx_ring *rx,
 	 * put packets in, we run the risk of getting the queue stuck
 	 * for good.
 	 */
-	err = gve_rx_post_new_mbuf_dqo(rx, M_NOWAIT);
+	err = gve_rx_post_new_rda_buf_dqo(rx, M_NOWAIT);
+	if (__predict_false(err != 0)) {
+		SDT_PROBE3(gve, , rx, post__fail, rx, err, num_pending_bufs);
+		rx->copybreak.starved++;
+	}
 	if (__predict_false(err != 0 &&
 	    num_pending_bufs <= GVE_RX_DQO_MIN_PENDING_BUFS)) {
 		counter_enter();
@@ -739,8 +1044,8 @@ static void *
 gve_get_cpu_addr_for_qpl_buf(struct gve_rx_ring *rx,
     struct gve_rx_buf_dqo *buf, uint8_t buf_frag_num)
 {
-	int page_idx = buf - rx->dqo.bufs;
-	void *va = rx->com.qpl->dmas[page_idx].cpu_addr;
+	int page_idx = gve_rx_page_idx_dqo(rx, buf);
+	void *va = gve_rx_page_list_dqo(rx)->dmas[page_idx].cpu_addr;
 
 	va = (char *)va + (buf_frag_num * GVE_DEFAULT_RX_BUFFER_SIZE);
 	return (va);
@@ -806,9 +1111,9 @@ gve_rx_add_extmbuf_to_ctx(struct gve_rx_ring *rx,
 	mbuf->m_len = frag_len;
 	ctx->total_size += frag_len;
 
-	page_idx = buf - rx->dqo.bufs;
-	page = rx->com.qpl->pages[page_idx];
-	page_addr = rx->com.qpl->dmas[page_idx].cpu_addr;
+	page_idx = gve_rx_page_idx_dqo(rx, buf);
+	page = gve_rx_page_list_dqo(rx)->pages[page_idx];
+	page_addr = gve_rx_page_list_dqo(rx)->dmas[page_idx].cpu_addr;
 	va = (char *)page_addr + (buf_frag_num * GVE_DEFAULT_RX_BUFFER_SIZE);
 
 	/*
@@ -827,44 +1132,43 @@ gve_rx_add_extmbuf_to_ctx(struct gve_rx_ring *rx,
 	return (0);
 }
 
+/* Handles completions for page bufs, see gve_rx_page_list_dqo. */
 static void
 gve_rx_dqo_qpl(struct gve_priv *priv, struct gve_rx_ring *rx,
     struct gve_rx_compl_desc_dqo *compl_desc,
     int *work_done)
 {
 	bool is_last_frag = compl_desc->end_of_packet != 0;
-	union gve_rx_qpl_buf_id_dqo composed_id;
 	struct gve_dma_handle *page_dma_handle;
 	struct gve_rx_ctx *ctx = &rx->ctx;
 	struct gve_rx_buf_dqo *buf;
 	uint32_t num_pending_bufs;
+	pfil_head_t pfil;
 	uint8_t buf_frag_num;
 	uint16_t frag_len;
-	uint16_t buf_id;
+	bool copybreak;
 	int err;
 
-	composed_id.all = le16toh(compl_desc->buf_id);
-	buf_id = composed_id.buf_id;
-	buf_frag_num = composed_id.frag_num;
-
-	if (__predict_false(buf_id >= rx->dqo.buf_cnt)) {
+	buf = gve_rx_page_buf_dqo(rx, compl_desc, &buf_frag_num);
+	if (__predict_false(buf == NULL)) {
 		device_printf(priv->dev, "Invalid rx buf id %d on rxq %d, issuing reset\n",
-		    buf_id, rx->com.id);
+		    le16toh(compl_desc->buf_id), rx->com.id);
 		gve_schedule_reset(priv);
 		goto drop_frag_clear_ctx;
 	}
-	buf = &rx->dqo.bufs[buf_id];
 	if (__predict_false(buf->num_nic_frags == 0 ||
 	    buf_frag_num > GVE_DQ_NUM_FRAGS_IN_PAGE - 1)) {
 		device_printf(priv->dev, "Spurious compl for buf id %d on rxq %d "
 		    "with buf_frag_num %d and num_nic_frags %d, issuing reset\n",
-		    buf_id, rx->com.id, buf_frag_num, buf->num_nic_frags);
+		    gve_rx_page_idx_dqo(rx, buf), rx->com.id, buf_frag_num,
+		    buf->num_nic_frags);
 		gve_schedule_reset(priv);
 		goto drop_frag_clear_ctx;
 	}
 
 	buf->num_nic_frags--;
 
+	ctx->frag_cnt++;
 	if (__predict_false(ctx->drop_pkt))
 		goto drop_frag;
 
@@ -879,10 +1183,40 @@ gve_rx_dqo_qpl(struct gve_priv *priv, struct gve_rx_ring *rx,
 	bus_dmamap_sync(page_dma_handle->tag, page_dma_handle->map,
 	    BUS_DMASYNC_POSTREAD);
 
+	if (rx->dqo.hdr_bufs != NULL && ctx->mbuf_head == NULL) {
+		err = gve_rx_hsplit_dqo(rx, compl_desc);
+		if (__predict_false(err != 0)) {
+			counter_enter();
+			if (err == ENOMEM)
+				counter_u64_add_protected(
+				    rx->stats.rx_dropped_pkt_mbuf_alloc_fail, 1);
+			else
+				counter_u64_add_protected(
+				    rx->stats.rx_dropped_pkt_desc_err, 1);
+			counter_exit();
+			goto drop_frag;
+		}
+	}
+
 	frag_len = compl_desc->packet_len;
-	if (frag_len <= priv->rx_copybreak && !ctx->mbuf_head && is_last_frag) {
+	if (ctx->mbuf_head == NULL && is_last_frag &&
+	    (pfil = gve_rx_pfil_hooked(priv)) != NULL &&
+	    gve_rx_pfil(rx, pfil,
+	    gve_get_cpu_addr_for_qpl_buf(rx, buf, buf_frag_num), frag_len)) {
+		rx->ctx = (struct gve_rx_ctx){};
+		(*work_done)++;
+		gve_rx_post_qpl_buf_dqo(rx, buf, buf_frag_num);
+		return;
+	}
+
+	copybreak = frag_len <= rx->copybreak.thresh && !ctx->mbuf_head &&
+	    is_last_frag;
+	SDT_PROBE3(gve, , rx, copybreak, rx, frag_len, copybreak);
+	rx->copybreak.frags++;
+	if (copybreak) {
 		void *va = gve_get_cpu_addr_for_qpl_buf(rx, buf, buf_frag_num);
 
+		rx->copybreak.copies++;
 		err = gve_rx_copybreak_dqo(rx, va, compl_desc, frag_len);
 		if (__predict_false(err != 0))
 			goto drop_frag;
@@ -891,8 +1225,23 @@ gve_rx_dqo_qpl(struct gve_priv *priv, struct gve_rx_ring *rx,
 		return;
 	}
 
+	if (is_last_frag && gve_rx_append_to_hdr_dqo(rx,
+	    gve_get_cpu_addr_for_qpl_buf(rx, buf, buf_frag_num), frag_len)) {
+		gve_rx_post_qpl_buf_dqo(rx, buf, buf_frag_num);
+		gve_rx_input_mbuf_dqo(rx, compl_desc);
+		(*work_done)++;
+		return;
+	}
+
 	num_pending_bufs = (rx->dqo.head - rx->dqo.tail) & rx->dqo.mask;
-	err = gve_rx_post_new_dqo_qpl_buf(rx);
+	if (gve_is_qpl(priv))
+		err = gve_rx_post_new_dqo_qpl_buf(rx);
+	else
+		err = gve_rx_post_new_rda_buf_dqo(rx, M_NOWAIT);
+	if (__predict_false(err != 0)) {
+		SDT_PROBE3(gve, , rx, post__fail, rx, err, num_pending_bufs);
+		rx->copybreak.starved++;
+	}
 	if (__predict_false(err != 0 &&
 	    num_pending_bufs <= GVE_RX_DQO_MIN_PENDING_BUFS)) {
 		/*
@@ -975,7 +1324,26 @@ gve_rx_get_gen_bit(uint8_t *desc)
 	return ((byte & GVE_RX_DESC_DQO_GEN_BIT_MASK) != 0);
 }
 
+/* Spins for new completions while busy-polling, returning true if any came. */
 static bool
+gve_rx_busy_poll_dqo(struct gve_rx_ring *rx)
+{
+	struct gve_rx_compl_desc_dqo *compl_desc;
+	sbintime_t deadline = 0;
+
+	while (gve_busy_poll_spin(&rx->com, &deadline)) {
+		bus_dmamap_sync(rx->dqo.compl_ring_mem.tag,
+		    rx->dqo.compl_ring_mem.map, BUS_DMASYNC_POSTREAD);
+		compl_desc = &rx->dqo.compl_ring[rx->dqo.tail];
+		if (gve_rx_get_gen_bit((uint8_t *)compl_desc) !=
+		    rx->dqo.cur_gen_bit)
+			return (true);
+	}
+	return (false);
+}
+
+/* Returns the number of completions handled, at most `budget`. */
+static int
 gve_rx_cleanup_dqo(struct gve_priv *priv, struct gve_rx_ring *rx, int budget)
 {
 	struct gve_rx_compl_desc_dqo *compl_desc;
@@ -997,19 +1365,23 @@ gve_rx_cleanup_dqo(struct gve_priv *priv, struct gve_rx_ring *rx, int budget)
 		rx->dqo.tail = (rx->dqo.tail + 1) & rx->dqo.mask;
 		rx->dqo.cur_gen_bit ^= (rx->dqo.tail == 0);
 
-		if (gve_is_qpl(priv))
+		if (gve_is_qpl(priv) || (le16toh(compl_desc->buf_id) &
+		    GVE_RX_POOL_BUF_ID_DQO) != 0)
 			gve_rx_dqo_qpl(priv, rx, compl_desc, &work_done);
 		else
 			gve_rx_dqo(priv, rx, compl_desc, &work_done);
 	}
 
+	gve_rx_input_flush(rx);
 	if (work_done != 0)
 		tcp_lro_flush_all(&rx->lro);
 
 	gve_rx_post_buffers_dqo(rx, M_NOWAIT);
-	if (gve_is_qpl(priv))
+	if (gve_rx_page_list_dqo(rx) != NULL)
 		gve_rx_maybe_extract_from_used_bufs(rx, /*just_one=*/false);
-	return (work_done == budget);
+	gve_rx_mbuf_cache_refill(rx, M_NOWAIT);
+	gve_rx_copybreak_adapt(rx);
+	return (work_done);
 }
 
 void
@@ -1017,15 +1389,218 @@ gve_rx_cleanup_tq_dqo(void *arg, int pending)
 {
 	struct gve_rx_ring *rx = arg;
 	struct gve_priv *priv = rx->com.priv;
+	uint32_t usecs;
+	int work_done;
 
 	if (__predict_false((if_getdrvflags(priv->ifp) & IFF_DRV_RUNNING) == 0))
 		return;
 
-	if (gve_rx_cleanup_dqo(priv, rx, /*budget=*/64)) {
+#ifdef GVE_HISTOGRAMS
+	gve_hist_intr_delay(&rx->com, rx->stats.rx_intr_delay_us);
+#endif
+
+#ifdef DEV_NETMAP
+	if (gve_netmap_rx_irq(rx)) {
+		gve_db_bar_dqo_write_4(priv, rx->com.irq_db_offset,
+		    GVE_ITR_NO_UPDATE_DQO | GVE_ITR_ENABLE_BIT_DQO);
+		return;
+	}
+#endif
+
+	work_done = gve_rx_cleanup_dqo(priv, rx, /*budget=*/64);
+#ifdef GVE_HISTOGRAMS
+	gve_hist_add(rx->stats.rx_cleanup_work, work_done);
+#endif
+	if (work_done == 64 || gve_rx_busy_poll_dqo(rx)) {
 		taskqueue_enqueue(rx->com.cleanup_tq, &rx->com.cleanup_task);
 		return;
 	}
 
+	usecs = gve_itr_rearm_usecs(&rx->com, work_done, rx->stats.rpackets,
+	    rx->stats.rbytes);
 	gve_db_bar_dqo_write_4(priv, rx->com.irq_db_offset,
-	    GVE_ITR_NO_UPDATE_DQO | GVE_ITR_ENABLE_BIT_DQO);
+	    gve_itr_db_val_dqo(&rx->com, usecs));
+}
+
+#ifdef DEV_NETMAP
+/*
+ * Returns the number of completions making up the packet starting at
+ * rx->dqo.tail, or 0 if the device has not written all of them yet.
+ */
+static uint32_t
+gve_rx_peek_pkt_frags_dqo(struct gve_rx_ring *rx)
+{
+	struct gve_rx_compl_desc_dqo *compl_desc;
+	uint8_t gen_bit = rx->dqo.cur_gen_bit;
+	uint32_t tail = rx->dqo.tail;
+	uint32_t frags = 0;
+
+	while (frags <= rx->dqo.mask) {
+		compl_desc = &rx->dqo.compl_ring[tail];
+		if (gve_rx_get_gen_bit((uint8_t *)compl_desc) == gen_bit)
+			return (0);
+		frags++;
+		if (compl_desc->end_of_packet != 0)
+			return (frags);
+		tail = (tail + 1) & rx->dqo.mask;
+		gen_bit ^= (tail == 0);
+	}
+
+	return (0);
+}
+
+/*
+ * Copies the frag described by compl_desc into dst and hands its buffer
+ * straight back to the device. Returns the frag's length, or -1 if the
+ * completion did not name a buffer the device owns.
+ */
+static int
+gve_netmap_rx_frag_dqo(struct gve_priv *priv, struct gve_rx_ring *rx,
+    struct gve_rx_compl_desc_dqo *compl_desc, char *dst)
+{
+	struct gve_dma_handle *page_dma_handle;
+	struct gve_rx_buf_dqo *buf;
+	uint16_t frag_len = compl_desc->packet_len;
+	uint16_t buf_id = le16toh(compl_desc->buf_id);
+	uint8_t buf_frag_num = 0;
+	bool page_buf;
+
+	page_buf = gve_is_qpl(priv) || (buf_id & GVE_RX_POOL_BUF_ID_DQO) != 0;
+	if (page_buf)
+		buf = gve_rx_page_buf_dqo(rx, compl_desc, &buf_frag_num);
+	else
+		buf = buf_id < rx->dqo.buf_cnt ? &rx->dqo.bufs[buf_id] : NULL;
+	if (__predict_false(buf == NULL)) {
+		device_printf(priv->dev, "Invalid rx buf id %d on rxq %d, issuing reset\n",
+		    buf_id, rx->com.id);
+		gve_schedule_reset(priv);
+		return (-1);
+	}
+
+	if (page_buf) {
+		if (__predict_false(buf->num_nic_frags == 0 ||
+		    buf_frag_num > GVE_DQ_NUM_FRAGS_IN_PAGE - 1)) {
+			device_printf(priv->dev, "Spurious compl for buf id %d on rxq %d "
+			    "with buf_frag_num %d and num_nic_frags %d, issuing reset\n",
+			    buf_id, rx->com.id, buf_frag_num, buf->num_nic_frags);
+			gve_schedule_reset(priv);
+			return (-1);
+		}
+		buf->num_nic_frags--;
+
+		page_dma_handle = gve_get_page_dma_handle(rx, buf);
+		bus_dmamap_sync(page_dma_handle->tag, page_dma_handle->map,
+		    BUS_DMASYNC_POSTREAD);
+		memcpy(dst, gve_get_cpu_addr_for_qpl_buf(rx, buf, buf_frag_num),
+		    frag_len);
+		gve_rx_post_qpl_buf_dqo(rx, buf, buf_frag_num);
+	} else {
+		if (__predict_false(buf->mbuf == NULL)) {
+			device_printf(priv->dev, "Spurious completion for buf id %d on rxq %d, issuing reset\n",
+			    buf_id, rx->com.id);
+			gve_schedule_reset(priv);
+			return (-1);
+		}
+
+		bus_dmamap_sync(rx->dqo.buf_dmatag, buf->dmamap,
+		    BUS_DMASYNC_POSTREAD);
+		memcpy(dst, mtod(buf->mbuf, char *), frag_len);
+		gve_rx_post_buf_dqo(rx, buf);
+	}
+
+	return (frag_len);
+}
+
+int
+gve_netmap_rxsync_dqo(struct netmap_kring *kring, int flags)
+{
+	struct netmap_adapter *na = kring->na;
+	struct netmap_ring *ring = kring->ring;
+	struct gve_priv *priv = if_getsoftc(na->ifp);
+	struct gve_rx_ring *rx = &priv->rx[kring->ring_id];
+	struct gve_rx_compl_desc_dqo *compl_desc;
+	struct netmap_slot *slot;
+	u_int lim = kring->nkr_num_slots - 1;
+	u_int const head = kring->rhead;
+	u_int nm_i, pkt_start, room;
+	uint64_t rbytes = 0, rpackets = 0;
+	uint32_t frags, len, i;
+	bool drop;
+	int frag_len;
+
+	if (head > lim)
+		return (netmap_ring_reinit(kring));
+
+	if (netmap_no_pendintr || (flags & NAF_FORCE_READ) != 0 ||
+	    (kring->nr_kflags & NKR_PENDINTR) != 0) {
+		nm_i = kring->nr_hwtail;
+		for (;;) {
+			bus_dmamap_sync(rx->dqo.compl_ring_mem.tag,
+			    rx->dqo.compl_ring_mem.map,
+			    BUS_DMASYNC_POSTREAD);
+
+			/* One slot is kept empty to tell a full ring from an empty one */
+			room = (kring->nr_hwcur + lim - nm_i) % kring->nkr_num_slots;
+			frags = gve_rx_peek_pkt_frags_dqo(rx);
+			if (frags == 0 || frags > room)
+				break;
+
+			pkt_start = nm_i;
+			drop = false;
+			len = 0;
+			for (i = 0; i < frags; i++) {
+				compl_desc = &rx->dqo.compl_ring[rx->dqo.tail];
+				slot = &ring->slot[nm_i];
+
+				rx->cnt++;
+				rx->dqo.tail = (rx->dqo.tail + 1) & rx->dqo.mask;
+				rx->dqo.cur_gen_bit ^= (rx->dqo.tail == 0);
+
+				if (__predict_false(compl_desc->rx_error))
+					drop = true;
+
+				frag_len = gve_netmap_rx_frag_dqo(priv, rx,
+				    compl_desc, NMB(na, slot));
+				if (__predict_false(frag_len < 0)) {
+					/* A reset is on its way */
+					nm_i = pkt_start;
+					goto done;
+				}
+
+				slot->len = frag_len;
+				slot->flags = (i == frags - 1) ? 0 : NS_MOREFRAG;
+				len += frag_len;
+				nm_i = nm_next(nm_i, lim);
+			}
+
+			if (__predict_false(drop)) {
+				nm_i = pkt_start;
+				counter_enter();
+				counter_u64_add_protected(
+				    rx->stats.rx_dropped_pkt_desc_err, 1);
+				counter_u64_add_protected(rx->stats.rx_dropped_pkt, 1);
+				counter_exit();
+				continue;
+			}
+
+			rbytes += len;
+			rpackets++;
+		}
+done:
+		kring->nr_hwtail = nm_i;
+		kring->nr_kflags &= ~NKR_PENDINTR;
+	}
+
+	/* Slots are only ever copied into, so returning them is free. */
+	kring->nr_hwcur = head;
+
+	if (rpackets != 0) {
+		counter_enter();
+		counter_u64_add_protected(rx->stats.rbytes, rbytes);
+		counter_u64_add_protected(rx->stats.rpackets, rpackets);
+		counter_exit();
+	}
+
+	return (0);
 }
+#endif
@@ -0,0 +1,379 @@
+/*-
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Copyright (c) 2024 Google LLC
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "opt_ratelimit.h"
+
+#include "gve.h"
+
+#ifdef RATELIMIT
+
+/* Packets a send tag holds back for pacing before it starts dropping */
+#define GVE_RL_TAG_MAX_PENDING 512
+
+/*
+ * A send tag for a paced flow. The device has no per-flow rate limiter, so the
+ * driver paces the flow itself: every packet moves next_send forward by the
+ * time its length takes at max_rate, and packets that show up before
+ * next_send wait in pending for the callout to release them. The flow is
+ * bound to one bulk tx queue so that pacing never reorders it.
+ */
+struct gve_rl_tag {
+	struct m_snd_tag com;
+	uint32_t flow;		/* spread over the bulk queues, see gve_rl_tag_txq */
+	LIST_ENTRY(gve_rl_tag) link;
+
+	struct mtx mtx;
+	struct gve_priv *priv;	/* NULL once the device has detached */
+	uint64_t max_rate;	/* bytes per second, 0 for unlimited */
+	sbintime_t next_send;
+	struct mbufq pending;
+	struct callout callout;
+
+	/* Tags are released from contexts that cannot drain the callout */
+	struct task free_task;
+};
+
+/*
+ * Tags can outlive the device they were allocated on, held by the stack or by
+ * queued mbufs, so gve_snd_tag_detach finds them here to cut them loose. A
+ * tag leaves the list last thing before it is freed, and the module is not
+ * unloaded while there are any, see gve_snd_tag_unload.
+ */
+static LIST_HEAD(, gve_rl_tag) gve_rl_tags = LIST_HEAD_INITIALIZER(gve_rl_tags);
+static struct mtx gve_rl_tags_mtx;
+MTX_SYSINIT(gve_rl_tags, &gve_rl_tags_mtx, "gve rl tags", MTX_DEF);
+
+static if_snd_tag_modify_t gve_rl_tag_modify;
+static if_snd_tag_query_t gve_rl_tag_query;
+static if_snd_tag_free_t gve_rl_tag_free;
+
+static const struct if_snd_tag_sw gve_rl_tag_sw = {
+	.snd_tag_modify = gve_rl_tag_modify,
+	.snd_tag_query = gve_rl_tag_query,
+	.snd_tag_free = gve_rl_tag_free,
+	.type = IF_SND_TAG_TYPE_RATE_LIMIT,
+};
+
+static const struct if_snd_tag_sw gve_unlimited_tag_sw = {
+	.snd_tag_modify = gve_rl_tag_modify,
+	.snd_tag_query = gve_rl_tag_query,
+	.snd_tag_free = gve_rl_tag_free,
+	.type = IF_SND_TAG_TYPE_UNLIMITED,
+};
+
+static inline struct gve_rl_tag *
+gve_mst_to_rl_tag(struct m_snd_tag *mst)
+{
+	return (__containerof(mst, struct gve_rl_tag, com));
+}
+
+/*
+ * Maps the flow onto the bulk queues as they are now, so that a change of the
+ * queue count or of the low-latency class never puts it on a low-latency one.
+ */
+static struct gve_tx_ring *
+gve_rl_tag_txq(struct gve_priv *priv, struct gve_rl_tag *tag)
+{
+	uint32_t num_queues;
+	uint32_t first;
+
+	num_queues = gve_tx_load_queues(priv, &first);
+	return (&priv->tx[first + tag->flow % (num_queues - first)]);
+}
+
+static void
+gve_rl_tag_send(struct gve_rl_tag *tag, struct mbuf *mbuf)
+{
+	struct gve_priv *priv = tag->priv;
+
+	mtx_assert(&tag->mtx, MA_OWNED);
+
+	if (__predict_false(priv == NULL ||
+	    (if_getdrvflags(priv->ifp) & IFF_DRV_RUNNING) == 0)) {
+		m_freem(mbuf);
+		return;
+	}
+	gve_xmit_txq(gve_rl_tag_txq(priv, tag), mbuf);
+}
+
+static sbintime_t
+gve_rl_tag_delay(struct gve_rl_tag *tag, struct mbuf *mbuf)
+{
+	if (tag->max_rate == 0)
+		return (0);
+	return (((uint64_t)mbuf->m_pkthdr.len * SBT_1S) / tag->max_rate);
+}
+
+/* Releases the pending packets whose turn has come */
+static void
+gve_rl_tag_callout(void *arg)
+{
+	struct gve_rl_tag *tag = arg;
+	struct epoch_tracker et;
+	struct mbuf *mbuf;
+	sbintime_t now;
+
+	mtx_assert(&tag->mtx, MA_OWNED);
+
+	/* Transmitters pick their queue in the net epoch, see gve_xmit_ifp */
+	NET_EPOCH_ENTER(et);
+	now = sbinuptime();
+	while ((mbuf = mbufq_first(&tag->pending)) != NULL) {
+		if (tag->next_send > now) {
+			callout_reset_sbt(&tag->callout, tag->next_send, 0,
+			    gve_rl_tag_callout, tag, C_ABSOLUTE);
+			break;
+		}
+		mbufq_dequeue(&tag->pending);
+		tag->next_send += gve_rl_tag_delay(tag, mbuf);
+		gve_rl_tag_send(tag, mbuf);
+	}
+	NET_EPOCH_EXIT(et);
+}
+
+int
+gve_rl_tag_xmit(struct gve_priv *priv, struct mbuf *mbuf)
+{
+	struct m_snd_tag *mst = mbuf->m_pkthdr.snd_tag;
+	struct gve_tx_ring *tx;
+	struct gve_rl_tag *tag;
+	sbintime_t now;
+
+	if (__predict_false(mst->sw != &gve_rl_tag_sw &&
+	    mst->sw != &gve_unlimited_tag_sw)) {
+		m_freem(mbuf);
+		return (EINVAL);
+	}
+	tag = gve_mst_to_rl_tag(mst);
+	tx = gve_rl_tag_txq(priv, tag);
+
+	mtx_lock(&tag->mtx);
+	if (__predict_false(tag->priv != priv)) {
+		mtx_unlock(&tag->mtx);
+		m_freem(mbuf);
+		return (ENXIO);
+	}
+	now = sbinuptime();
+	if (mbufq_len(&tag->pending) == 0 && tag->next_send <= now) {
+		tag->next_send = now + gve_rl_tag_delay(tag, mbuf);
+		mtx_unlock(&tag->mtx);
+		return (gve_xmit_txq(tx, mbuf));
+	}
+
+	if (__predict_false(mbufq_enqueue(&tag->pending, mbuf) != 0)) {
+		mtx_unlock(&tag->mtx);
+		m_freem(mbuf);
+		counter_enter();
+		counter_u64_add_protected(tx->stats.tx_dropped_pkt_pacing, 1);
+		counter_u64_add_protected(tx->stats.tx_dropped_pkt, 1);
+		counter_exit();
+		return (ENOBUFS);
+	}
+	if (!callout_pending(&tag->callout))
+		callout_reset_sbt(&tag->callout, tag->next_send, 0,
+		    gve_rl_tag_callout, tag, C_ABSOLUTE);
+	mtx_unlock(&tag->mtx);
+
+	counter_enter();
+	counter_u64_add_protected(tx->stats.tx_paced_pkt, 1);
+	counter_exit();
+	return (0);
+}
+
+/*
+ * Picks what binds a new flow to a bulk tx queue, which is then the same one
+ * gve_xmit_ifp would have picked for it when RSS is not configured.
+ */
+static uint32_t
+gve_rl_tag_pick_flow(struct gve_priv *priv, union if_snd_tag_alloc_params *params)
+{
+	if (params->hdr.flowtype == M_HASHTYPE_NONE)
+		return (priv->cpu_txq[curcpu]);
+	return (params->hdr.flowid);
+}
+
+static int
+gve_rl_tag_alloc(if_t ifp, union if_snd_tag_alloc_params *params,
+    const struct if_snd_tag_sw *sw, struct m_snd_tag **mstp)
+{
+	struct gve_priv *priv = if_getsoftc(ifp);
+	struct gve_rl_tag *tag;
+
+	if ((if_getcapenable(ifp) & IFCAP_TXRTLMT) == 0)
+		return (EOPNOTSUPP);
+
+	tag = malloc(sizeof(*tag), M_GVE, M_NOWAIT | M_ZERO);
+	if (tag == NULL)
+		return (ENOMEM);
+
+	tag->flow = gve_rl_tag_pick_flow(priv, params);
+	tag->priv = priv;
+	if (sw == &gve_rl_tag_sw)
+		tag->max_rate = params->rate_limit.max_rate;
+	mtx_init(&tag->mtx, "gve rl tag", NULL, MTX_DEF);
+	mbufq_init(&tag->pending, GVE_RL_TAG_MAX_PENDING);
+	callout_init_mtx(&tag->callout, &tag->mtx, 0);
+
+	mtx_lock(&gve_rl_tags_mtx);
+	LIST_INSERT_HEAD(&gve_rl_tags, tag, link);
+	mtx_unlock(&gve_rl_tags_mtx);
+
+	m_snd_tag_init(&tag->com, ifp, sw);
+	*mstp = &tag->com;
+	return (0);
+}
+
+int
+gve_snd_tag_alloc(if_t ifp, union if_snd_tag_alloc_params *params,
+    struct m_snd_tag **mstp)
+{
+	switch (params->hdr.type) {
+	case IF_SND_TAG_TYPE_RATE_LIMIT:
+		return (gve_rl_tag_alloc(ifp, params, &gve_rl_tag_sw, mstp));
+	case IF_SND_TAG_TYPE_UNLIMITED:
+		return (gve_rl_tag_alloc(ifp, params, &gve_unlimited_tag_sw, mstp));
+	default:
+		/*
+		 * Kernel TLS tags would be handed out here, but the device has
+		 * no inline crypto engine to back them.
+		 */
+		return (EOPNOTSUPP);
+	}
+}
+
+static int
+gve_rl_tag_modify(struct m_snd_tag *mst, union if_snd_tag_modify_params *params)
+{
+	struct gve_rl_tag *tag = gve_mst_to_rl_tag(mst);
+
+	if (mst->sw != &gve_rl_tag_sw)
+		return (EOPNOTSUPP);
+
+	/* Packets already waiting keep the slots they were given */
+	mtx_lock(&tag->mtx);
+	tag->max_rate = params->rate_limit.max_rate;
+	mtx_unlock(&tag->mtx);
+	return (0);
+}
+
+static int
+gve_rl_tag_query(struct m_snd_tag *mst, union if_snd_tag_query_params *params)
+{
+	struct gve_rl_tag *tag = gve_mst_to_rl_tag(mst);
+
+	mtx_lock(&tag->mtx);
+	params->rate_limit.max_rate = tag->max_rate;
+	params->rate_limit.queue_level = IF_SND_QUEUE_LEVEL_MAX *
+	    mbufq_len(&tag->pending) / GVE_RL_TAG_MAX_PENDING;
+	mtx_unlock(&tag->mtx);
+	return (0);
+}
+
+static void
+gve_rl_tag_free_task(void *arg, int pending)
+{
+	struct gve_rl_tag *tag = arg;
+
+	callout_drain(&tag->callout);
+
+	mtx_lock(&gve_rl_tags_mtx);
+	LIST_REMOVE(tag, link);
+	mtx_unlock(&gve_rl_tags_mtx);
+
+	mtx_destroy(&tag->mtx);
+	free(tag, M_GVE);
+}
+
+/*
+ * Every pending packet holds a reference on its tag, so the tag has nothing
+ * left to send by the time it is freed, though its callout may still be on
+ * the way out.
+ */
+static void
+gve_rl_tag_free(struct m_snd_tag *mst)
+{
+	struct gve_rl_tag *tag = gve_mst_to_rl_tag(mst);
+
+	TASK_INIT(&tag->free_task, 0, gve_rl_tag_free_task, tag);
+	taskqueue_enqueue(taskqueue_thread, &tag->free_task);
+}
+
+/*
+ * Stops the tags of a detaching device from touching it again: their callouts
+ * are stopped and the packets they were pacing dropped. The tags themselves
+ * live on until the stack lets go of them.
+ */
+void
+gve_snd_tag_detach(struct gve_priv *priv)
+{
+	struct mbufq purged;
+	struct gve_rl_tag *tag;
+	struct mbuf *mbuf;
+
+	mbufq_init(&purged, INT_MAX);
+
+	mtx_lock(&gve_rl_tags_mtx);
+	LIST_FOREACH(tag, &gve_rl_tags, link) {
+		mtx_lock(&tag->mtx);
+		if (tag->priv == priv) {
+			tag->priv = NULL;
+			callout_stop(&tag->callout);
+			mbufq_concat(&purged, &tag->pending);
+		}
+		mtx_unlock(&tag->mtx);
+	}
+	mtx_unlock(&gve_rl_tags_mtx);
+
+	/* Releases the tag refs the packets held, which may free the tags */
+	while ((mbuf = mbufq_dequeue(&purged)) != NULL)
+		m_freem(mbuf);
+}
+
+/*
+ * Keeps the module loaded while any tag is still around, since freeing one
+ * runs code from it. Once the list is empty only the tail of the last free
+ * tasks can be left, which draining their taskqueue waits out.
+ */
+int
+gve_snd_tag_unload(void)
+{
+	bool busy;
+
+	mtx_lock(&gve_rl_tags_mtx);
+	busy = !LIST_EMPTY(&gve_rl_tags);
+	mtx_unlock(&gve_rl_tags_mtx);
+	if (busy)
+		return (EBUSY);
+
+	taskqueue_drain_all(taskqueue_thread);
+	return (0);
+}
+
+#endif /* RATELIMIT */
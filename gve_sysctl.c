@@ -37,6 +37,16 @@ bool gve_disable_hw_lro = false;
 SYSCTL_BOOL(_hw_gve, OID_AUTO, disable_hw_lro, CTLFLAG_RDTUN,
     &gve_disable_hw_lro, 0, "Controls if hardware LRO is used");
 
+bool gve_rx_page_pool = true;
+SYSCTL_BOOL(_hw_gve, OID_AUTO, rx_page_pool, CTLFLAG_RDTUN,
+    &gve_rx_page_pool, 0,
+    "Recycle pre-mapped pages for DQO RDA receive buffers");
+
+uint32_t gve_stats_report_interval = 20000;
+SYSCTL_UINT(_hw_gve, OID_AUTO, stats_report_interval_ms, CTLFLAG_RDTUN,
+    &gve_stats_report_interval, 0,
+    "Milliseconds between stats report refreshes, 0 disables the report");
+
 char gve_queue_format[8];
 SYSCTL_STRING(_hw_gve, OID_AUTO, queue_format, CTLFLAG_RD,
     &gve_queue_format, 0, "Queue format being used by the iface");
@@ -45,14 +55,90 @@ char gve_version[8];
 SYSCTL_STRING(_hw_gve, OID_AUTO, driver_version, CTLFLAG_RD,
     &gve_version, 0, "Driver version");
 
+/*
+ * Handles a uint32_t knob in arg1 whose value arg2 caps. The data path picks up
+ * the new value on its next pass.
+ */
+static int
+gve_sysctl_capped_u32(SYSCTL_HANDLER_ARGS)
+{
+	uint32_t *knob = arg1;
+	u_int val;
+	int err;
+
+	val = *knob;
+	err = sysctl_handle_int(oidp, &val, 0, req);
+	if (err != 0 || req->newptr == NULL)
+		return (err);
+
+	if (val > arg2)
+		return (EINVAL);
+
+	*knob = val;
+	return (0);
+}
+
+static void
+gve_setup_itr_sysctl(struct sysctl_ctx_list *ctx,
+    struct sysctl_oid_list *list, struct gve_ring_com *com)
+{
+	SYSCTL_ADD_PROC(ctx, list, OID_AUTO, "itr_usecs",
+	    CTLTYPE_UINT | CTLFLAG_RW | CTLFLAG_MPSAFE, &com->itr.usecs,
+	    GVE_ITR_MAX_USECS, gve_sysctl_capped_u32, "IU",
+	    "Interrupt moderation interval in microseconds");
+	SYSCTL_ADD_U32(ctx, list, OID_AUTO, "itr_frames", CTLFLAG_RW,
+	    &com->itr.frames, 0,
+	    "Completions per cleanup pass below which the interval is skipped");
+	SYSCTL_ADD_BOOL(ctx, list, OID_AUTO, "itr_adaptive", CTLFLAG_RW,
+	    &com->itr.adaptive, 0,
+	    "Derive the interval from the observed packet and byte rates");
+	SYSCTL_ADD_U32(ctx, list, OID_AUTO, "itr_cur_usecs", CTLFLAG_RD,
+	    &com->itr.cur_usecs, 0, "Interrupt moderation interval in use");
+	SYSCTL_ADD_PROC(ctx, list, OID_AUTO, "busy_poll_usecs",
+	    CTLTYPE_UINT | CTLFLAG_RW | CTLFLAG_MPSAFE, &com->busy_poll_usecs,
+	    GVE_BUSY_POLL_MAX_USECS, gve_sysctl_capped_u32, "IU",
+	    "Microseconds to spin for completions before re-arming the irq");
+}
+
+#ifdef GVE_HISTOGRAMS
+/*
+ * Reports the GVE_HIST_BUCKETS counters in arg1 as an array, bucket n holding
+ * the samples of [2^n, 2^(n+1)).
+ */
+static int
+gve_sysctl_hist(SYSCTL_HANDLER_ARGS)
+{
+	counter_u64_t *hist = arg1;
+	uint64_t vals[GVE_HIST_BUCKETS];
+	int i;
+
+	for (i = 0; i < GVE_HIST_BUCKETS; i++)
+		vals[i] = counter_u64_fetch(hist[i]);
+	return (SYSCTL_OUT(req, vals, sizeof(vals)));
+}
+
+static void
+gve_setup_hist_sysctl(struct sysctl_ctx_list *ctx,
+    struct sysctl_oid_list *list, const char *name, counter_u64_t *hist,
+    const char *descr)
+{
+	SYSCTL_ADD_PROC(ctx, list, OID_AUTO, name,
+	    CTLTYPE_U64 | CTLFLAG_RD | CTLFLAG_MPSAFE, hist, 0,
+	    gve_sysctl_hist, "QU", descr);
+}
+#endif
+
 static void
 gve_setup_rxq_sysctl(struct sysctl_ctx_list *ctx,
     struct sysctl_oid_list *child, struct gve_rx_ring *rxq)
 {
 	struct sysctl_oid *node;
+	struct sysctl_oid *batch_node;
 	struct sysctl_oid_list *list;
+	struct sysctl_oid_list *batch_list;
 	struct gve_rxq_stats *stats;
 	char namebuf[16];
+	int i;
 
 	snprintf(namebuf, sizeof(namebuf), "rxq%d", rxq->com.id);
 	node = SYSCTL_ADD_NODE(ctx, child, OID_AUTO, namebuf,
@@ -76,6 +162,9 @@ gve_setup_rxq_sysctl(struct sysctl_ctx_list *ctx,
 	SYSCTL_ADD_COUNTER_U64(ctx, list, OID_AUTO, "rx_frag_copy_cnt",
 	    CTLFLAG_RD, &stats->rx_frag_copy_cnt,
 	    "Total frags with mbuf that copied payload into mbuf");
+	SYSCTL_ADD_COUNTER_U64(ctx, list, OID_AUTO, "rx_page_swap_cnt",
+	    CTLFLAG_RD, &stats->rx_page_swap_cnt,
+	    "Total frags whose slot got a spare page instead of a copy");
 	SYSCTL_ADD_COUNTER_U64(ctx, list, OID_AUTO, "rx_dropped_pkt",
 	    CTLFLAG_RD, &stats->rx_dropped_pkt,
 	    "Total rx packets dropped");
@@ -99,6 +188,50 @@ gve_setup_rxq_sysctl(struct sysctl_ctx_list *ctx,
 	    "rx_mbuf_mclget_null", CTLFLAG_RD,
 	    &stats->rx_mbuf_mclget_null,
 	    "Number of times when there were no cluster mbufs");
+	SYSCTL_ADD_COUNTER_U64(ctx, list, OID_AUTO,
+	    "rx_hsplit_pkt", CTLFLAG_RD,
+	    &stats->rx_hsplit_pkt,
+	    "Packets received with header split enabled");
+	SYSCTL_ADD_COUNTER_U64(ctx, list, OID_AUTO,
+	    "rx_hsplit_unsplit_pkt", CTLFLAG_RD,
+	    &stats->rx_hsplit_unsplit_pkt,
+	    "Header split packets the device did not split");
+	SYSCTL_ADD_COUNTER_U64(ctx, list, OID_AUTO,
+	    "rx_hsplit_bytes", CTLFLAG_RD,
+	    &stats->rx_hsplit_bytes,
+	    "Header bytes received in header buffers");
+	SYSCTL_ADD_COUNTER_U64(ctx, list, OID_AUTO,
+	    "rx_pool_hit", CTLFLAG_RD,
+	    &stats->rx_pool_hit,
+	    "Buffers posted from recycled page pool pages");
+	SYSCTL_ADD_COUNTER_U64(ctx, list, OID_AUTO,
+	    "rx_pool_fallback", CTLFLAG_RD,
+	    &stats->rx_pool_fallback,
+	    "Buffers posted as new mbufs because no pool page was free");
+	SYSCTL_ADD_COUNTER_U64(ctx, list, OID_AUTO,
+	    "rx_mbuf_cache_empty", CTLFLAG_RD,
+	    &stats->rx_mbuf_cache_empty,
+	    "Mbufs the cleanup path allocated inline because the mbuf cache ran dry");
+	SYSCTL_ADD_COUNTER_U64(ctx, list, OID_AUTO,
+	    "rx_pfil_dropped", CTLFLAG_RD,
+	    &stats->rx_pfil_dropped,
+	    "Packets dropped or consumed by the rx pfil hooks");
+	SYSCTL_ADD_U64(ctx, list, OID_AUTO,
+	    "rx_nic_queue_drops", CTLFLAG_RD,
+	    &rxq->nic_queue_drops, 0,
+	    "Packets the NIC dropped on this queue, from the stats report");
+	SYSCTL_ADD_U64(ctx, list, OID_AUTO,
+	    "rx_nic_no_buffers_drops", CTLFLAG_RD,
+	    &rxq->nic_no_buffers_drops, 0,
+	    "Packets the NIC dropped for lack of posted buffers");
+	SYSCTL_ADD_U64(ctx, list, OID_AUTO,
+	    "rx_nic_over_mru_drops", CTLFLAG_RD,
+	    &rxq->nic_over_mru_drops, 0,
+	    "Packets the NIC dropped for exceeding the MRU");
+	SYSCTL_ADD_U64(ctx, list, OID_AUTO,
+	    "rx_nic_bad_csum_drops", CTLFLAG_RD,
+	    &rxq->nic_bad_csum_drops, 0,
+	    "Packets the NIC dropped for an invalid checksum");
 	SYSCTL_ADD_U32(ctx, list, OID_AUTO,
 	    "rx_completed_desc", CTLFLAG_RD,
 	    &rxq->cnt, 0, "Number of descriptors completed");
@@ -106,6 +239,42 @@ gve_setup_rxq_sysctl(struct sysctl_ctx_list *ctx,
 	    "num_desc_posted", CTLFLAG_RD,
 	    &rxq->fill_cnt, rxq->fill_cnt,
 	    "Toal number of descriptors posted");
+	if (gve_is_gqi(rxq->com.priv))
+		SYSCTL_ADD_U32(ctx, list, OID_AUTO,
+		    "rx_spare_pages", CTLFLAG_RD,
+		    &rxq->num_spare_pages, 0,
+		    "Spare qpl pages that can stand in for a page that cannot flip");
+	SYSCTL_ADD_PROC(ctx, list, OID_AUTO, "rx_copybreak",
+	    CTLTYPE_UINT | CTLFLAG_RW | CTLFLAG_MPSAFE, &rxq->copybreak.override,
+	    GVE_RX_COPYBREAK_MAX, gve_sysctl_capped_u32, "IU",
+	    "Fixed copybreak threshold for this queue, 0 to adapt it");
+	SYSCTL_ADD_U32(ctx, list, OID_AUTO, "rx_copybreak_cur", CTLFLAG_RD,
+	    &rxq->copybreak.thresh, 0, "Copybreak threshold in use");
+
+	batch_node = SYSCTL_ADD_NODE(ctx, list, OID_AUTO, "rx_input_batch",
+	    CTLFLAG_RD | CTLFLAG_MPSAFE, NULL,
+	    "Histogram of packets passed to each if_input call");
+	batch_list = SYSCTL_CHILDREN(batch_node);
+	for (i = 0; i < GVE_RX_INPUT_BATCH_BUCKETS; i++) {
+		if (i == GVE_RX_INPUT_BATCH_BUCKETS - 1)
+			snprintf(namebuf, sizeof(namebuf), "%u_up", 1u << i);
+		else
+			snprintf(namebuf, sizeof(namebuf), "%u_%u", 1u << i,
+			    (2u << i) - 1);
+		SYSCTL_ADD_COUNTER_U64(ctx, batch_list, OID_AUTO, namebuf,
+		    CTLFLAG_RD, &stats->rx_input_batch[i],
+		    "if_input calls with this many packets");
+	}
+
+#ifdef GVE_HISTOGRAMS
+	gve_setup_hist_sysctl(ctx, list, "rx_cleanup_work",
+	    stats->rx_cleanup_work, "Histogram of completions per cleanup pass");
+	gve_setup_hist_sysctl(ctx, list, "rx_intr_delay_us",
+	    stats->rx_intr_delay_us,
+	    "Histogram of microseconds from interrupt to cleanup task");
+#endif
+
+	gve_setup_itr_sysctl(ctx, list, &rxq->com);
 }
 
 static void
@@ -151,6 +320,18 @@ gve_setup_txq_sysctl(struct sysctl_ctx_list *ctx,
 	    "tx_dropped_pkt_vlan", CTLFLAG_RD,
 	    &stats->tx_dropped_pkt_vlan,
 	    "Dropped VLAN packets");
+	SYSCTL_ADD_COUNTER_U64(ctx, tx_list, OID_AUTO,
+	    "tx_xmit_handoff", CTLFLAG_RD,
+	    &stats->tx_xmit_handoff,
+	    "Packets left on the br for the sender already draining it");
+	SYSCTL_ADD_COUNTER_U64(ctx, tx_list, OID_AUTO,
+	    "tx_doorbells", CTLFLAG_RD,
+	    &stats->tx_doorbells,
+	    "Doorbell writes, tx_packets over this is packets per doorbell");
+	SYSCTL_ADD_COUNTER_U64(ctx, tx_list, OID_AUTO,
+	    "tx_xmit_tq_deferred", CTLFLAG_RD,
+	    &stats->tx_xmit_tq_deferred,
+	    "br drains handed to the xmit taskqueue");
 	SYSCTL_ADD_COUNTER_U64(ctx, tx_list, OID_AUTO,
 	    "tx_delayed_pkt_nospace_descring", CTLFLAG_RD,
 	    &stats->tx_delayed_pkt_nospace_descring,
@@ -191,6 +372,38 @@ gve_setup_txq_sysctl(struct sysctl_ctx_list *ctx,
 	    "tx_timeout", CTLFLAG_RD,
 	    &stats->tx_timeout,
 	    "detections of timed out packets on tx queues");
+	SYSCTL_ADD_COUNTER_U64(ctx, tx_list, OID_AUTO,
+	    "tx_copied_bytes", CTLFLAG_RD,
+	    &stats->tx_copied_bytes,
+	    "Bytes copied into the queue page list");
+	SYSCTL_ADD_COUNTER_U64(ctx, tx_list, OID_AUTO,
+	    "tx_zerocopy_bytes", CTLFLAG_RD,
+	    &stats->tx_zerocopy_bytes,
+	    "Bytes the NIC read straight from dma-mapped mbufs");
+	SYSCTL_ADD_COUNTER_U64(ctx, tx_list, OID_AUTO,
+	    "tx_paced_pkt", CTLFLAG_RD,
+	    &stats->tx_paced_pkt,
+	    "Packets of rate-limited flows held back for pacing");
+	SYSCTL_ADD_COUNTER_U64(ctx, tx_list, OID_AUTO,
+	    "tx_dropped_pkt_pacing", CTLFLAG_RD,
+	    &stats->tx_dropped_pkt_pacing,
+	    "Packets dropped for lack of room in a send tag's pacing queue");
+
+#ifdef GVE_HISTOGRAMS
+	gve_setup_hist_sysctl(ctx, tx_list, "tx_cleanup_work",
+	    stats->tx_cleanup_work, "Histogram of completions per cleanup pass");
+	gve_setup_hist_sysctl(ctx, tx_list, "tx_intr_delay_us",
+	    stats->tx_intr_delay_us,
+	    "Histogram of microseconds from interrupt to cleanup task");
+	gve_setup_hist_sysctl(ctx, tx_list, "tx_compl_lat_us",
+	    stats->tx_compl_lat_us,
+	    "Histogram of microseconds from descriptor write to completion");
+	gve_setup_hist_sysctl(ctx, tx_list, "tx_br_occupancy",
+	    stats->tx_br_occupancy,
+	    "Histogram of mbufs already in the buf_ring at each enqueue");
+#endif
+
+	gve_setup_itr_sysctl(ctx, tx_list, &txq->com);
 }
 
 static void
@@ -267,14 +480,92 @@ gve_setup_adminq_stat_sysctl(struct sysctl_ctx_list *ctx,
 	    "adminq_verify_driver_compatibility_cnt", CTLFLAG_RD,
 	    &priv->adminq_verify_driver_compatibility_cnt, 0,
 	    "adminq_verify_driver_compatibility_cnt");
+	SYSCTL_ADD_U32(ctx, admin_list, OID_AUTO, "adminq_configure_rss_cnt",
+	    CTLFLAG_RD, &priv->adminq_configure_rss_cnt, 0,
+	    "adminq_configure_rss_cnt");
+	SYSCTL_ADD_U32(ctx, admin_list, OID_AUTO, "adminq_query_rss_cnt",
+	    CTLFLAG_RD, &priv->adminq_query_rss_cnt, 0,
+	    "adminq_query_rss_cnt");
+	SYSCTL_ADD_U32(ctx, admin_list, OID_AUTO, "adminq_report_stats_cnt",
+	    CTLFLAG_RD, &priv->adminq_report_stats_cnt, 0,
+	    "adminq_report_stats_cnt");
+	SYSCTL_ADD_U32(ctx, admin_list, OID_AUTO, "adminq_report_nic_ts_cnt",
+	    CTLFLAG_RD, &priv->adminq_report_nic_ts_cnt, 0,
+	    "adminq_report_nic_ts_cnt");
+}
+
+/*
+ * Sums the tx queue counter at offset off of gve_txq_stats over the active
+ * queues of one tx class.
+ */
+static int
+gve_sysctl_tx_class_stat(struct sysctl_oid *oidp, struct sysctl_req *req,
+    struct gve_priv *priv, bool ll, size_t off)
+{
+	uint32_t first, last, i;
+	counter_u64_t *counter;
+	uint64_t val = 0;
+
+	first = ll ? 0 : gve_tx_ll_queues(priv);
+	last = ll ? gve_tx_ll_queues(priv) : priv->tx_cfg.num_queues;
+	for (i = first; i < last; i++) {
+		counter = (counter_u64_t *)((char *)&priv->tx[i].stats + off);
+		val += counter_u64_fetch(*counter);
+	}
+
+	return (sysctl_handle_64(oidp, &val, 0, req));
+}
+
+static int
+gve_sysctl_tx_ll_stat(SYSCTL_HANDLER_ARGS)
+{
+	return (gve_sysctl_tx_class_stat(oidp, req, arg1, true, arg2));
+}
+
+static int
+gve_sysctl_tx_bulk_stat(SYSCTL_HANDLER_ARGS)
+{
+	return (gve_sysctl_tx_class_stat(oidp, req, arg1, false, arg2));
+}
+
+static void
+gve_setup_tx_class_sysctl(struct sysctl_ctx_list *ctx,
+    struct sysctl_oid_list *child, struct gve_priv *priv, const char *name,
+    const char *descr, int (*handler)(SYSCTL_HANDLER_ARGS))
+{
+	struct sysctl_oid *class_node;
+	struct sysctl_oid_list *class_list;
+
+	class_node = SYSCTL_ADD_NODE(ctx, child, OID_AUTO, name,
+	    CTLFLAG_RD | CTLFLAG_MPSAFE, NULL, descr);
+	class_list = SYSCTL_CHILDREN(class_node);
+
+	SYSCTL_ADD_PROC(ctx, class_list, OID_AUTO, "tpackets",
+	    CTLTYPE_U64 | CTLFLAG_RD | CTLFLAG_MPSAFE, priv,
+	    offsetof(struct gve_txq_stats, tpackets), handler, "QU",
+	    "Packets transmitted");
+	SYSCTL_ADD_PROC(ctx, class_list, OID_AUTO, "tbytes",
+	    CTLTYPE_U64 | CTLFLAG_RD | CTLFLAG_MPSAFE, priv,
+	    offsetof(struct gve_txq_stats, tbytes), handler, "QU",
+	    "Bytes transmitted");
+	SYSCTL_ADD_PROC(ctx, class_list, OID_AUTO, "tx_dropped_pkt",
+	    CTLTYPE_U64 | CTLFLAG_RD | CTLFLAG_MPSAFE, priv,
+	    offsetof(struct gve_txq_stats, tx_dropped_pkt), handler, "QU",
+	    "Packets dropped");
+	SYSCTL_ADD_PROC(ctx, class_list, OID_AUTO, "tx_doorbells",
+	    CTLTYPE_U64 | CTLFLAG_RD | CTLFLAG_MPSAFE, priv,
+	    offsetof(struct gve_txq_stats, tx_doorbells), handler, "QU",
+	    "Doorbells written");
 }
 
 static void
 gve_setup_main_stat_sysctl(struct sysctl_ctx_list *ctx,
     struct sysctl_oid_list *child, struct gve_priv *priv)
 {
-	struct sysctl_oid *main_node;
-	struct sysctl_oid_list *main_list;
+	struct sysctl_oid *main_node, *outage_node;
+	struct sysctl_oid_list *main_list, *outage_list;
+	char namebuf[16];
+	int i;
 
 	/* Main stats */
 	main_node = SYSCTL_ADD_NODE(ctx, child, OID_AUTO, "main_stats",
@@ -287,6 +578,26 @@ gve_setup_main_stat_sysctl(struct sysctl_ctx_list *ctx,
 	    &priv->interface_down_cnt, 0, "Times interface was set to down");
 	SYSCTL_ADD_U32(ctx, main_list, OID_AUTO, "reset_cnt", CTLFLAG_RD,
 	    &priv->reset_cnt, 0, "Times reset");
+	SYSCTL_ADD_U32(ctx, main_list, OID_AUTO, "reset_fast_cnt", CTLFLAG_RD,
+	    &priv->reset_fast_cnt, 0, "Times reset through the fast path");
+	SYSCTL_ADD_U32(ctx, main_list, OID_AUTO, "reset_last_outage_us",
+	    CTLFLAG_RD, &priv->reset_last_outage_us, 0,
+	    "Microseconds the link was down for during the last reset");
+
+	outage_node = SYSCTL_ADD_NODE(ctx, main_list, OID_AUTO,
+	    "reset_outage_ms", CTLFLAG_RD | CTLFLAG_MPSAFE, NULL,
+	    "Histogram of milliseconds the link was down for per reset");
+	outage_list = SYSCTL_CHILDREN(outage_node);
+	for (i = 0; i < GVE_RESET_OUTAGE_BUCKETS; i++) {
+		if (i == GVE_RESET_OUTAGE_BUCKETS - 1)
+			snprintf(namebuf, sizeof(namebuf), "%u_up", 1u << i);
+		else
+			snprintf(namebuf, sizeof(namebuf), "%u_%u",
+			    i == 0 ? 0 : 1u << i, (2u << i) - 1);
+		SYSCTL_ADD_U64(ctx, outage_list, OID_AUTO, namebuf,
+		    CTLFLAG_RD, &priv->reset_outage_ms[i], 0,
+		    "Resets with an outage in this range");
+	}
 }
 
 static int
@@ -435,6 +746,326 @@ gve_sysctl_rx_ring_size(SYSCTL_HANDLER_ARGS)
 	return (err);
 }
 
+/*
+ * Pushes priv->rss_config to the device if the queues are up, reverting the
+ * cached config to old_config if the device rejects it.
+ */
+static int
+gve_rss_apply(struct gve_priv *priv, const struct gve_rss_config *old_config)
+{
+	int err;
+
+	GVE_IFACE_LOCK_ASSERT(priv->gve_iface_lock);
+
+	if (!gve_get_state_flag(priv, GVE_STATE_FLAG_QUEUES_UP))
+		return (0);
+
+	err = gve_adminq_configure_rss(priv);
+	if (err != 0) {
+		device_printf(priv->dev,
+		    "Failed to configure RSS, err=%d\n", err);
+		priv->rss_config = *old_config;
+	}
+	return (err);
+}
+
+static int
+gve_sysctl_rss_key(SYSCTL_HANDLER_ARGS)
+{
+	struct gve_priv *priv = arg1;
+	struct gve_rss_config *old_config;
+	char buf[GVE_RSS_KEY_MAX_SIZE * 2 + 1];
+	uint8_t key[GVE_RSS_KEY_MAX_SIZE];
+	int key_size;
+	char hex[3];
+	char *end;
+	int err;
+	int i;
+
+	GVE_IFACE_LOCK_LOCK(priv->gve_iface_lock);
+	key_size = priv->rss_config.key_size;
+	for (i = 0; i < key_size; i++)
+		snprintf(&buf[i * 2], 3, "%02x", priv->rss_config.key[i]);
+	buf[key_size * 2] = '\0';
+	GVE_IFACE_LOCK_UNLOCK(priv->gve_iface_lock);
+
+	err = sysctl_handle_string(oidp, buf, sizeof(buf), req);
+	if (err != 0 || req->newptr == NULL)
+		return (err);
+
+	if (strlen(buf) != key_size * 2) {
+		device_printf(priv->dev,
+		    "RSS key must be %d hex digits\n", key_size * 2);
+		return (EINVAL);
+	}
+
+	hex[2] = '\0';
+	for (i = 0; i < key_size; i++) {
+		hex[0] = buf[i * 2];
+		hex[1] = buf[i * 2 + 1];
+		key[i] = strtoul(hex, &end, 16);
+		if (*end != '\0')
+			return (EINVAL);
+	}
+
+	old_config = malloc(sizeof(*old_config), M_GVE, M_WAITOK);
+	GVE_IFACE_LOCK_LOCK(priv->gve_iface_lock);
+	*old_config = priv->rss_config;
+	memcpy(priv->rss_config.key, key, key_size);
+	err = gve_rss_apply(priv, old_config);
+	GVE_IFACE_LOCK_UNLOCK(priv->gve_iface_lock);
+	free(old_config, M_GVE);
+
+	return (err);
+}
+
+static int
+gve_sysctl_rss_indir(SYSCTL_HANDLER_ARGS)
+{
+	struct gve_priv *priv = arg1;
+	struct gve_rss_config *old_config;
+	uint16_t lut[GVE_RSS_LUT_MAX_SIZE];
+	size_t buflen;
+	int lut_size;
+	u_long qid;
+	char *buf;
+	char *pos;
+	char *end;
+	int err;
+	int i;
+
+	/* Each entry is at most a 5 digit queue id and a separator */
+	buflen = GVE_RSS_LUT_MAX_SIZE * 6 + 1;
+	buf = malloc(buflen, M_GVE, M_WAITOK | M_ZERO);
+
+	GVE_IFACE_LOCK_LOCK(priv->gve_iface_lock);
+	lut_size = priv->rss_config.lut_size;
+	pos = buf;
+	for (i = 0; i < lut_size; i++)
+		pos += snprintf(pos, buflen - (pos - buf), i == 0 ? "%u" : " %u",
+		    priv->rss_config.lut[i]);
+	GVE_IFACE_LOCK_UNLOCK(priv->gve_iface_lock);
+
+	err = sysctl_handle_string(oidp, buf, buflen, req);
+	if (err != 0 || req->newptr == NULL)
+		goto free_buf;
+
+	pos = buf;
+	for (i = 0; i < lut_size; i++) {
+		qid = strtoul(pos, &end, 10);
+		if (end == pos || qid > UINT16_MAX) {
+			device_printf(priv->dev,
+			    "RSS indirection table needs %d queue ids\n",
+			    lut_size);
+			err = EINVAL;
+			goto free_buf;
+		}
+		lut[i] = qid;
+		pos = end;
+	}
+
+	old_config = malloc(sizeof(*old_config), M_GVE, M_WAITOK);
+	GVE_IFACE_LOCK_LOCK(priv->gve_iface_lock);
+	for (i = 0; i < lut_size; i++) {
+		if (lut[i] >= priv->rx_cfg.num_queues) {
+			device_printf(priv->dev,
+			    "RSS indirection entry %d (%u) is not an rx queue\n",
+			    i, lut[i]);
+			err = EINVAL;
+			break;
+		}
+	}
+	if (err == 0) {
+		*old_config = priv->rss_config;
+		memcpy(priv->rss_config.lut, lut, lut_size * sizeof(*lut));
+		err = gve_rss_apply(priv, old_config);
+	}
+	GVE_IFACE_LOCK_UNLOCK(priv->gve_iface_lock);
+	free(old_config, M_GVE);
+
+free_buf:
+	free(buf, M_GVE);
+	return (err);
+}
+
+static int
+gve_sysctl_rss_hash_types(SYSCTL_HANDLER_ARGS)
+{
+	struct gve_priv *priv = arg1;
+	struct gve_rss_config *old_config;
+	u_int val;
+	int err;
+
+	val = priv->rss_config.hash_types;
+	err = sysctl_handle_int(oidp, &val, 0, req);
+	if (err != 0 || req->newptr == NULL)
+		return (err);
+
+	if ((val & ~GVE_RSS_HASH_TYPES_ALL) != 0) {
+		device_printf(priv->dev,
+		    "Unsupported RSS hash types 0x%x\n",
+		    val & ~GVE_RSS_HASH_TYPES_ALL);
+		return (EINVAL);
+	}
+
+	old_config = malloc(sizeof(*old_config), M_GVE, M_WAITOK);
+	GVE_IFACE_LOCK_LOCK(priv->gve_iface_lock);
+	*old_config = priv->rss_config;
+	priv->rss_config.hash_types = val;
+	err = gve_rss_apply(priv, old_config);
+	GVE_IFACE_LOCK_UNLOCK(priv->gve_iface_lock);
+	free(old_config, M_GVE);
+
+	return (err);
+}
+
+static void
+gve_setup_rss_sysctl(struct sysctl_ctx_list *ctx,
+    struct sysctl_oid_list *child, struct gve_priv *priv)
+{
+	struct sysctl_oid *rss_node;
+	struct sysctl_oid_list *rss_list;
+
+	if (!priv->rss_config_enabled)
+		return;
+
+	rss_node = SYSCTL_ADD_NODE(ctx, child, OID_AUTO, "rss",
+	    CTLFLAG_RD | CTLFLAG_MPSAFE, NULL, "RSS configuration");
+	rss_list = SYSCTL_CHILDREN(rss_node);
+
+	SYSCTL_ADD_PROC(ctx, rss_list, OID_AUTO, "key",
+	    CTLTYPE_STRING | CTLFLAG_RW | CTLFLAG_MPSAFE, priv, 0,
+	    gve_sysctl_rss_key, "A", "Toeplitz hash key in hex");
+	SYSCTL_ADD_PROC(ctx, rss_list, OID_AUTO, "indir",
+	    CTLTYPE_STRING | CTLFLAG_RW | CTLFLAG_MPSAFE, priv, 0,
+	    gve_sysctl_rss_indir, "A",
+	    "Space separated rx queue ids, one per indirection table entry");
+	SYSCTL_ADD_PROC(ctx, rss_list, OID_AUTO, "hash_types",
+	    CTLTYPE_UINT | CTLFLAG_RW | CTLFLAG_MPSAFE, priv, 0,
+	    gve_sysctl_rss_hash_types, "IU", "Bitmask of hashed packet types");
+	SYSCTL_ADD_U16(ctx, rss_list, OID_AUTO, "key_size", CTLFLAG_RD,
+	    &priv->rss_config.key_size, 0, "RSS key size in bytes");
+	SYSCTL_ADD_U16(ctx, rss_list, OID_AUTO, "indir_size", CTLFLAG_RD,
+	    &priv->rss_config.lut_size, 0, "RSS indirection table size");
+}
+
+/*
+ * Handles the LRO knob at offset arg2 into priv. The rx rings set up LRO as
+ * they start, so running queues are restarted to apply it.
+ */
+static int
+gve_sysctl_lro_param(SYSCTL_HANDLER_ARGS)
+{
+	struct gve_priv *priv = arg1;
+	uint32_t *knob = (uint32_t *)((char *)priv + arg2);
+	u_int val;
+	int err;
+
+	val = *knob;
+	err = sysctl_handle_int(oidp, &val, 0, req);
+	if (err != 0 || req->newptr == NULL)
+		return (err);
+
+	if (val > GVE_LRO_PARAM_MAX)
+		return (EINVAL);
+
+	GVE_IFACE_LOCK_LOCK(priv->gve_iface_lock);
+	if (val != *knob) {
+		*knob = val;
+		if (gve_get_state_flag(priv, GVE_STATE_FLAG_QUEUES_UP) &&
+		    (if_getcapenable(priv->ifp) & IFCAP_LRO) != 0) {
+			gve_down(priv);
+			err = gve_up(priv);
+		}
+	}
+	GVE_IFACE_LOCK_UNLOCK(priv->gve_iface_lock);
+
+	return (err);
+}
+
+static int
+gve_sysctl_header_split(SYSCTL_HANDLER_ARGS)
+{
+	struct gve_priv *priv = arg1;
+	int val;
+	int err;
+
+	val = priv->header_split_enabled;
+	err = sysctl_handle_int(oidp, &val, 0, req);
+	if (err != 0 || req->newptr == NULL)
+		return (err);
+
+	if (val != 0 && val != 1)
+		return (EINVAL);
+
+	GVE_IFACE_LOCK_LOCK(priv->gve_iface_lock);
+	if (val != priv->header_split_enabled)
+		err = gve_set_header_split(priv, val);
+	GVE_IFACE_LOCK_UNLOCK(priv->gve_iface_lock);
+
+	return (err);
+}
+
+static int
+gve_sysctl_queue_cpus(SYSCTL_HANDLER_ARGS)
+{
+	struct gve_priv *priv = arg1;
+	int num_queues = MAX(priv->tx_cfg.max_queues, priv->rx_cfg.max_queues);
+	size_t buflen;
+	u_long cpu;
+	char *buf;
+	char *pos;
+	char *end;
+	int *cpus;
+	int err;
+	int i;
+
+	/* Each entry is at most a 5 digit cpu id and a separator */
+	buflen = num_queues * 6 + 1;
+	buf = malloc(buflen, M_GVE, M_WAITOK | M_ZERO);
+	cpus = malloc(sizeof(*cpus) * num_queues, M_GVE, M_WAITOK);
+
+	GVE_IFACE_LOCK_LOCK(priv->gve_iface_lock);
+	pos = buf;
+	for (i = 0; i < num_queues; i++)
+		pos += snprintf(pos, buflen - (pos - buf), i == 0 ? "%d" : " %d",
+		    priv->queue_cpus[i]);
+	GVE_IFACE_LOCK_UNLOCK(priv->gve_iface_lock);
+
+	err = sysctl_handle_string(oidp, buf, buflen, req);
+	if (err != 0 || req->newptr == NULL)
+		goto abort;
+
+	pos = buf;
+	for (i = 0; i < num_queues; i++) {
+		cpu = strtoul(pos, &end, 10);
+		if (end == pos || cpu > mp_maxid || CPU_ABSENT(cpu)) {
+			device_printf(priv->dev,
+			    "Queue cpus must list %d present cpus\n",
+			    num_queues);
+			err = EINVAL;
+			goto abort;
+		}
+		cpus[i] = cpu;
+		pos = end;
+	}
+
+	GVE_IFACE_LOCK_LOCK(priv->gve_iface_lock);
+	memcpy(priv->queue_cpus, cpus, sizeof(*cpus) * num_queues);
+	gve_update_cpu_txq(priv);
+	/* Restarting the queues rebinds their irqs and taskqueues */
+	if (gve_get_state_flag(priv, GVE_STATE_FLAG_QUEUES_UP)) {
+		gve_down(priv);
+		err = gve_up(priv);
+	}
+	GVE_IFACE_LOCK_UNLOCK(priv->gve_iface_lock);
+
+abort:
+	free(cpus, M_GVE);
+	free(buf, M_GVE);
+	return (err);
+}
+
 static void
 gve_setup_sysctl_writables(struct sysctl_ctx_list *ctx,
     struct sysctl_oid_list *child, struct gve_priv *priv)
@@ -447,6 +1078,55 @@ gve_setup_sysctl_writables(struct sysctl_ctx_list *ctx,
 	    CTLTYPE_UINT | CTLFLAG_RW | CTLFLAG_MPSAFE, priv, 0,
 	    gve_sysctl_num_rx_queues, "I", "Number of RX queues");
 
+	SYSCTL_ADD_PROC(ctx, child, OID_AUTO, "lro_entries",
+	    CTLTYPE_UINT | CTLFLAG_RW | CTLFLAG_MPSAFE, priv,
+	    offsetof(struct gve_priv, lro_entries), gve_sysctl_lro_param, "IU",
+	    "LRO entries per RX queue, 0 for the kernel default");
+
+	SYSCTL_ADD_PROC(ctx, child, OID_AUTO, "lro_mbufs",
+	    CTLTYPE_UINT | CTLFLAG_RW | CTLFLAG_MPSAFE, priv,
+	    offsetof(struct gve_priv, lro_mbufs), gve_sysctl_lro_param, "IU",
+	    "Depth of the per-queue queue that sorts packets by flow before LRO");
+
+	SYSCTL_ADD_PROC(ctx, child, OID_AUTO, "tx_db_batch_pkts",
+	    CTLTYPE_UINT | CTLFLAG_RW | CTLFLAG_MPSAFE, &priv->tx_db_batch_pkts,
+	    GVE_TX_DB_BATCH_MAX_PKTS, gve_sysctl_capped_u32, "IU",
+	    "Packets queued on a tx ring before its doorbell is forced");
+
+	SYSCTL_ADD_PROC(ctx, child, OID_AUTO, "tx_db_batch_bytes",
+	    CTLTYPE_UINT | CTLFLAG_RW | CTLFLAG_MPSAFE, &priv->tx_db_batch_bytes,
+	    GVE_TX_DB_BATCH_MAX_BYTES, gve_sysctl_capped_u32, "IU",
+	    "Bytes queued on a tx ring before its doorbell is forced");
+
+	SYSCTL_ADD_PROC(ctx, child, OID_AUTO, "tx_ll_queues",
+	    CTLTYPE_UINT | CTLFLAG_RW | CTLFLAG_MPSAFE, &priv->tx_ll_queues,
+	    priv->tx_cfg.max_queues - 1, gve_sysctl_capped_u32, "IU",
+	    "Leading tx queues reserved for low-latency traffic, 0 for none");
+
+	SYSCTL_ADD_U32(ctx, child, OID_AUTO, "tx_ll_max_len", CTLFLAG_RW,
+	    &priv->tx_ll_max_len, 0,
+	    "Largest non-TSO packet sent on the low-latency tx queues, 0 for none");
+
+	SYSCTL_ADD_U64(ctx, child, OID_AUTO, "tx_ll_dscp_mask", CTLFLAG_RW,
+	    &priv->tx_ll_dscp_mask, 0,
+	    "Bitmap of the DSCPs sent on the low-latency tx queues");
+
+	SYSCTL_ADD_BOOL(ctx, child, OID_AUTO, "fast_reset", CTLFLAG_RW,
+	    &priv->fast_reset, 0,
+	    "Reuse the adminq, ring taskqueues and LRO state across resets");
+
+	SYSCTL_ADD_PROC(ctx, child, OID_AUTO, "queue_cpus",
+	    CTLTYPE_STRING | CTLFLAG_RW | CTLFLAG_MPSAFE, priv, 0,
+	    gve_sysctl_queue_cpus, "A",
+	    "Space separated cpu of each rx/tx queue pair");
+
+	if (priv->header_split_supported) {
+		SYSCTL_ADD_PROC(ctx, child, OID_AUTO, "header_split",
+		    CTLTYPE_INT | CTLFLAG_RW | CTLFLAG_MPSAFE, priv, 0,
+		    gve_sysctl_header_split, "I",
+		    "Receive packet headers into a separate small buffer");
+	}
+
 	if (priv->modify_ringsize_enabled) {
 		SYSCTL_ADD_PROC(ctx, child, OID_AUTO, "tx_ring_size",
 		    CTLTYPE_UINT | CTLFLAG_RW | CTLFLAG_MPSAFE, priv, 0,
@@ -473,7 +1153,12 @@ void gve_setup_sysctl(struct gve_priv *priv)
 	gve_setup_queue_stat_sysctl(ctx, child, priv);
 	gve_setup_adminq_stat_sysctl(ctx, child, priv);
 	gve_setup_main_stat_sysctl(ctx, child, priv);
+	gve_setup_tx_class_sysctl(ctx, child, priv, "tx_ll",
+	    "Low-latency tx queue class statistics", gve_sysctl_tx_ll_stat);
+	gve_setup_tx_class_sysctl(ctx, child, priv, "tx_bulk",
+	    "Bulk tx queue class statistics", gve_sysctl_tx_bulk_stat);
 	gve_setup_sysctl_writables(ctx, child, priv);
+	gve_setup_rss_sysctl(ctx, child, priv);
 }
 
 void
@@ -28,6 +28,10 @@
  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#include "opt_netmap.h"
+#include "opt_ratelimit.h"
+#include "opt_rss.h"
+
 #include "gve.h"
 #include "gve_adminq.h"
 #include "gve_dqo.h"
@@ -76,6 +80,16 @@ gve_tx_free_ring(struct gve_priv *priv, int i)
 	struct gve_tx_ring *tx = &priv->tx[i];
 	struct gve_ring_com *com = &tx->com;
 
+	/* Left behind by a fast reset that failed to bring the ring back up */
+	if (com->cleanup_tq != NULL) {
+		taskqueue_free(com->cleanup_tq);
+		com->cleanup_tq = NULL;
+	}
+	if (tx->xmit_tq != NULL) {
+		taskqueue_free(tx->xmit_tq);
+		tx->xmit_tq = NULL;
+	}
+
 	/* Safe to call even if never alloced */
 	gve_free_counters((counter_u64_t *)&tx->stats, NUM_TX_STATS);
 
@@ -190,6 +204,12 @@ gve_alloc_tx_rings(struct gve_priv *priv, uint16_t start_idx, uint16_t stop_idx)
 
 	KASSERT(priv->tx != NULL, ("priv->tx is NULL!"));
 
+	/* Same shape as the gve_alloc_qpl calls made by the ring allocation */
+	if (gve_is_qpl(priv) && stop_idx > start_idx)
+		gve_prealloc_qpls(priv, start_idx, stop_idx - start_idx,
+		    gve_is_gqi(priv) ? priv->tx_desc_cnt / GVE_QPL_DIVISOR :
+		    GVE_TX_NUM_QPL_PAGES_DQO, /*single_kva=*/gve_is_gqi(priv));
+
 	for (i = start_idx; i < stop_idx; i++) {
 		err = gve_tx_alloc_ring(priv, i);
 		if (err != 0)
@@ -248,50 +268,64 @@ gve_start_tx_ring(struct gve_priv *priv, int i)
 {
 	struct gve_tx_ring *tx = &priv->tx[i];
 	struct gve_ring_com *com = &tx->com;
+	cpuset_t cpuset;
 
 	atomic_store_8(&tx->stopped, 0);
-	if (gve_is_gqi(priv))
-		NET_TASK_INIT(&com->cleanup_task, 0, gve_tx_cleanup_tq, tx);
-	else
-		NET_TASK_INIT(&com->cleanup_task, 0, gve_tx_cleanup_tq_dqo, tx);
-	com->cleanup_tq = taskqueue_create_fast("gve tx", M_WAITOK,
-	    taskqueue_thread_enqueue, &com->cleanup_tq);
-	taskqueue_start_threads(&com->cleanup_tq, 1, PI_NET, "%s txq %d",
-	    device_get_nameunit(priv->dev), i);
+	atomic_store_32(&tx->xmit_pending, 0);
+	/* Both tqs are kept across a fast reset */
+	CPU_SETOF(priv->queue_cpus[i], &cpuset);
+	if (com->cleanup_tq == NULL) {
+		if (gve_is_gqi(priv))
+			NET_TASK_INIT(&com->cleanup_task, 0, gve_tx_cleanup_tq, tx);
+		else
+			NET_TASK_INIT(&com->cleanup_task, 0,
+			    gve_tx_cleanup_tq_dqo, tx);
+		com->cleanup_tq = taskqueue_create_fast("gve tx", M_WAITOK,
+		    taskqueue_thread_enqueue, &com->cleanup_tq);
+		taskqueue_start_threads_cpuset(&com->cleanup_tq, 1, PI_NET,
+		    &cpuset, "%s txq %d", device_get_nameunit(priv->dev), i);
+	}
+
+	if (tx->xmit_tq == NULL) {
+		TASK_INIT(&tx->xmit_task, 0, gve_xmit_tq, tx);
+		tx->xmit_tq = taskqueue_create_fast("gve tx xmit",
+		    M_WAITOK, taskqueue_thread_enqueue, &tx->xmit_tq);
+		taskqueue_start_threads_cpuset(&tx->xmit_tq, 1, PI_NET,
+		    &cpuset, "%s txq %d xmit", device_get_nameunit(priv->dev),
+		    i);
+	}
+	gve_bind_queue(priv, com);
 
-	TASK_INIT(&tx->xmit_task, 0, gve_xmit_tq, tx);
-	tx->xmit_tq = taskqueue_create_fast("gve tx xmit",
-	    M_WAITOK, taskqueue_thread_enqueue, &tx->xmit_tq);
-	taskqueue_start_threads(&tx->xmit_tq, 1, PI_NET, "%s txq %d xmit",
-	    device_get_nameunit(priv->dev), i);
+#ifdef DEV_NETMAP
+	gve_netmap_reset_ring(priv, i, /*is_rx=*/false);
+#endif
 }
 
+/* Creates and starts the tx rings in [start_idx, stop_idx), already allocated. */
 int
-gve_create_tx_rings(struct gve_priv *priv)
+gve_create_tx_ring_range(struct gve_priv *priv, uint16_t start_idx,
+    uint16_t stop_idx)
 {
 	struct gve_ring_com *com;
 	struct gve_tx_ring *tx;
 	int err;
 	int i;
 
-	if (gve_get_state_flag(priv, GVE_STATE_FLAG_TX_RINGS_OK))
-		return (0);
-
-	for (i = 0; i < priv->tx_cfg.num_queues; i++) {
+	for (i = start_idx; i < stop_idx; i++) {
 		if (gve_is_gqi(priv))
 			gve_clear_tx_ring(priv, i);
 		else
 			gve_clear_tx_ring_dqo(priv, i);
 	}
 
-	err = gve_adminq_create_tx_queues(priv, priv->tx_cfg.num_queues);
+	err = gve_adminq_create_tx_queues(priv, start_idx, stop_idx);
 	if (err != 0)
 		return (err);
 
 	bus_dmamap_sync(priv->irqs_db_mem.tag, priv->irqs_db_mem.map,
 	    BUS_DMASYNC_POSTREAD);
 
-	for (i = 0; i < priv->tx_cfg.num_queues; i++) {
+	for (i = start_idx; i < stop_idx; i++) {
 		tx = &priv->tx[i];
 		com = &tx->com;
 
@@ -305,6 +339,21 @@ gve_create_tx_rings(struct gve_priv *priv)
 		gve_start_tx_ring(priv, i);
 	}
 
+	return (0);
+}
+
+int
+gve_create_tx_rings(struct gve_priv *priv)
+{
+	int err;
+
+	if (gve_get_state_flag(priv, GVE_STATE_FLAG_TX_RINGS_OK))
+		return (0);
+
+	err = gve_create_tx_ring_range(priv, 0, priv->tx_cfg.num_queues);
+	if (err != 0)
+		return (err);
+
 	gve_set_state_flag(priv, GVE_STATE_FLAG_TX_RINGS_OK);
 	return (0);
 }
@@ -315,19 +364,48 @@ gve_stop_tx_ring(struct gve_priv *priv, int i)
 	struct gve_tx_ring *tx = &priv->tx[i];
 	struct gve_ring_com *com = &tx->com;
 
+	if (com->cleanup_tq != NULL)
+		gve_itr_stop(com);
+	if (tx->xmit_tq != NULL)
+		taskqueue_quiesce(tx->xmit_tq);
+
+	/* A fast reset starts the ring straight back up on the same tqs */
+	if (gve_get_state_flag(priv, GVE_STATE_FLAG_FAST_RESET))
+		return;
+
 	if (com->cleanup_tq != NULL) {
-		taskqueue_quiesce(com->cleanup_tq);
 		taskqueue_free(com->cleanup_tq);
 		com->cleanup_tq = NULL;
 	}
-
 	if (tx->xmit_tq != NULL) {
-		taskqueue_quiesce(tx->xmit_tq);
 		taskqueue_free(tx->xmit_tq);
 		tx->xmit_tq = NULL;
 	}
 }
 
+/*
+ * Stops and destroys the tx rings in [start_idx, stop_idx), leaving them
+ * allocated. Senders must no longer be able to pick these rings, so the mbufs
+ * still on their brs are dropped.
+ */
+int
+gve_destroy_tx_ring_range(struct gve_priv *priv, uint16_t start_idx,
+    uint16_t stop_idx)
+{
+	struct gve_tx_ring *tx;
+	int i;
+
+	for (i = start_idx; i < stop_idx; i++) {
+		tx = &priv->tx[i];
+		gve_stop_tx_ring(priv, i);
+		GVE_RING_LOCK(tx);
+		drbr_flush(priv->ifp, tx->br);
+		GVE_RING_UNLOCK(tx);
+	}
+
+	return (gve_adminq_destroy_tx_queues(priv, start_idx, stop_idx));
+}
+
 int
 gve_destroy_tx_rings(struct gve_priv *priv)
 {
@@ -338,7 +416,8 @@ gve_destroy_tx_rings(struct gve_priv *priv)
 		gve_stop_tx_ring(priv, i);
 
 	if (gve_get_state_flag(priv, GVE_STATE_FLAG_TX_RINGS_OK)) {
-		err = gve_adminq_destroy_tx_queues(priv, priv->tx_cfg.num_queues);
+		err = gve_adminq_destroy_tx_queues(priv, 0,
+		    priv->tx_cfg.num_queues);
 		if (err != 0)
 			return (err);
 		gve_clear_state_flag(priv, GVE_STATE_FLAG_TX_RINGS_OK);
@@ -382,6 +461,9 @@ gve_tx_intr(void *arg)
 		return (FILTER_STRAY);
 
 	gve_db_bar_write_4(priv, com->irq_db_offset, GVE_IRQ_MASK);
+#ifdef GVE_HISTOGRAMS
+	com->intr_time = sbinuptime();
+#endif
 	taskqueue_enqueue(com->cleanup_tq, &com->cleanup_task);
 	return (FILTER_HANDLED);
 }
@@ -401,6 +483,35 @@ gve_tx_free_fifo(struct gve_tx_fifo *fifo, size_t bytes)
 	atomic_add_int(&fifo->available, bytes);
 }
 
+/* Returns the fifo space held by the packet whose first desc owns info. */
+static size_t
+gve_tx_release_iovs(struct gve_tx_buffer_state *info)
+{
+	size_t space_freed = 0;
+	int i;
+
+	for (i = 0; i < GVE_TX_MAX_DESCS; i++) {
+		space_freed += info->iov[i].iov_len + info->iov[i].iov_padding;
+		info->iov[i].iov_len = 0;
+		info->iov[i].iov_padding = 0;
+	}
+
+	return (space_freed);
+}
+
+/* Spins for new completions while busy-polling, returning true if any came. */
+static bool
+gve_tx_busy_poll(struct gve_priv *priv, struct gve_tx_ring *tx)
+{
+	sbintime_t deadline = 0;
+
+	while (gve_busy_poll_spin(&tx->com, &deadline)) {
+		if (gve_tx_load_event_counter(priv, tx) != tx->done)
+			return (true);
+	}
+	return (false);
+}
+
 void
 gve_tx_cleanup_tq(void *arg, int pending)
 {
@@ -409,11 +520,28 @@ gve_tx_cleanup_tq(void *arg, int pending)
 	uint32_t nic_done = gve_tx_load_event_counter(priv, tx);
 	uint32_t todo = nic_done - tx->done;
 	size_t space_freed = 0;
-	int i, j;
+	uint32_t usecs;
+	int j;
 
 	if (__predict_false((if_getdrvflags(priv->ifp) & IFF_DRV_RUNNING) == 0))
 		return;
 
+#ifdef GVE_HISTOGRAMS
+	gve_hist_intr_delay(&tx->com, tx->stats.tx_intr_delay_us);
+#endif
+
+#ifdef DEV_NETMAP
+	if (gve_netmap_tx_irq(tx)) {
+		gve_db_bar_write_4(priv, tx->com.irq_db_offset,
+		    GVE_IRQ_ACK | GVE_IRQ_EVENT);
+		atomic_thread_fence_seq_cst();
+		/* Completions that raced the ack will not interrupt */
+		if (gve_tx_load_event_counter(priv, tx) != nic_done)
+			gve_netmap_tx_irq(tx);
+		return;
+	}
+#endif
+
 	for (j = 0; j < todo; j++) {
 		uint32_t idx = tx->done & tx->mask;
 		struct gve_tx_buffer_state *info = &tx->info[idx];
@@ -424,6 +552,10 @@ gve_tx_cleanup_tq(void *arg, int pending)
 			continue;
 
 		gve_invalidate_timestamp(&info->enqueue_time_sec);
+#ifdef GVE_HISTOGRAMS
+		gve_hist_add(tx->stats.tx_compl_lat_us,
+		    sbttous(sbinuptime() - info->xmit_time));
+#endif
 
 		info->mbuf = NULL;
 
@@ -433,30 +565,43 @@ gve_tx_cleanup_tq(void *arg, int pending)
 		counter_exit();
 		m_freem(mbuf);
 
-		for (i = 0; i < GVE_TX_MAX_DESCS; i++) {
-			space_freed += info->iov[i].iov_len + info->iov[i].iov_padding;
-			info->iov[i].iov_len = 0;
-			info->iov[i].iov_padding = 0;
-		}
+		space_freed += gve_tx_release_iovs(info);
 	}
 
 	gve_tx_free_fifo(&tx->fifo, space_freed);
+#ifdef GVE_HISTOGRAMS
+	gve_hist_add(tx->stats.tx_cleanup_work, todo);
+#endif
 
-	gve_db_bar_write_4(priv, tx->com.irq_db_offset,
-	    GVE_IRQ_ACK | GVE_IRQ_EVENT);
-
-	/*
-	 * Completions born before this barrier MAY NOT cause the NIC to send an
-	 * interrupt but they will still be handled by the enqueue below.
-	 * Completions born after the barrier WILL trigger an interrupt.
-	 */
-	atomic_thread_fence_seq_cst();
-
-	nic_done = gve_tx_load_event_counter(priv, tx);
-	todo = nic_done - tx->done;
-	if (todo != 0) {
-		gve_db_bar_write_4(priv, tx->com.irq_db_offset, GVE_IRQ_MASK);
+	usecs = gve_itr_rearm_usecs(&tx->com, todo, tx->stats.tpackets,
+	    tx->stats.tbytes);
+	if (gve_tx_busy_poll(priv, tx)) {
 		taskqueue_enqueue(tx->com.cleanup_tq, &tx->com.cleanup_task);
+		atomic_thread_fence_seq_cst();
+	} else if (todo != 0 && usecs != 0) {
+		/* Leave the irq masked and batch completions meanwhile */
+		gve_itr_schedule_poll(&tx->com, usecs);
+		atomic_thread_fence_seq_cst();
+	} else {
+		gve_db_bar_write_4(priv, tx->com.irq_db_offset,
+		    GVE_IRQ_ACK | GVE_IRQ_EVENT);
+
+		/*
+		 * Completions born before this barrier MAY NOT cause the NIC
+		 * to send an interrupt but they will still be handled by the
+		 * enqueue below. Completions born after the barrier WILL
+		 * trigger an interrupt.
+		 */
+		atomic_thread_fence_seq_cst();
+
+		nic_done = gve_tx_load_event_counter(priv, tx);
+		todo = nic_done - tx->done;
+		if (todo != 0) {
+			gve_db_bar_write_4(priv, tx->com.irq_db_offset,
+			    GVE_IRQ_MASK);
+			taskqueue_enqueue(tx->com.cleanup_tq,
+			    &tx->com.cleanup_task);
+		}
 	}
 
 	if (atomic_load_8(&tx->stopped) && space_freed) {
@@ -638,7 +783,9 @@ gve_xmit(struct gve_tx_ring *tx, struct mbuf *mbuf)
 	struct gve_tx_mtd_desc *mtd_desc;
 	struct gve_tx_buffer_state *info;
 	uint32_t idx = tx->req & tx->mask;
+	struct ether_vlan_header *evl;
 	struct ether_header *eh;
+	uint16_t etype;
 	struct mbuf *mbuf_next;
 	int payload_iov = 2;
 	int bytes_required;
@@ -659,11 +806,15 @@ gve_xmit(struct gve_tx_ring *tx, struct mbuf *mbuf)
 	tso_mss = is_tso ? mbuf->m_pkthdr.tso_segsz : 0;
 
 	eh = mtod(mbuf, struct ether_header *);
-	KASSERT(eh->ether_type != ETHERTYPE_VLAN,
-	    ("VLAN-tagged packets not supported"));
-
-	is_ipv6 = ntohs(eh->ether_type) == ETHERTYPE_IPV6;
+	etype = ntohs(eh->ether_type);
 	l3_off = ETHER_HDR_LEN;
+	if (etype == ETHERTYPE_VLAN) {
+		evl = mtod(mbuf, struct ether_vlan_header *);
+		etype = ntohs(evl->evl_proto);
+		l3_off += ETHER_VLAN_ENCAP_LEN;
+	}
+
+	is_ipv6 = etype == ETHERTYPE_IPV6;
 	mbuf_next = m_getptr(mbuf, l3_off, &offset);
 
 	if (is_ipv6) {
@@ -672,7 +823,7 @@ gve_xmit(struct gve_tx_ring *tx, struct mbuf *mbuf)
 		is_tcp = (ip6->ip6_nxt == IPPROTO_TCP);
 		is_udp = (ip6->ip6_nxt == IPPROTO_UDP);
 		mbuf_next = m_getptr(mbuf, l4_off, &offset);
-	} else if (ntohs(eh->ether_type) == ETHERTYPE_IP) {
+	} else if (etype == ETHERTYPE_IP) {
 		ip = (struct ip *)(mtodo(mbuf_next, offset));
 		l4_off = l3_off + (ip->ip_hl << 2);
 		is_tcp = (ip->ip_p == IPPROTO_TCP);
@@ -716,6 +867,9 @@ gve_xmit(struct gve_tx_ring *tx, struct mbuf *mbuf)
 	info->mbuf = mbuf;
 
 	gve_set_timestamp(&info->enqueue_time_sec);
+#ifdef GVE_HISTOGRAMS
+	info->xmit_time = sbinuptime();
+#endif
 
 	/*
 	 * We don't want to split the header, so if necessary, pad to the end
@@ -762,30 +916,56 @@ gve_xmit(struct gve_tx_ring *tx, struct mbuf *mbuf)
 	}
 
 	tx->req += (1 + mtd_desc_nr + payload_nfrags);
-	if (is_tso) {
-		counter_enter();
+	counter_enter();
+	counter_u64_add_protected(tx->stats.tx_copied_bytes, pkt_len);
+	if (is_tso)
 		counter_u64_add_protected(tx->stats.tso_packet_cnt, 1);
-		counter_exit();
-	}
+	counter_exit();
 	return (0);
 }
 
+/* The ring's next free descriptor, which the xmit functions advance */
+static inline uint32_t
+gve_xmit_desc_idx(struct gve_tx_ring *tx)
+{
+	if (gve_is_gqi(tx->com.priv))
+		return (tx->req);
+	return (tx->dqo.desc_tail);
+}
+
+static inline uint32_t
+gve_xmit_descs_since(struct gve_tx_ring *tx, uint32_t desc_idx)
+{
+	if (gve_is_gqi(tx->com.priv))
+		return (tx->req - desc_idx);
+	return ((tx->dqo.desc_tail - desc_idx) & tx->dqo.desc_mask);
+}
+
 static int
 gve_xmit_mbuf(struct gve_tx_ring *tx,
     struct mbuf **mbuf)
 {
-	if (gve_is_gqi(tx->com.priv))
-		return (gve_xmit(tx, *mbuf));
+	uint32_t desc_idx = gve_xmit_desc_idx(tx);
+	int err;
 
-	if (gve_is_qpl(tx->com.priv))
-		return (gve_xmit_dqo_qpl(tx, *mbuf));
+	SDT_PROBE2(gve, , tx, xmit__start, tx, *mbuf);
 
-	/*
-	 * gve_xmit_dqo might attempt to defrag the mbuf chain.
-	 * The reference is passed in so that in the case of
-	 * errors, the new mbuf chain is what's put back on the br.
-	 */
-	return (gve_xmit_dqo(tx, mbuf));
+	if (gve_is_gqi(tx->com.priv))
+		err = gve_xmit(tx, *mbuf);
+	else if (gve_is_qpl(tx->com.priv))
+		err = gve_xmit_dqo_qpl(tx, *mbuf);
+	else {
+		/*
+		 * gve_xmit_dqo might attempt to defrag the mbuf chain.
+		 * The reference is passed in so that in the case of
+		 * errors, the new mbuf chain is what's put back on the br.
+		 */
+		err = gve_xmit_dqo(tx, mbuf);
+	}
+
+	SDT_PROBE3(gve, , tx, xmit__done, tx, err,
+	    gve_xmit_descs_since(tx, desc_idx));
+	return (err);
 }
 
 /*
@@ -823,14 +1003,45 @@ gve_xmit_retry_enobuf_mbuf(struct gve_tx_ring *tx,
 	return (err);
 }
 
+/*
+ * Publishes every descriptor written since the last doorbell with a single
+ * MMIO write, which on a VM is an exit.
+ */
+static void
+gve_xmit_ring_db(struct gve_tx_ring *tx)
+{
+	struct gve_priv *priv = tx->com.priv;
+
+	bus_dmamap_sync(tx->desc_ring_mem.tag, tx->desc_ring_mem.map,
+	    BUS_DMASYNC_PREWRITE);
+
+	SDT_PROBE2(gve, , tx, doorbell, tx, gve_xmit_desc_idx(tx));
+	if (gve_is_gqi(priv))
+		gve_db_bar_write_4(priv, tx->com.db_offset, tx->req);
+	else
+		gve_db_bar_dqo_write_4(priv, tx->com.db_offset,
+		    tx->dqo.desc_tail);
+
+	counter_enter();
+	counter_u64_add_protected(tx->stats.tx_doorbells, 1);
+	counter_exit();
+}
+
 static void
 gve_xmit_br(struct gve_tx_ring *tx)
 {
 	struct gve_priv *priv = tx->com.priv;
 	struct ifnet *ifp = priv->ifp;
 	struct mbuf *mbuf;
+	uint32_t batch_pkts = priv->tx_db_batch_pkts;
+	uint32_t db_pkts = 0;
+	uint32_t db_bytes = 0;
 	int err;
 
+	/* Low-latency queues do not make packets wait on a doorbell batch */
+	if (tx->com.id < gve_tx_ll_queues(priv))
+		batch_pkts = 1;
+
 	while ((if_getdrvflags(ifp) & IFF_DRV_RUNNING) != 0 &&
 	    (mbuf = drbr_peek(ifp, tx->br)) != NULL) {
 		err = gve_xmit_mbuf(tx, &mbuf);
@@ -854,17 +1065,79 @@ gve_xmit_br(struct gve_tx_ring *tx)
 		}
 
 		drbr_advance(ifp, tx->br);
+		db_bytes += mbuf->m_pkthdr.len;
                 BPF_MTAP(ifp, mbuf);
 
-		bus_dmamap_sync(tx->desc_ring_mem.tag, tx->desc_ring_mem.map,
-		    BUS_DMASYNC_PREWRITE);
-
-		if (gve_is_gqi(priv))
-			gve_db_bar_write_4(priv, tx->com.db_offset, tx->req);
-		else
-			gve_db_bar_dqo_write_4(priv, tx->com.db_offset,
-			    tx->dqo.desc_tail);
+		/*
+		 * Mbufs still on the br play the role of xmit_more: the
+		 * doorbell waits for them unless the batch has grown past
+		 * the limits that bound how long the NIC sits idle.
+		 */
+		if (++db_pkts >= batch_pkts ||
+		    db_bytes >= priv->tx_db_batch_bytes) {
+			gve_xmit_ring_db(tx);
+			db_pkts = 0;
+			db_bytes = 0;
+		}
 	}
+
+	/*
+	 * Also reached when the ring is out of room, whose completions can
+	 * only come once the NIC has been told about the queued descriptors.
+	 */
+	if (db_pkts != 0)
+		gve_xmit_ring_db(tx);
+}
+
+/*
+ * Called with ring_mtx held. Clearing xmit_pending before peeking at the br
+ * means any sender whose flag gets wiped here has its mbuf picked up below.
+ */
+static void
+gve_xmit_br_pending(struct gve_tx_ring *tx)
+{
+	GVE_RING_ASSERT(tx);
+
+	atomic_store_32(&tx->xmit_pending, 0);
+	atomic_thread_fence_seq_cst();
+	gve_xmit_br(tx);
+}
+
+/*
+ * Drains the br on behalf of every sender that enqueued since the last drain.
+ * A sender failing the trylock leaves its mbuf on the br: the holder rechecks
+ * xmit_pending after unlocking, with a fence pairing with the one in
+ * gve_xmit_ifp so that at least one of the two sees the other. Only a drainer
+ * that keeps finding new work is relieved by the xmit tq.
+ */
+static void
+gve_xmit_drain(struct gve_tx_ring *tx)
+{
+	int rounds = 0;
+
+	do {
+		/* The cleanup tq kicks the xmit tq once it makes room */
+		if (atomic_load_8(&tx->stopped))
+			return;
+
+		if (GVE_RING_TRYLOCK(tx) == 0) {
+			counter_enter();
+			counter_u64_add_protected(tx->stats.tx_xmit_handoff, 1);
+			counter_exit();
+			return;
+		}
+		gve_xmit_br_pending(tx);
+		GVE_RING_UNLOCK(tx);
+
+		atomic_thread_fence_seq_cst();
+		if (atomic_load_32(&tx->xmit_pending) == 0)
+			return;
+	} while (++rounds < GVE_XMIT_DRAIN_ROUNDS);
+
+	counter_enter();
+	counter_u64_add_protected(tx->stats.tx_xmit_tq_deferred, 1);
+	counter_exit();
+	taskqueue_enqueue(tx->xmit_tq, &tx->xmit_task);
 }
 
 void
@@ -873,48 +1146,164 @@ gve_xmit_tq(void *arg, int pending)
 	struct gve_tx_ring *tx = (struct gve_tx_ring *)arg;
 
 	GVE_RING_LOCK(tx);
-	gve_xmit_br(tx);
+	gve_xmit_br_pending(tx);
 	GVE_RING_UNLOCK(tx);
+
+	/* Senders that found the lock held while we drained rely on this */
+	atomic_thread_fence_seq_cst();
+	if (atomic_load_32(&tx->xmit_pending) != 0)
+		gve_xmit_drain(tx);
+}
+
+/*
+ * Sends a flow on the queue whose index matches the rx queue the device steers
+ * it to, the two being bound to the same CPU.
+ */
+static uint32_t
+gve_flowid_to_txq(struct gve_priv *priv, uint32_t flowid)
+{
+	struct gve_rss_config *rss_config = &priv->rss_config;
+
+	if (priv->rss_config_enabled)
+		return (rss_config->lut[flowid % rss_config->lut_size] %
+		    priv->tx_cfg.num_queues);
+	return (flowid % priv->tx_cfg.num_queues);
 }
 
+/*
+ * Whether the packet belongs in the low-latency tx class: those whose DSCP is
+ * in tx_ll_dscp_mask, which keeps whole flows together, and, only when
+ * tx_ll_max_len is set, small non-TSO packets, at the price of reordering
+ * flows that mix small and large packets. The DSCP is only looked for in
+ * headers the stack left in the first mbuf.
+ */
 static bool
-is_vlan_tagged_pkt(struct mbuf *mbuf)
+gve_xmit_is_ll(struct gve_priv *priv, struct mbuf *mbuf)
 {
 	struct ether_header *eh;
+	struct ip6_hdr *ip6;
+	struct ip *ip;
+	uint8_t dscp;
+
+	if (priv->tx_ll_max_len != 0 &&
+	    (mbuf->m_pkthdr.csum_flags & CSUM_TSO) == 0 &&
+	    mbuf->m_pkthdr.len <= priv->tx_ll_max_len)
+		return (true);
+	if (priv->tx_ll_dscp_mask == 0 || mbuf->m_len < ETHER_HDR_LEN)
+		return (false);
 
 	eh = mtod(mbuf, struct ether_header *);
-	return (ntohs(eh->ether_type) == ETHERTYPE_VLAN);
+	switch (ntohs(eh->ether_type)) {
+	case ETHERTYPE_IP:
+		if (mbuf->m_len < ETHER_HDR_LEN + sizeof(struct ip))
+			return (false);
+		ip = (struct ip *)(eh + 1);
+		dscp = ip->ip_tos >> 2;
+		break;
+	case ETHERTYPE_IPV6:
+		if (mbuf->m_len < ETHER_HDR_LEN + sizeof(struct ip6_hdr))
+			return (false);
+		ip6 = (struct ip6_hdr *)(eh + 1);
+		dscp = (be32dec(&ip6->ip6_flow) >> 22) & 0x3f;
+		break;
+	default:
+		return (false);
+	}
+
+	return ((priv->tx_ll_dscp_mask & (1ULL << dscp)) != 0);
 }
 
 int
 gve_xmit_ifp(if_t ifp, struct mbuf *mbuf)
 {
 	struct gve_priv *priv = if_getsoftc(ifp);
+	struct epoch_tracker et;
 	struct gve_tx_ring *tx;
-	bool is_br_empty;
-	int err;
+	uint32_t num_queues;
+	uint32_t first;
+	uint32_t ll;
 	uint32_t i;
+	int err;
 
 	if (__predict_false((if_getdrvflags(priv->ifp) & IFF_DRV_RUNNING) == 0))
 		return (ENODEV);
 
-	if (M_HASHTYPE_GET(mbuf) != M_HASHTYPE_NONE)
-		i = mbuf->m_pkthdr.flowid % priv->tx_cfg.num_queues;
-	else
-		i = curcpu % priv->tx_cfg.num_queues;
-	tx = &priv->tx[i];
+	/*
+	 * Not every if_transmit caller is in the net epoch, and shrinking the
+	 * tx queue count relies on it to wait out senders of the queues going.
+	 */
+	NET_EPOCH_ENTER(et);
+#ifdef RATELIMIT
+	/* Paced flows go out on the queue their send tag was bound to */
+	if ((mbuf->m_pkthdr.csum_flags & CSUM_SND_TAG) != 0 &&
+	    mbuf->m_pkthdr.snd_tag->ifp == ifp) {
+		err = gve_rl_tag_xmit(priv, mbuf);
+		NET_EPOCH_EXIT(et);
+		return (err);
+	}
+#endif
+
+	/* Flows are spread over the queues of the class the packet is in */
+	first = 0;
+	num_queues = gve_tx_load_queues(priv, &ll);
+	if (ll != 0) {
+		if (gve_xmit_is_ll(priv, mbuf))
+			num_queues = ll;
+		else {
+			first = ll;
+			num_queues -= ll;
+		}
+	}
 
-	if (__predict_false(is_vlan_tagged_pkt(mbuf))) {
-		counter_enter();
-		counter_u64_add_protected(tx->stats.tx_dropped_pkt_vlan, 1);
-		counter_u64_add_protected(tx->stats.tx_dropped_pkt, 1);
-		counter_exit();
-		m_freem(mbuf);
-		return (ENODEV);
+	if (M_HASHTYPE_GET(mbuf) != M_HASHTYPE_NONE) {
+#ifdef RSS
+		uint32_t bucket;
+
+		/* Keep the flow on the queue pair its rx side lands on */
+		if (rss_hash2bucket(mbuf->m_pkthdr.flowid,
+		    M_HASHTYPE_GET(mbuf), &bucket) == 0)
+			i = bucket;
+		else
+#endif
+			i = gve_flowid_to_txq(priv, mbuf->m_pkthdr.flowid);
+	} else
+		i = priv->cpu_txq[curcpu];
+	tx = &priv->tx[first + i % num_queues];
+
+	err = gve_xmit_txq(tx, mbuf);
+	NET_EPOCH_EXIT(et);
+	return (err);
+}
+
+/*
+ * Hands an mbuf to a particular tx queue, transmitting it straight away unless
+ * another sender is already draining the queue's br.
+ */
+int
+gve_xmit_txq(struct gve_tx_ring *tx, struct mbuf *mbuf)
+{
+	int err;
+
+	/*
+	 * Neither descriptor format has a tag field, so tags handed down with
+	 * IFCAP_VLAN_HWTAGGING are inserted in band and offloads parse past them.
+	 */
+	if ((mbuf->m_flags & M_VLANTAG) != 0) {
+		mbuf = ether_vlanencap(mbuf, mbuf->m_pkthdr.ether_vtag);
+		if (__predict_false(mbuf == NULL)) {
+			counter_enter();
+			counter_u64_add_protected(tx->stats.tx_dropped_pkt_vlan, 1);
+			counter_u64_add_protected(tx->stats.tx_dropped_pkt, 1);
+			counter_exit();
+			return (ENOBUFS);
+		}
+		mbuf->m_flags &= ~M_VLANTAG;
 	}
 
-	is_br_empty = drbr_empty(ifp, tx->br);
-	err = drbr_enqueue(ifp, tx->br, mbuf);
+#ifdef GVE_HISTOGRAMS
+	gve_hist_add(tx->stats.tx_br_occupancy, buf_ring_count(tx->br));
+#endif
+	err = drbr_enqueue(tx->com.priv->ifp, tx->br, mbuf);
 	if (__predict_false(err != 0)) {
 		if (!atomic_load_8(&tx->stopped))
 			taskqueue_enqueue(tx->xmit_tq, &tx->xmit_task);
@@ -926,14 +1315,12 @@ gve_xmit_ifp(if_t ifp, struct mbuf *mbuf)
 	}
 
 	/*
-	 * If the mbuf we just enqueued is the only one on the ring, then
-	 * transmit it right away in the interests of low latency.
+	 * Transmit right away in the interests of low latency, or leave the
+	 * mbuf to whichever sender is already draining the br.
 	 */
-	if (is_br_empty && (GVE_RING_TRYLOCK(tx) != 0)) {
-		gve_xmit_br(tx);
-		GVE_RING_UNLOCK(tx);
-	} else if (!atomic_load_8(&tx->stopped))
-		taskqueue_enqueue(tx->xmit_tq, &tx->xmit_task);
+	atomic_store_rel_32(&tx->xmit_pending, 1);
+	atomic_thread_fence_seq_cst();
+	gve_xmit_drain(tx);
 
 	return (0);
 }
@@ -956,3 +1343,142 @@ gve_qflush(if_t ifp)
 
 	if_qflush(ifp);
 }
+
+#ifdef DEV_NETMAP
+/*
+ * Netmap packets are copied into the fifo just like mbufs are, except that
+ * they carry no offloads and so never need a metadata desc or a TSO header
+ * split: the first segment is always the spec-stipulated minimum.
+ */
+static void
+gve_netmap_xmit_gqi(struct gve_tx_ring *tx, struct netmap_kring *kring,
+    u_int nm_i, uint16_t pkt_len)
+{
+	struct gve_tx_buffer_state *info;
+	uint32_t idx = tx->req & tx->mask;
+	int pad_bytes, hdr_nfrags, payload_nfrags;
+	struct gve_tx_seg_desc *seg_desc;
+	uint16_t first_seg_len;
+	int payload_iov = 2;
+	uint32_t next_idx;
+	int copy_offset;
+	int i;
+
+	info = &tx->info[idx];
+	first_seg_len = MIN(pkt_len, GVE_GQ_TX_MIN_PKT_DESC_BYTES);
+
+	pad_bytes = gve_tx_fifo_pad_alloc_one_frag(&tx->fifo, first_seg_len);
+	hdr_nfrags = gve_tx_alloc_fifo(&tx->fifo, first_seg_len + pad_bytes,
+	    &info->iov[0]);
+	KASSERT(hdr_nfrags > 0, ("Number of header fragments for gve tx is 0"));
+	payload_nfrags = gve_tx_alloc_fifo(&tx->fifo, pkt_len - first_seg_len,
+	    &info->iov[payload_iov]);
+
+	gve_tx_fill_pkt_desc(&tx->desc_ring[idx].pkt, /*is_tso=*/false,
+	    /*l4_hdr_offset=*/0, 1 + payload_nfrags, first_seg_len,
+	    info->iov[hdr_nfrags - 1].iov_offset, /*has_csum_flag=*/false,
+	    /*csum_offset=*/0, pkt_len);
+
+	gve_netmap_copy_slots(kring, nm_i, 0, first_seg_len,
+	    (char *)tx->fifo.base + info->iov[hdr_nfrags - 1].iov_offset);
+	gve_dma_sync_for_device(tx->com.qpl,
+	    info->iov[hdr_nfrags - 1].iov_offset,
+	    info->iov[hdr_nfrags - 1].iov_len);
+	copy_offset = first_seg_len;
+
+	for (i = payload_iov; i < payload_nfrags + payload_iov; i++) {
+		next_idx = (tx->req + 1 + i - payload_iov) & tx->mask;
+		seg_desc = &tx->desc_ring[next_idx].seg;
+
+		gve_tx_fill_seg_desc(seg_desc, /*is_tso=*/false,
+		    info->iov[i].iov_len, info->iov[i].iov_offset,
+		    /*is_ipv6=*/false, /*l3_off=*/0, /*tso_mss=*/0);
+
+		gve_netmap_copy_slots(kring, nm_i, copy_offset,
+		    info->iov[i].iov_len,
+		    (char *)tx->fifo.base + info->iov[i].iov_offset);
+		gve_dma_sync_for_device(tx->com.qpl,
+		    info->iov[i].iov_offset, info->iov[i].iov_len);
+		copy_offset += info->iov[i].iov_len;
+	}
+
+	tx->req += (1 + payload_nfrags);
+}
+
+int
+gve_netmap_txsync_gqi(struct netmap_kring *kring, int flags)
+{
+	struct netmap_adapter *na = kring->na;
+	struct gve_priv *priv = if_getsoftc(na->ifp);
+	struct gve_tx_ring *tx = &priv->tx[kring->ring_id];
+	u_int lim = kring->nkr_num_slots - 1;
+	u_int const head = kring->rhead;
+	uint64_t tbytes = 0, tpackets = 0;
+	uint32_t nic_done, todo, req;
+	size_t space_freed = 0;
+	uint16_t first_seg_len;
+	bool has_empty_slot;
+	int bytes_required;
+	uint32_t pkt_len;
+	u_int nm_i, last_i;
+	uint32_t j;
+
+	nic_done = gve_tx_load_event_counter(priv, tx);
+	todo = nic_done - tx->done;
+	for (j = 0; j < todo; j++) {
+		space_freed += gve_tx_release_iovs(&tx->info[tx->done & tx->mask]);
+		tx->done++;
+	}
+	gve_tx_free_fifo(&tx->fifo, space_freed);
+
+	req = tx->req;
+	nm_i = kring->nr_hwcur;
+	while (nm_i != head && gve_netmap_tx_pkt_bounds(kring, nm_i, head,
+	    &last_i, &pkt_len, &has_empty_slot)) {
+		if (__predict_false(pkt_len == 0 ||
+		    pkt_len > if_getmtu(priv->ifp) + ETHER_HDR_LEN +
+		    ETHER_VLAN_ENCAP_LEN)) {
+			counter_enter();
+			counter_u64_add_protected(tx->stats.tx_dropped_pkt, 1);
+			counter_exit();
+			nm_i = nm_next(last_i, lim);
+			continue;
+		}
+
+		first_seg_len = MIN(pkt_len, GVE_GQ_TX_MIN_PKT_DESC_BYTES);
+		bytes_required = gve_fifo_bytes_required(tx, first_seg_len,
+		    pkt_len);
+		if (!gve_can_tx(tx, bytes_required)) {
+			counter_enter();
+			counter_u64_add_protected(
+			    tx->stats.tx_delayed_pkt_nospace_device, 1);
+			counter_exit();
+			break;
+		}
+
+		gve_netmap_xmit_gqi(tx, kring, nm_i, pkt_len);
+		tbytes += pkt_len;
+		tpackets++;
+		nm_i = nm_next(last_i, lim);
+	}
+
+	if (tx->req != req) {
+		bus_dmamap_sync(tx->desc_ring_mem.tag, tx->desc_ring_mem.map,
+		    BUS_DMASYNC_PREWRITE);
+		gve_db_bar_write_4(priv, tx->com.db_offset, tx->req);
+	}
+	kring->nr_hwcur = nm_i;
+
+	/* The data now lives in the fifo, so the slots are free right away. */
+	kring->nr_hwtail = nm_prev(kring->nr_hwcur, lim);
+
+	if (tpackets != 0) {
+		counter_enter();
+		counter_u64_add_protected(tx->stats.tbytes, tbytes);
+		counter_u64_add_protected(tx->stats.tpackets, tpackets);
+		counter_exit();
+	}
+
+	return (0);
+}
+#endif
@@ -30,6 +30,7 @@
  */
 
 #include "opt_inet6.h"
+#include "opt_netmap.h"
 
 #include "gve.h"
 #include "gve_dqo.h"
@@ -58,7 +59,8 @@ gve_free_tx_mbufs_dqo(struct gve_tx_ring *tx)
 
 	for (i = 0; i < tx->dqo.num_pending_pkts; i++) {
 		pending_pkt = &tx->dqo.pending_pkts[i];
-		if (!pending_pkt->mbuf)
+		/* Netmap packets hold a dmamap or qpl bufs but no mbuf */
+		if (pending_pkt->state != GVE_PACKET_STATE_PENDING_DATA_COMPL)
 			continue;
 
 		if (gve_is_qpl(tx->com.priv))
@@ -66,8 +68,10 @@ gve_free_tx_mbufs_dqo(struct gve_tx_ring *tx)
 		else
 			gve_unmap_packet(tx, pending_pkt);
 
-		m_freem(pending_pkt->mbuf);
-		pending_pkt->mbuf = NULL;
+		if (pending_pkt->mbuf != NULL) {
+			m_freem(pending_pkt->mbuf);
+			pending_pkt->mbuf = NULL;
+		}
 	}
 }
 
@@ -343,18 +347,25 @@ static int
 gve_prep_tso(struct mbuf *mbuf, int *header_len)
 {
 	uint8_t l3_off, l4_off = 0;
+	struct ether_vlan_header *evl;
 	struct ether_header *eh;
 	struct tcphdr *th;
+	uint16_t etype;
 	u_short csum;
 
 	PULLUP_HDR(mbuf, sizeof(*eh));
 	eh = mtod(mbuf, struct ether_header *);
-	KASSERT(eh->ether_type != ETHERTYPE_VLAN,
-	    ("VLAN-tagged packets not supported"));
+	etype = ntohs(eh->ether_type);
 	l3_off = ETHER_HDR_LEN;
+	if (etype == ETHERTYPE_VLAN) {
+		PULLUP_HDR(mbuf, sizeof(*evl));
+		evl = mtod(mbuf, struct ether_vlan_header *);
+		etype = ntohs(evl->evl_proto);
+		l3_off += ETHER_VLAN_ENCAP_LEN;
+	}
 
 #ifdef INET6
-	if (ntohs(eh->ether_type) == ETHERTYPE_IPV6) {
+	if (etype == ETHERTYPE_IPV6) {
 		struct ip6_hdr *ip6;
 
 		PULLUP_HDR(mbuf, l3_off + sizeof(*ip6));
@@ -364,7 +375,7 @@ gve_prep_tso(struct mbuf *mbuf, int *header_len)
 		    /*csum=*/0);
 	} else
 #endif
-	if (ntohs(eh->ether_type) == ETHERTYPE_IP) {
+	if (etype == ETHERTYPE_IP) {
 		struct ip *ip;
 
 		PULLUP_HDR(mbuf, l3_off + sizeof(*ip));
@@ -528,6 +539,9 @@ gve_alloc_pending_packet(struct gve_tx_ring *tx)
 	pending_pkt->state = GVE_PACKET_STATE_PENDING_DATA_COMPL;
 
 	gve_set_timestamp(&pending_pkt->enqueue_time_sec);
+#ifdef GVE_HISTOGRAMS
+	pending_pkt->xmit_time = sbinuptime();
+#endif
 
 	return (pending_pkt);
 }
@@ -656,6 +670,30 @@ gve_get_page_dma_handle(struct gve_tx_ring *tx, int32_t index)
 	return (&tx->com.qpl->dmas[page_id]);
 }
 
+/*
+ * Copies len bytes from the chain starting at offset *off of *m and moves the
+ * position past them, so a packet is copied in a single walk of its chain
+ * rather than m_copydata walking it from the head for every qpl buf.
+ */
+static void
+gve_tx_copy_chain_dqo(struct mbuf **m, int *off, int len, char *va)
+{
+	int n;
+
+	while (len > 0) {
+		if (*off == (*m)->m_len) {
+			*m = (*m)->m_next;
+			*off = 0;
+			continue;
+		}
+		n = MIN((*m)->m_len - *off, len);
+		m_copydata(*m, *off, n, va);
+		va += n;
+		len -= n;
+		*off += n;
+	}
+}
+
 static void
 gve_tx_copy_mbuf_and_write_pkt_descs(struct gve_tx_ring *tx,
     struct mbuf *mbuf, struct gve_tx_pending_pkt_dqo *pkt,
@@ -665,9 +703,11 @@ gve_tx_copy_mbuf_and_write_pkt_descs(struct gve_tx_ring *tx,
 	int32_t pkt_len = mbuf->m_pkthdr.len;
 	struct gve_dma_handle *dma;
 	uint32_t copy_offset = 0;
+	struct mbuf *m = mbuf;
 	int32_t prev_buf = -1;
 	uint32_t copy_len;
 	bus_addr_t addr;
+	int m_off = 0;
 	int32_t buf;
 	void *va;
 
@@ -681,7 +721,7 @@ gve_tx_copy_mbuf_and_write_pkt_descs(struct gve_tx_ring *tx,
 
 		gve_tx_buf_get_addr_dqo(tx, buf, &va, &addr);
 		copy_len = MIN(GVE_TX_BUF_SIZE_DQO, pkt_len - copy_offset);
-		m_copydata(mbuf, copy_offset, copy_len, va);
+		gve_tx_copy_chain_dqo(&m, &m_off, copy_len, va);
 		copy_offset += copy_len;
 
 		dma = gve_get_page_dma_handle(tx, buf);
@@ -703,6 +743,10 @@ gve_tx_copy_mbuf_and_write_pkt_descs(struct gve_tx_ring *tx,
 	}
 
 	tx->dqo.qpl_bufs[buf] = -1;
+
+	counter_enter();
+	counter_u64_add_protected(tx->stats.tx_copied_bytes, pkt_len);
+	counter_exit();
 }
 
 int
@@ -839,6 +883,10 @@ gve_xmit_dqo(struct gve_tx_ring *tx, struct mbuf **mbuf_ptr)
 		goto abort_with_dma;
 
 	bus_dmamap_sync(tx->dqo.buf_dmatag, pkt->dmamap, BUS_DMASYNC_PREWRITE);
+	counter_enter();
+	counter_u64_add_protected(tx->stats.tx_zerocopy_bytes,
+	    mbuf->m_pkthdr.len);
+	counter_exit();
 	for (i = 0; i < nsegs; i++) {
 		gve_tx_fill_pkt_desc_dqo(tx, &desc_idx,
 		    segs[i].ds_len, segs[i].ds_addr,
@@ -866,14 +914,36 @@ abort:
 	return (err);
 }
 
+/*
+ * Pending packets and qpl bufs reclaimed by a cleanup pass. They are chained
+ * up locally and only handed to the xmit path by gve_tx_publish_reclaim_dqo,
+ * so a pass costs one atomic per free list rather than one per completion.
+ */
+struct gve_tx_reclaim_dqo {
+	int32_t pkt_head;
+	int32_t pkt_tail;
+	int32_t buf_head;
+	int32_t buf_tail;
+	uint32_t buf_cnt;
+};
+
+static void
+gve_tx_init_reclaim_dqo(struct gve_tx_reclaim_dqo *rc)
+{
+	rc->pkt_head = -1;
+	rc->pkt_tail = -1;
+	rc->buf_head = -1;
+	rc->buf_tail = -1;
+	rc->buf_cnt = 0;
+}
+
 static void
 gve_reap_qpl_bufs_dqo(struct gve_tx_ring *tx,
-    struct gve_tx_pending_pkt_dqo *pkt)
+    struct gve_tx_pending_pkt_dqo *pkt, struct gve_tx_reclaim_dqo *rc)
 {
 	int32_t buf = pkt->qpl_buf_head;
 	struct gve_dma_handle *dma;
 	int32_t qpl_buf_tail;
-	int32_t old_head;
 	int i;
 
 	for (i = 0; i < pkt->num_qpl_bufs; i++) {
@@ -883,33 +953,81 @@ gve_reap_qpl_bufs_dqo(struct gve_tx_ring *tx,
 		buf = tx->dqo.qpl_bufs[buf];
 	}
 	MPASS(buf == -1);
-	buf = qpl_buf_tail;
+
+	/* Prepend this pkt's bufs to the ones reclaimed so far */
+	tx->dqo.qpl_bufs[qpl_buf_tail] = rc->buf_head;
+	if (rc->buf_tail == -1)
+		rc->buf_tail = qpl_buf_tail;
+	rc->buf_head = pkt->qpl_buf_head;
+	rc->buf_cnt += pkt->num_qpl_bufs;
+
+	gve_clear_qpl_pending_pkt(pkt);
+}
+
+static void
+gve_reclaim_pending_packet(struct gve_tx_ring *tx,
+    struct gve_tx_pending_pkt_dqo *pending_pkt, struct gve_tx_reclaim_dqo *rc)
+{
+	int index = pending_pkt - tx->dqo.pending_pkts;
+
+	pending_pkt->state = GVE_PACKET_STATE_FREE;
+
+	gve_invalidate_timestamp(&pending_pkt->enqueue_time_sec);
+
+	pending_pkt->next = rc->pkt_head;
+	if (rc->pkt_tail == -1)
+		rc->pkt_tail = index;
+	rc->pkt_head = index;
+}
+
+static void
+gve_tx_publish_reclaim_dqo(struct gve_tx_ring *tx,
+    struct gve_tx_reclaim_dqo *rc)
+{
+	int32_t old_head;
+
+	if (rc->pkt_head != -1) {
+		while (true) {
+			old_head = atomic_load_32(
+			    &tx->dqo.free_pending_pkts_prd);
+			tx->dqo.pending_pkts[rc->pkt_tail].next = old_head;
+
+			/*
+			 * The "rel" ensures the xmit path stealing the list
+			 * sees the chain built above.
+			 */
+			if (atomic_cmpset_rel_32(&tx->dqo.free_pending_pkts_prd,
+			    old_head, rc->pkt_head))
+				break;
+		}
+	}
+
+	if (rc->buf_head == -1)
+		return;
 
 	while (true) {
 		old_head = atomic_load_32(&tx->dqo.free_qpl_bufs_prd);
-		tx->dqo.qpl_bufs[buf] = old_head;
+		tx->dqo.qpl_bufs[rc->buf_tail] = old_head;
 
 		/*
 		 * The "rel" ensures that the update to dqo.free_qpl_bufs_prd
-		 * is visible only after the linked list from this pkt is
-		 * attached above to old_head.
+		 * is visible only after the reclaimed linked list is attached
+		 * above to old_head.
 		 */
 		if (atomic_cmpset_rel_32(&tx->dqo.free_qpl_bufs_prd,
-		    old_head, pkt->qpl_buf_head))
+		    old_head, rc->buf_head))
 			break;
 	}
 	/*
 	 * The "rel" ensures that the update to dqo.qpl_bufs_produced is
 	 * visible only adter the update to dqo.free_qpl_bufs_prd above.
 	 */
-	atomic_add_rel_32(&tx->dqo.qpl_bufs_produced, pkt->num_qpl_bufs);
-
-	gve_clear_qpl_pending_pkt(pkt);
+	atomic_add_rel_32(&tx->dqo.qpl_bufs_produced, rc->buf_cnt);
 }
 
 static uint64_t
 gve_handle_packet_completion(struct gve_priv *priv,
-    struct gve_tx_ring *tx, uint16_t compl_tag)
+    struct gve_tx_ring *tx, uint16_t compl_tag, struct gve_tx_reclaim_dqo *rc)
 {
 	struct gve_tx_pending_pkt_dqo *pending_pkt;
 	int32_t pkt_len;
@@ -931,15 +1049,19 @@ gve_handle_packet_completion(struct gve_priv *priv,
 	}
 
 	pkt_len = pending_pkt->mbuf->m_pkthdr.len;
+#ifdef GVE_HISTOGRAMS
+	gve_hist_add(tx->stats.tx_compl_lat_us,
+	    sbttous(sbinuptime() - pending_pkt->xmit_time));
+#endif
 
 	if (gve_is_qpl(priv))
-		gve_reap_qpl_bufs_dqo(tx, pending_pkt);
+		gve_reap_qpl_bufs_dqo(tx, pending_pkt, rc);
 	else
 		gve_unmap_packet(tx, pending_pkt);
 
 	m_freem(pending_pkt->mbuf);
 	pending_pkt->mbuf = NULL;
-	gve_free_pending_packet(tx, pending_pkt);
+	gve_reclaim_pending_packet(tx, pending_pkt, rc);
 	return (pkt_len);
 }
 
@@ -977,6 +1099,9 @@ gve_tx_intr_dqo(void *arg)
 		return (FILTER_STRAY);
 
 	/* Interrupts are automatically masked */
+#ifdef GVE_HISTOGRAMS
+	com->intr_time = sbinuptime();
+#endif
 	taskqueue_enqueue(com->cleanup_tq, &com->cleanup_task);
 	return (FILTER_HANDLED);
 }
@@ -1071,26 +1196,85 @@ gve_tx_get_gen_bit(uint8_t *desc)
 	return ((byte & GVE_TX_DESC_DQO_GEN_BIT_MASK) != 0);
 }
 
+/* Spins for new completions while busy-polling, returning true if any came. */
 static bool
+gve_tx_busy_poll_dqo(struct gve_tx_ring *tx)
+{
+	struct gve_tx_compl_desc_dqo *compl_desc;
+	sbintime_t deadline = 0;
+
+	while (gve_busy_poll_spin(&tx->com, &deadline)) {
+		bus_dmamap_sync(tx->dqo.compl_ring_mem.tag,
+		    tx->dqo.compl_ring_mem.map, BUS_DMASYNC_POSTREAD);
+		compl_desc = &tx->dqo.compl_ring[tx->dqo.compl_head];
+		if (gve_tx_get_gen_bit((uint8_t *)compl_desc) !=
+		    tx->dqo.cur_gen_bit)
+			return (true);
+	}
+	return (false);
+}
+
+/*
+ * Warms the cache for the completions after the one at compl_head: the
+ * completion ring a few lines ahead, and the pending packet the next
+ * completion refers to, if the NIC has written it already.
+ */
+static void
+gve_tx_prefetch_compl_dqo(struct gve_tx_ring *tx)
+{
+	struct gve_tx_compl_desc_dqo *next;
+	uint32_t next_idx;
+	uint16_t tag;
+
+	next_idx = (tx->dqo.compl_head + GVE_TX_COMPL_PREFETCH_DQO) &
+	    tx->dqo.compl_mask;
+	__builtin_prefetch(&tx->dqo.compl_ring[next_idx]);
+
+	next_idx = (tx->dqo.compl_head + 1) & tx->dqo.compl_mask;
+	next = &tx->dqo.compl_ring[next_idx];
+	if (gve_tx_get_gen_bit((uint8_t *)next) ==
+	    (tx->dqo.cur_gen_bit ^ (next_idx == 0)))
+		return;
+	if (next->type != GVE_COMPL_TYPE_DQO_PKT)
+		return;
+	tag = le16toh(next->completion_tag);
+	if (__predict_true(tag < tx->dqo.num_pending_pkts))
+		__builtin_prefetch(&tx->dqo.pending_pkts[tag]);
+}
+
+/* Returns the number of completions handled, at most `budget`. */
+static int
 gve_tx_cleanup_dqo(struct gve_priv *priv, struct gve_tx_ring *tx, int budget)
 {
 	struct gve_tx_compl_desc_dqo *compl_desc;
+	struct gve_tx_reclaim_dqo rc;
 	uint64_t bytes_done = 0;
 	uint64_t pkts_done = 0;
 	uint16_t compl_tag;
+	uint64_t pkt_len;
 	int work_done = 0;
 	uint16_t tx_head;
 	uint16_t type;
 
-	while (work_done < budget) {
-		bus_dmamap_sync(tx->dqo.compl_ring_mem.tag,
-		    tx->dqo.compl_ring_mem.map,
-		    BUS_DMASYNC_POSTREAD);
+	gve_tx_init_reclaim_dqo(&rc);
+	bus_dmamap_sync(tx->dqo.compl_ring_mem.tag,
+	    tx->dqo.compl_ring_mem.map,
+	    BUS_DMASYNC_POSTREAD);
 
+	while (work_done < budget) {
 		compl_desc = &tx->dqo.compl_ring[tx->dqo.compl_head];
 		if (gve_tx_get_gen_bit((uint8_t *)compl_desc) ==
-		    tx->dqo.cur_gen_bit)
-			break;
+		    tx->dqo.cur_gen_bit) {
+			/* Pick up completions written during the pass */
+			bus_dmamap_sync(tx->dqo.compl_ring_mem.tag,
+			    tx->dqo.compl_ring_mem.map,
+			    BUS_DMASYNC_POSTREAD);
+			if (gve_tx_get_gen_bit((uint8_t *)compl_desc) ==
+			    tx->dqo.cur_gen_bit)
+				break;
+		}
+
+		gve_tx_prefetch_compl_dqo(tx);
 
 		type = compl_desc->type;
 		if (type == GVE_COMPL_TYPE_DQO_DESC) {
@@ -1099,8 +1283,11 @@ gve_tx_cleanup_dqo(struct gve_priv *priv, struct gve_tx_ring *tx, int budget)
 			atomic_store_rel_32(&tx->dqo.hw_tx_head, tx_head);
 		} else if (type == GVE_COMPL_TYPE_DQO_PKT) {
 			compl_tag = le16toh(compl_desc->completion_tag);
-			bytes_done += gve_handle_packet_completion(priv,
-			    tx, compl_tag);
+			pkt_len = gve_handle_packet_completion(priv, tx,
+			    compl_tag, &rc);
+			SDT_PROBE3(gve, , tx, completion, tx, compl_tag,
+			    pkt_len);
+			bytes_done += pkt_len;
 			pkts_done++;
 		}
 
@@ -1111,6 +1298,8 @@ gve_tx_cleanup_dqo(struct gve_priv *priv, struct gve_tx_ring *tx, int budget)
 		work_done++;
 	}
 
+	gve_tx_publish_reclaim_dqo(tx, &rc);
+
 	/*
 	 * Waking the xmit taskqueue has to occur after room has been made in
 	 * the queue.
@@ -1127,7 +1316,7 @@ gve_tx_cleanup_dqo(struct gve_priv *priv, struct gve_tx_ring *tx, int budget)
 	counter_u64_add_protected(tx->stats.tpackets, pkts_done);
 	counter_exit();
 
-	return (work_done == budget);
+	return (work_done);
 }
 
 void
@@ -1135,15 +1324,319 @@ gve_tx_cleanup_tq_dqo(void *arg, int pending)
 {
 	struct gve_tx_ring *tx = arg;
 	struct gve_priv *priv = tx->com.priv;
+	uint32_t usecs;
+	int work_done;
 
 	if (__predict_false((if_getdrvflags(priv->ifp) & IFF_DRV_RUNNING) == 0))
 		return;
 
-	if (gve_tx_cleanup_dqo(priv, tx, /*budget=*/1024)) {
+#ifdef GVE_HISTOGRAMS
+	gve_hist_intr_delay(&tx->com, tx->stats.tx_intr_delay_us);
+#endif
+
+#ifdef DEV_NETMAP
+	if (gve_netmap_tx_irq(tx)) {
+		gve_db_bar_dqo_write_4(priv, tx->com.irq_db_offset,
+		    GVE_ITR_NO_UPDATE_DQO | GVE_ITR_ENABLE_BIT_DQO);
+		return;
+	}
+#endif
+
+	work_done = gve_tx_cleanup_dqo(priv, tx, /*budget=*/1024);
+#ifdef GVE_HISTOGRAMS
+	gve_hist_add(tx->stats.tx_cleanup_work, work_done);
+#endif
+	if (work_done == 1024 || gve_tx_busy_poll_dqo(tx)) {
 		taskqueue_enqueue(tx->com.cleanup_tq, &tx->com.cleanup_task);
 		return;
 	}
 
+	usecs = gve_itr_rearm_usecs(&tx->com, work_done, tx->stats.tpackets,
+	    tx->stats.tbytes);
 	gve_db_bar_dqo_write_4(priv, tx->com.irq_db_offset,
-	    GVE_ITR_NO_UPDATE_DQO | GVE_ITR_ENABLE_BIT_DQO);
+	    gve_itr_db_val_dqo(&tx->com, usecs));
 }
+
+#ifdef DEV_NETMAP
+/*
+ * In netmap mode the pending packets are not handed out from the free lists:
+ * netmap slot i is backed by pending_pkts[i], which holds the slot's dmamap in
+ * RDA mode. A packet's completion tag is the index of its last slot, and the
+ * pending packet at that index remembers the packet's first slot in "next"
+ * and, in QPL mode, owns the qpl bufs the packet was copied into.
+ */
+
+static void
+gve_netmap_handle_packet_completion(struct gve_priv *priv,
+    struct gve_tx_ring *tx, uint16_t compl_tag, struct gve_tx_reclaim_dqo *rc)
+{
+	struct gve_tx_pending_pkt_dqo *pending_pkt;
+	uint16_t lim = tx->dqo.num_pending_pkts - 1;
+	uint16_t i;
+
+	if (__predict_false(compl_tag >= tx->dqo.num_pending_pkts)) {
+		device_printf(priv->dev, "Invalid TX completion tag: %d\n",
+		    compl_tag);
+		return;
+	}
+
+	pending_pkt = &tx->dqo.pending_pkts[compl_tag];
+	if (__predict_false(pending_pkt->state !=
+	    GVE_PACKET_STATE_PENDING_DATA_COMPL)) {
+		device_printf(priv->dev,
+		    "No pending data completion: %d\n", compl_tag);
+		return;
+	}
+
+	gve_invalidate_timestamp(&pending_pkt->enqueue_time_sec);
+	if (gve_is_qpl(priv))
+		gve_reap_qpl_bufs_dqo(tx, pending_pkt, rc);
+
+	for (i = pending_pkt->next;; i = nm_next(i, lim)) {
+		if (!gve_is_qpl(priv))
+			gve_unmap_packet(tx, &tx->dqo.pending_pkts[i]);
+		tx->dqo.pending_pkts[i].state = GVE_PACKET_STATE_FREE;
+		if (i == compl_tag)
+			break;
+	}
+}
+
+static void
+gve_netmap_tx_cleanup_dqo(struct gve_priv *priv, struct gve_tx_ring *tx)
+{
+	struct gve_tx_compl_desc_dqo *compl_desc;
+	struct gve_tx_reclaim_dqo rc;
+	int work_done = 0;
+
+	gve_tx_init_reclaim_dqo(&rc);
+	for (;;) {
+		bus_dmamap_sync(tx->dqo.compl_ring_mem.tag,
+		    tx->dqo.compl_ring_mem.map,
+		    BUS_DMASYNC_POSTREAD);
+
+		compl_desc = &tx->dqo.compl_ring[tx->dqo.compl_head];
+		if (gve_tx_get_gen_bit((uint8_t *)compl_desc) ==
+		    tx->dqo.cur_gen_bit)
+			break;
+
+		if (compl_desc->type == GVE_COMPL_TYPE_DQO_DESC)
+			atomic_store_rel_32(&tx->dqo.hw_tx_head,
+			    le16toh(compl_desc->tx_head));
+		else if (compl_desc->type == GVE_COMPL_TYPE_DQO_PKT)
+			gve_netmap_handle_packet_completion(priv, tx,
+			    le16toh(compl_desc->completion_tag), &rc);
+
+		tx->dqo.compl_head = (tx->dqo.compl_head + 1) &
+		    tx->dqo.compl_mask;
+		tx->dqo.cur_gen_bit ^= tx->dqo.compl_head == 0;
+		work_done++;
+	}
+
+	gve_tx_publish_reclaim_dqo(tx, &rc);
+	tx->done += work_done; /* tx->done is just a sysctl counter */
+}
+
+static void
+gve_netmap_copy_and_write_pkt_descs_dqo(struct gve_tx_ring *tx,
+    struct netmap_kring *kring, u_int nm_i, uint32_t pkt_len,
+    struct gve_tx_pending_pkt_dqo *pkt, int16_t completion_tag,
+    uint32_t *desc_idx)
+{
+	struct gve_dma_handle *dma;
+	uint32_t copy_offset = 0;
+	int32_t prev_buf = -1;
+	uint32_t copy_len;
+	bus_addr_t addr;
+	int32_t buf;
+	void *va;
+
+	while (copy_offset < pkt_len) {
+		buf = gve_tx_alloc_qpl_buf(tx);
+		/* We already checked for availability */
+		MPASS(buf != -1);
+
+		gve_tx_buf_get_addr_dqo(tx, buf, &va, &addr);
+		copy_len = MIN(GVE_TX_BUF_SIZE_DQO, pkt_len - copy_offset);
+		gve_netmap_copy_slots(kring, nm_i, copy_offset, copy_len, va);
+		copy_offset += copy_len;
+
+		dma = gve_get_page_dma_handle(tx, buf);
+		bus_dmamap_sync(dma->tag, dma->map, BUS_DMASYNC_PREWRITE);
+
+		gve_tx_fill_pkt_desc_dqo(tx, desc_idx,
+		    copy_len, addr, completion_tag,
+		    /*eop=*/copy_offset == pkt_len,
+		    /*csum_enabled=*/false);
+
+		if (prev_buf == -1)
+			pkt->qpl_buf_head = buf;
+		else
+			tx->dqo.qpl_bufs[prev_buf] = buf;
+
+		prev_buf = buf;
+		pkt->num_qpl_bufs++;
+	}
+
+	tx->dqo.qpl_bufs[buf] = -1;
+}
+
+static void
+gve_netmap_map_and_write_pkt_descs_dqo(struct gve_tx_ring *tx,
+    struct netmap_kring *kring, u_int nm_i, u_int last_i,
+    int16_t completion_tag, uint32_t *desc_idx)
+{
+	struct netmap_adapter *na = kring->na;
+	u_int lim = kring->nkr_num_slots - 1;
+	struct gve_tx_pending_pkt_dqo *pkt;
+	struct netmap_slot *slot;
+	uint64_t paddr;
+	void *addr;
+
+	for (;; nm_i = nm_next(nm_i, lim)) {
+		slot = &kring->ring->slot[nm_i];
+		pkt = &tx->dqo.pending_pkts[nm_i];
+
+		addr = PNMB(na, slot, &paddr);
+		netmap_load_map(na, tx->dqo.buf_dmatag, pkt->dmamap, addr);
+		bus_dmamap_sync(tx->dqo.buf_dmatag, pkt->dmamap,
+		    BUS_DMASYNC_PREWRITE);
+		slot->flags &= ~NS_BUF_CHANGED;
+
+		gve_tx_fill_pkt_desc_dqo(tx, desc_idx, slot->len, paddr,
+		    completion_tag, /*eop=*/nm_i == last_i,
+		    /*csum_enabled=*/false);
+		if (nm_i == last_i)
+			break;
+	}
+}
+
+/*
+ * Returns the number of data descs the packet in slots nm_i to last_i
+ * needs, or 0 if it cannot be sent at all.
+ */
+static int
+gve_netmap_num_data_descs_dqo(struct gve_tx_ring *tx,
+    struct netmap_kring *kring, u_int nm_i, u_int last_i, uint32_t pkt_len)
+{
+	u_int lim = kring->nkr_num_slots - 1;
+	int descs = 0;
+
+	if (gve_is_qpl(tx->com.priv))
+		return (howmany(pkt_len, GVE_TX_BUF_SIZE_DQO));
+
+	for (;; nm_i = nm_next(nm_i, lim)) {
+		descs += howmany(kring->ring->slot[nm_i].len,
+		    GVE_TX_MAX_BUF_SIZE_DQO);
+		if (nm_i == last_i)
+			break;
+	}
+
+	return (descs > GVE_TX_MAX_DATA_DESCS_DQO ? 0 : descs);
+}
+
+int
+gve_netmap_txsync_dqo(struct netmap_kring *kring, int flags)
+{
+	struct netmap_adapter *na = kring->na;
+	struct gve_priv *priv = if_getsoftc(na->ifp);
+	struct gve_tx_ring *tx = &priv->tx[kring->ring_id];
+	struct gve_tx_metadata_dqo metadata = {
+		.version = GVE_TX_METADATA_VERSION_DQO,
+	};
+	u_int lim = kring->nkr_num_slots - 1;
+	u_int const head = kring->rhead;
+	struct gve_tx_pending_pkt_dqo *pkt;
+	uint64_t tbytes = 0, tpackets = 0;
+	int data_descs, total_descs_needed;
+	uint32_t desc_idx, desc_tail;
+	u_int nm_i, last_i, j;
+	bool has_empty_slot;
+	uint32_t pkt_len;
+
+	gve_netmap_tx_cleanup_dqo(priv, tx);
+
+	/* Give back the slots of completed packets, in order */
+	nm_i = nm_next(kring->nr_hwtail, lim);
+	while (nm_i != kring->nr_hwcur &&
+	    tx->dqo.pending_pkts[nm_i].state == GVE_PACKET_STATE_FREE)
+		nm_i = nm_next(nm_i, lim);
+	kring->nr_hwtail = nm_prev(nm_i, lim);
+
+	desc_tail = tx->dqo.desc_tail;
+	nm_i = kring->nr_hwcur;
+	while (nm_i != head && gve_netmap_tx_pkt_bounds(kring, nm_i, head,
+	    &last_i, &pkt_len, &has_empty_slot)) {
+		data_descs = gve_netmap_num_data_descs_dqo(tx, kring, nm_i,
+		    last_i, pkt_len);
+		if (__predict_false(data_descs == 0 || has_empty_slot ||
+		    pkt_len > if_getmtu(priv->ifp) + ETHER_HDR_LEN +
+		    ETHER_VLAN_ENCAP_LEN)) {
+			/* The slots stay FREE and are given back next time */
+			counter_enter();
+			counter_u64_add_protected(tx->stats.tx_dropped_pkt, 1);
+			counter_exit();
+			nm_i = nm_next(last_i, lim);
+			continue;
+		}
+
+		total_descs_needed = 1 + data_descs; /* general_ctx_desc */
+		if (!gve_tx_has_desc_room_dqo(tx, total_descs_needed))
+			break;
+		if (gve_is_qpl(priv) &&
+		    !gve_tx_have_enough_qpl_bufs(tx, data_descs)) {
+			counter_enter();
+			counter_u64_add_protected(
+			    tx->stats.tx_delayed_pkt_nospace_qpl_bufs, 1);
+			counter_exit();
+			break;
+		}
+
+		pkt = &tx->dqo.pending_pkts[last_i];
+		pkt->next = nm_i;
+		gve_set_timestamp(&pkt->enqueue_time_sec);
+		for (j = nm_i;; j = nm_next(j, lim)) {
+			tx->dqo.pending_pkts[j].state =
+			    GVE_PACKET_STATE_PENDING_DATA_COMPL;
+			if (j == last_i)
+				break;
+		}
+
+		desc_idx = tx->dqo.desc_tail;
+		gve_tx_fill_general_ctx_desc(
+		    &tx->dqo.desc_ring[desc_idx].general_ctx, &metadata);
+		desc_idx = (desc_idx + 1) & tx->dqo.desc_mask;
+
+		if (gve_is_qpl(priv))
+			gve_netmap_copy_and_write_pkt_descs_dqo(tx, kring,
+			    nm_i, pkt_len, pkt, last_i, &desc_idx);
+		else
+			gve_netmap_map_and_write_pkt_descs_dqo(tx, kring,
+			    nm_i, last_i, last_i, &desc_idx);
+
+		tx->dqo.desc_tail = desc_idx;
+		gve_tx_request_desc_compl(tx, desc_idx);
+		tx->req += total_descs_needed; /* tx->req is just a sysctl counter */
+
+		tbytes += pkt_len;
+		tpackets++;
+		nm_i = nm_next(last_i, lim);
+	}
+
+	if (tx->dqo.desc_tail != desc_tail) {
+		bus_dmamap_sync(tx->desc_ring_mem.tag, tx->desc_ring_mem.map,
+		    BUS_DMASYNC_PREWRITE);
+		gve_db_bar_dqo_write_4(priv, tx->com.db_offset,
+		    tx->dqo.desc_tail);
+	}
+	kring->nr_hwcur = nm_i;
+
+	if (tpackets != 0) {
+		counter_enter();
+		counter_u64_add_protected(tx->stats.tbytes, tbytes);
+		counter_u64_add_protected(tx->stats.tpackets, tpackets);
+		counter_exit();
+	}
+
+	return (0);
+}
+#endif
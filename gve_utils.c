@@ -28,6 +28,8 @@
  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#include "opt_rss.h"
+
 #include "gve.h"
 #include "gve_dqo.h"
 
@@ -401,43 +403,306 @@ gve_setup_itr_interval_dqo(uint32_t interval_us)
 	return (result);
 }
 
+void
+gve_unmask_queue_irq(struct gve_priv *priv, struct gve_ring_com *com)
+{
+	if (gve_is_gqi(priv))
+		gve_db_bar_write_4(priv, com->irq_db_offset, 0);
+	else {
+		com->itr.hw_usecs = com->itr.cur_usecs;
+		gve_db_bar_dqo_write_4(priv, com->irq_db_offset,
+		    gve_setup_itr_interval_dqo(com->itr.hw_usecs));
+	}
+}
+
 void
 gve_unmask_all_queue_irqs(struct gve_priv *priv)
 {
-	struct gve_tx_ring *tx;
-	struct gve_rx_ring *rx;
 	int idx;
 
-	for (idx = 0; idx < priv->tx_cfg.num_queues; idx++) {
-		tx = &priv->tx[idx];
-		if (gve_is_gqi(priv))
-			gve_db_bar_write_4(priv, tx->com.irq_db_offset, 0);
-		else
-			gve_db_bar_dqo_write_4(priv, tx->com.irq_db_offset,
-			    gve_setup_itr_interval_dqo(GVE_TX_IRQ_RATELIMIT_US_DQO));
-	}
+	for (idx = 0; idx < priv->tx_cfg.num_queues; idx++)
+		gve_unmask_queue_irq(priv, &priv->tx[idx].com);
+
+	for (idx = 0; idx < priv->rx_cfg.num_queues; idx++)
+		gve_unmask_queue_irq(priv, &priv->rx[idx].com);
+}
+
+#ifndef RSS
+/* Spreads the queues over the CPUs, taking those of the device's domain first */
+static void
+gve_spread_queue_cpus(struct gve_priv *priv, int num_queues)
+{
+	int *cpus;
+	int domain;
+	int ncpus = 0;
+	int cpu;
+	int i;
 
-	for (idx = 0; idx < priv->rx_cfg.num_queues; idx++) {
-		rx = &priv->rx[idx];
-		if (gve_is_gqi(priv))
-			gve_db_bar_write_4(priv, rx->com.irq_db_offset, 0);
-		else
-			gve_db_bar_dqo_write_4(priv, rx->com.irq_db_offset,
-			    gve_setup_itr_interval_dqo(GVE_RX_IRQ_RATELIMIT_US_DQO));
+	if (bus_get_domain(priv->dev, &domain) != 0)
+		domain = -1;
+
+	cpus = malloc(sizeof(*cpus) * mp_ncpus, M_GVE, M_WAITOK);
+	CPU_FOREACH(cpu) {
+		if (pcpu_find(cpu)->pc_domain == domain)
+			cpus[ncpus++] = cpu;
+	}
+	CPU_FOREACH(cpu) {
+		if (pcpu_find(cpu)->pc_domain != domain)
+			cpus[ncpus++] = cpu;
 	}
+
+	for (i = 0; i < num_queues; i++)
+		priv->queue_cpus[i] = cpus[i % ncpus];
+	free(cpus, M_GVE);
+}
+#endif
+
+/*
+ * Picks the default CPU of each queue index. With kernel RSS the queues follow
+ * the RSS bucket CPUs so that a flow's rx and tx queue run where the stack
+ * processes it.
+ */
+void
+gve_alloc_queue_cpus(struct gve_priv *priv)
+{
+	int num_queues = MAX(priv->tx_cfg.max_queues, priv->rx_cfg.max_queues);
+#ifdef RSS
+	int i;
+#endif
+
+	priv->queue_cpus = malloc(sizeof(*priv->queue_cpus) * num_queues,
+	    M_GVE, M_WAITOK | M_ZERO);
+	priv->cpu_txq = malloc(sizeof(*priv->cpu_txq) * (mp_maxid + 1),
+	    M_GVE, M_WAITOK | M_ZERO);
+
+#ifdef RSS
+	for (i = 0; i < num_queues; i++)
+		priv->queue_cpus[i] = rss_getcpu(i % rss_getnumbuckets());
+#else
+	gve_spread_queue_cpus(priv, num_queues);
+#endif
+
+	gve_update_cpu_txq(priv);
+}
+
+void
+gve_free_queue_cpus(struct gve_priv *priv)
+{
+	free(priv->cpu_txq, M_GVE);
+	priv->cpu_txq = NULL;
+	free(priv->queue_cpus, M_GVE);
+	priv->queue_cpus = NULL;
+}
+
+/* Rebuilds the CPU to tx queue map after the tx queues or their CPUs change. */
+void
+gve_update_cpu_txq(struct gve_priv *priv)
+{
+	int cpu;
+	int i;
+
+	CPU_FOREACH(cpu)
+		priv->cpu_txq[cpu] = cpu % priv->tx_cfg.num_queues;
+
+	/* Walk backwards so that the lowest queue on a CPU wins */
+	for (i = priv->tx_cfg.num_queues - 1; i >= 0; i--)
+		priv->cpu_txq[priv->queue_cpus[i]] = i;
+}
+
+/* Binds a queue's irq to its CPU; the taskqueues are bound as they start. */
+void
+gve_bind_queue(struct gve_priv *priv, struct gve_ring_com *com)
+{
+	struct gve_irq *irq = &priv->irq_tbl[com->ntfy_id];
+	int cpu = priv->queue_cpus[com->id];
+	int err;
+
+	err = bus_bind_intr(priv->dev, irq->res, cpu);
+	if (err != 0)
+		device_printf(priv->dev,
+		    "Failed to bind irq %d to cpu %d, err: %d\n",
+		    (int)rman_get_rid(irq->res), cpu, err);
+}
+
+/* Rates and intervals that the adaptive interrupt moderation works with */
+#define GVE_ITR_ADAPT_PERIOD (10 * SBT_1MS)
+#define GVE_ITR_ADAPT_LOW_PPS 10000
+#define GVE_ITR_ADAPT_HIGH_PPS 100000
+#define GVE_ITR_ADAPT_BULK_PKT_SIZE 1024
+#define GVE_ITR_ADAPT_MID_USECS 10
+#define GVE_ITR_ADAPT_HIGH_USECS 30
+#define GVE_ITR_ADAPT_BULK_USECS 60
+
+void
+gve_itr_init(struct gve_ring_com *com, uint32_t usecs)
+{
+	struct gve_itr *itr = &com->itr;
+
+	itr->usecs = usecs;
+	itr->cur_usecs = usecs;
+	itr->frames = 0;
+	itr->adaptive = false;
+	callout_init(&itr->poll_callout, 1);
+}
+
+/*
+ * Picks an interval from the packet and byte rates seen since the last sample:
+ * sparse traffic gets interrupts right away for latency, small-packet floods
+ * and bulk flows get progressively longer batches.
+ */
+static void
+gve_itr_adapt(struct gve_itr *itr, counter_u64_t packets, counter_u64_t bytes)
+{
+	sbintime_t now = getsbinuptime();
+	sbintime_t elapsed = now - itr->sample_time;
+	uint64_t npackets;
+	uint64_t nbytes;
+	uint64_t avg_size;
+	uint64_t pps;
+
+	if (elapsed < GVE_ITR_ADAPT_PERIOD)
+		return;
+
+	npackets = counter_u64_fetch(packets);
+	nbytes = counter_u64_fetch(bytes);
+	pps = (npackets - itr->sample_packets) * SBT_1S / elapsed;
+	avg_size = npackets != itr->sample_packets ?
+	    (nbytes - itr->sample_bytes) / (npackets - itr->sample_packets) : 0;
+
+	if (pps < GVE_ITR_ADAPT_LOW_PPS)
+		itr->cur_usecs = 0;
+	else if (avg_size >= GVE_ITR_ADAPT_BULK_PKT_SIZE)
+		itr->cur_usecs = GVE_ITR_ADAPT_BULK_USECS;
+	else if (pps >= GVE_ITR_ADAPT_HIGH_PPS)
+		itr->cur_usecs = GVE_ITR_ADAPT_HIGH_USECS;
+	else
+		itr->cur_usecs = GVE_ITR_ADAPT_MID_USECS;
+
+	itr->sample_time = now;
+	itr->sample_packets = npackets;
+	itr->sample_bytes = nbytes;
+}
+
+/*
+ * Returns the interval the queue's irq should be re-armed with after a cleanup
+ * pass that handled `work_done` completions. Passes lighter than the frames
+ * threshold re-arm without delay.
+ */
+uint32_t
+gve_itr_rearm_usecs(struct gve_ring_com *com, uint32_t work_done,
+    counter_u64_t packets, counter_u64_t bytes)
+{
+	struct gve_itr *itr = &com->itr;
+
+	if (itr->adaptive)
+		gve_itr_adapt(itr, packets, bytes);
+	else
+		itr->cur_usecs = itr->usecs;
+
+	if (work_done < itr->frames)
+		return (0);
+	return (itr->cur_usecs);
+}
+
+/* Builds the DQO irq doorbell value that re-arms with the given interval. */
+uint32_t
+gve_itr_db_val_dqo(struct gve_ring_com *com, uint32_t usecs)
+{
+	if (usecs == com->itr.hw_usecs)
+		return (GVE_ITR_NO_UPDATE_DQO | GVE_ITR_ENABLE_BIT_DQO);
+
+	com->itr.hw_usecs = usecs;
+	return (gve_setup_itr_interval_dqo(usecs));
+}
+
+static void
+gve_itr_poll(void *arg)
+{
+	struct gve_ring_com *com = arg;
+
+	taskqueue_enqueue(com->cleanup_tq, &com->cleanup_task);
+}
+
+/* Runs the cleanup task again after `usecs` while the irq stays masked. */
+void
+gve_itr_schedule_poll(struct gve_ring_com *com, uint32_t usecs)
+{
+	callout_reset_sbt(&com->itr.poll_callout, usecs * SBT_1US, 0,
+	    gve_itr_poll, com, 0);
+}
+
+/*
+ * Quiesces the cleanup task along with the poll callout. Each of them can
+ * bring the other back, so the callout goes first and both are stopped again
+ * until the task leaves the callout idle.
+ */
+void
+gve_itr_stop(struct gve_ring_com *com)
+{
+	do {
+		callout_drain(&com->itr.poll_callout);
+		taskqueue_quiesce(com->cleanup_tq);
+	} while (callout_pending(&com->itr.poll_callout));
+}
+
+void
+gve_mask_queue_irq(struct gve_priv *priv, struct gve_ring_com *com)
+{
+	gve_db_bar_write_4(priv, com->irq_db_offset, GVE_IRQ_MASK);
 }
 
 void
 gve_mask_all_queue_irqs(struct gve_priv *priv)
 {
-	for (int idx = 0; idx < priv->tx_cfg.num_queues; idx++) {
-		struct gve_tx_ring *tx = &priv->tx[idx];
-		gve_db_bar_write_4(priv, tx->com.irq_db_offset, GVE_IRQ_MASK);
-	}
-	for (int idx = 0; idx < priv->rx_cfg.num_queues; idx++) {
-		struct gve_rx_ring *rx = &priv->rx[idx];
-		gve_db_bar_write_4(priv, rx->com.irq_db_offset, GVE_IRQ_MASK);
-	}
+	for (int idx = 0; idx < priv->tx_cfg.num_queues; idx++)
+		gve_mask_queue_irq(priv, &priv->tx[idx].com);
+	for (int idx = 0; idx < priv->rx_cfg.num_queues; idx++)
+		gve_mask_queue_irq(priv, &priv->rx[idx].com);
+}
+
+/*
+ * Paces a busy-poll loop: returns true while the queue's busy-poll budget,
+ * which starts on the first call with *deadline zeroed, has not run out.
+ */
+bool
+gve_busy_poll_spin(struct gve_ring_com *com, sbintime_t *deadline)
+{
+	sbintime_t now;
+
+	if (com->busy_poll_usecs == 0)
+		return (false);
+
+	now = getsbinuptime();
+	if (*deadline == 0)
+		*deadline = now + com->busy_poll_usecs * SBT_1US;
+	else if (now >= *deadline)
+		return (false);
+
+	cpu_spinwait();
+	return (true);
+}
+
+/*
+ * The device leaves VLAN tags in band. With IFCAP_VLAN_HWTAGGING enabled, move
+ * the outer tag into the packet header as a tag-stripping NIC would.
+ */
+void
+gve_rx_strip_vlan(struct mbuf *mbuf)
+{
+	struct ether_vlan_header *evl;
+
+	if (mbuf->m_len < sizeof(*evl))
+		return;
+
+	evl = mtod(mbuf, struct ether_vlan_header *);
+	if (evl->evl_encap_proto != htons(ETHERTYPE_VLAN))
+		return;
+
+	mbuf->m_pkthdr.ether_vtag = ntohs(evl->evl_tag);
+	mbuf->m_flags |= M_VLANTAG;
+	bcopy(evl, (char *)evl + ETHER_VLAN_ENCAP_LEN,
+	    ETHER_HDR_LEN - ETHER_TYPE_LEN);
+	m_adj(mbuf, ETHER_VLAN_ENCAP_LEN);
 }
 
 /*
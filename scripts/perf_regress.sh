@@ -0,0 +1,263 @@
+#!/usr/local/bin/bash
+
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Copyright (c) 2023 Google LLC
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice, this
+#    list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+#    may be used to endorse or promote products derived from this software without
+#    specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+# ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+# ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+# Runs a fixed set of netperf tests against a peer running netserver across a
+# sweep of queue counts, ring sizes and MTUs, and writes one CSV row per run
+# to ${OUTDIR}/results.csv. Each row carries the aggregate throughput, the
+# RR latency percentiles, the CPU utilization netperf measured on both ends
+# and the driver-side drops seen during the run. The per-queue counter deltas
+# of every run are kept in ${OUTDIR}/<run>.stats.
+#
+# With -b, every run is compared against the row with the same test, queue
+# count, ring size, MTU and flow count in an earlier results.csv: it fails if
+# its throughput dropped or its p99 latency grew by more than the tolerance,
+# and the script exits with 1 if any run failed.
+#
+# The peer needs netserver running and an MTU at least as large as the
+# largest swept one. Changing the sysctls briefly takes the interface down.
+
+IFACE="gve0"
+SERVER_IP="192.168.100.1"
+DURATION=30
+NUM_FLOWS=8
+CRR_FLOWS=64
+UDP_MSG_SIZE=64
+TESTS="tcp_rr tcp_stream udp_pps tcp_crr"
+QUEUE_COUNTS=""
+RING_SIZES=""
+MTUS=""
+BASELINE=""
+TOLERANCE_PCT=5
+OUTDIR="/tmp/gve_perf_$(date +%Y%m%d_%H%M%S)"
+SETTLE_SECS=5
+
+usage() {
+  printf "Usage: %s: [-i <iface>] [-s <server ip>] [-l <test len seconds>]\n" $0
+  printf "    [-f <flows>] [-c <crr flows>] [-t <tests>] [-q <queue counts>]\n"
+  printf "    [-r <ring sizes>] [-m <mtus>] [-b <baseline results.csv>]\n"
+  printf "    [-T <tolerance pct>] [-o <output dir>]\n"
+  printf "    -t picks from \"%s\"\n" "${TESTS}"
+  printf "    -q, -r and -m take space separated lists to sweep, the current\n"
+  printf "    setting is used when one is not given\n"
+  exit 2
+}
+
+while getopts i:s:l:f:c:t:q:r:m:b:T:o: name
+do
+    case ${name} in
+    i)   IFACE="$OPTARG";;
+    s)   SERVER_IP="$OPTARG";;
+    l)   DURATION="$OPTARG";;
+    f)   NUM_FLOWS="$OPTARG";;
+    c)   CRR_FLOWS="$OPTARG";;
+    t)   TESTS="$OPTARG";;
+    q)   QUEUE_COUNTS="$OPTARG";;
+    r)   RING_SIZES="$OPTARG";;
+    m)   MTUS="$OPTARG";;
+    b)   BASELINE="$OPTARG";;
+    T)   TOLERANCE_PCT="$OPTARG";;
+    o)   OUTDIR="$OPTARG";;
+    ?)   usage;;
+    esac
+done
+
+UNIT="${IFACE##*[!0-9]}"
+SYSCTL_ROOT="dev.gve.${UNIT}"
+RESULTS="${OUTDIR}/results.csv"
+
+if ! sysctl -n "${SYSCTL_ROOT}.num_rx_queues" > /dev/null 2>&1; then
+  echo "${IFACE} is not a gve interface"
+  exit 1
+fi
+
+[[ -z "${QUEUE_COUNTS}" ]] && QUEUE_COUNTS="$(sysctl -n ${SYSCTL_ROOT}.num_rx_queues)"
+# Without modify_ringsize support there are no ring size sysctls to sweep, and
+# every run goes at whatever size the device picked.
+if sysctl -n "${SYSCTL_ROOT}.rx_ring_size" > /dev/null 2>&1; then
+  [[ -z "${RING_SIZES}" ]] && RING_SIZES="$(sysctl -n ${SYSCTL_ROOT}.rx_ring_size)"
+elif [[ -n "${RING_SIZES}" ]]; then
+  echo "${IFACE} does not support changing its ring sizes"
+  exit 1
+else
+  RING_SIZES="current"
+fi
+[[ -z "${MTUS}" ]] && MTUS="$(ifconfig ${IFACE} | sed -nr 's/.*mtu ([0-9]+).*/\1/p')"
+
+mkdir -p "${OUTDIR}" || exit 1
+pkill netperf
+trap "pkill netperf" EXIT
+
+# Applies a sysctl only when it changes, since every change is a down/up.
+function set_sysctl() {
+  if [[ "$(sysctl -n ${SYSCTL_ROOT}.$1)" != "$2" ]]; then
+    sysctl "${SYSCTL_ROOT}.$1=$2" > /dev/null || exit 1
+  fi
+}
+
+function wait_for_peer() {
+  sleep ${SETTLE_SECS}
+  for i in $(seq 1 30); do
+    ping -c 1 -t 1 "${SERVER_IP}" > /dev/null 2>&1 && return
+    sleep 1
+  done
+  echo "$(date): ${SERVER_IP} unreachable after reconfiguring ${IFACE}"
+  exit 1
+}
+
+# Plain numeric per-queue counters, histograms and strings are left out.
+function snapshot_stats() {
+  sysctl -e "${SYSCTL_ROOT}" | grep -E "^${SYSCTL_ROOT}\.[rt]xq[0-9]+\." |
+    grep -E '=[0-9]+$' | sort -t= -k1,1
+}
+
+# Runs flows instances of one netperf test and prints the aggregate as
+# "throughput,units,p50_us,p99_us,local_cpu,remote_cpu".
+function run_netperf() {
+  local flows=$1 test=$2 out=$3 selectors=$4
+  shift 4
+  local tmp="${OUTDIR}/.netperf"
+
+  : > "${tmp}"
+  for i in $(seq 1 ${flows}); do
+    netperf -P 0 -H "${SERVER_IP}" -l ${DURATION} -t ${test} -c -C -- \
+      -o "${selectors}" "$@" >> "${tmp}" 2>&1 &
+  done
+  wait
+
+  cat "${tmp}" >> "${out}.netperf"
+  # Sums throughput over the flows, keeps the worst latency and the busiest cpu
+  awk -F, -v flows=${flows} '
+    NF == 6 && $1 ~ /^[0-9.]+$/ {
+      n++; tput += $1; units = $2; p50 += $3
+      if ($4 > p99) p99 = $4
+      if ($5 > lcpu) lcpu = $5
+      if ($6 > rcpu) rcpu = $6
+    }
+    END {
+      if (n != flows) exit 1
+      printf "%.2f,%s,%.1f,%.1f,%.1f,%.1f\n", tput, units, p50 / n, p99,
+        lcpu, rcpu
+    }' "${tmp}"
+}
+
+function run_test() {
+  local test=$1 out=$2
+  local rr_sel="THROUGHPUT,THROUGHPUT_UNITS,P50_LATENCY,P99_LATENCY,LOCAL_CPU_UTIL,REMOTE_CPU_UTIL"
+  local udp_sel="REMOTE_RECV_THROUGHPUT,THROUGHPUT_UNITS,P50_LATENCY,P99_LATENCY,LOCAL_CPU_UTIL,REMOTE_CPU_UTIL"
+  local result
+
+  case ${test} in
+  tcp_rr)
+    run_netperf 1 TCP_RR "${out}" "${rr_sel}" -r 1,1;;
+  tcp_stream)
+    run_netperf ${NUM_FLOWS} TCP_STREAM "${out}" "${rr_sel}";;
+  tcp_crr)
+    run_netperf ${CRR_FLOWS} TCP_CRR "${out}" "${rr_sel}" -r 1,1;;
+  udp_pps)
+    # Turns the received 10^6 bits/s into packets per second
+    result="$(run_netperf ${NUM_FLOWS} UDP_STREAM "${out}" "${udp_sel}" \
+      -R 1 -m ${UDP_MSG_SIZE})" || return 1
+    echo "${result}" | awk -F, -v size=${UDP_MSG_SIZE} 'BEGIN { OFS = "," }
+      { $1 = sprintf("%.0f", $1 * 1000000 / 8 / size); $2 = "pps"; print }';;
+  *)
+    echo "Unknown test ${test}" >&2
+    return 1;;
+  esac
+}
+
+# Prints "pass" or "fail" for a run against its BASELINE row, "new" if none.
+function verdict() {
+  local key=$1 tput=$2 p99=$3
+
+  [[ -z "${BASELINE}" ]] && echo "new" && return
+  awk -F, -v key="${key}" -v tput=${tput} -v p99=${p99} \
+    -v tol=${TOLERANCE_PCT} '
+    $1 "," $2 "," $3 "," $4 "," $5 == key {
+      found = 1
+      if (tput < $6 * (100 - tol) / 100 ||
+          ($9 > 0 && p99 > $9 * (100 + tol) / 100))
+        bad = 1
+    }
+    END { print !found ? "new" : bad ? "fail" : "pass" }' "${BASELINE}"
+}
+
+failed=0
+echo "test,queues,ring_size,mtu,flows,throughput,units,p50_us,p99_us,local_cpu,remote_cpu,drops,verdict" > "${RESULTS}"
+
+for mtu in ${MTUS}; do
+  ifconfig ${IFACE} mtu ${mtu} || exit 1
+  for queues in ${QUEUE_COUNTS}; do
+    set_sysctl num_rx_queues ${queues}
+    set_sysctl num_tx_queues ${queues}
+    for ring in ${RING_SIZES}; do
+      if [[ "${ring}" != "current" ]]; then
+        set_sysctl rx_ring_size ${ring}
+        set_sysctl tx_ring_size ${ring}
+      fi
+      wait_for_peer
+
+      for test in ${TESTS}; do
+        case ${test} in
+        tcp_rr) flows=1;;
+        tcp_crr) flows=${CRR_FLOWS};;
+        *) flows=${NUM_FLOWS};;
+        esac
+        run="${test}_q${queues}_r${ring}_m${mtu}"
+        out="${OUTDIR}/${run}"
+        echo "$(date): ${run} with ${flows} flows"
+
+        snapshot_stats > "${out}.before"
+        if ! result="$(run_test ${test} "${out}")"; then
+          echo "$(date): ${run} did not complete, see ${out}.netperf"
+          failed=1
+          continue
+        fi
+        snapshot_stats > "${out}.after"
+
+        # Counter deltas over the run, only the ones that moved
+        join -t= "${out}.before" "${out}.after" |
+          awk -F= '$3 != $2 { print $1 "=" $3 - $2 }' > "${out}.stats"
+        rm -f "${out}.before" "${out}.after"
+        drops="$(awk -F= '$1 ~ /_dropped_pkt$/ { sum += $2 }
+          END { print sum + 0 }' "${out}.stats")"
+
+        key="${test},${queues},${ring},${mtu},${flows}"
+        v="$(verdict "${key}" "$(echo ${result} | cut -d, -f1)" \
+          "$(echo ${result} | cut -d, -f4)")"
+        [[ "${v}" == "fail" ]] && failed=1
+        echo "${key},${result},${drops},${v}" | tee -a "${RESULTS}"
+      done
+    done
+  done
+done
+
+echo "$(date): Results in ${RESULTS}"
+exit ${failed}